@@ -0,0 +1,155 @@
+/*
+ * Load test for the channel API: every round sets a new duty cycle on
+ * all given channels and reads the frequencies back, either with one
+ * ioctl per change or gathered into PWM_BATCH calls. Prints one JSON
+ * object per mode with the rate and the kernel calls per round.
+ *
+ * On a machine without OMAP3 timers load the driver with
+ *   insmod pwm.ko sim=1 timers=8,9,10,11
+ *
+ * usage: pwm_load [-n rounds] [-t threads] timer [timer...]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "pwm.hpp"
+
+static unsigned int rounds = 10000;
+static int nthreads = 1;
+static std::vector<int> timers;
+static std::atomic<unsigned long> errors;
+static std::atomic<unsigned long> calls;
+
+/* one ioctl per change */
+static void run_single(unsigned int seed)
+{
+	std::vector<pwm::Channel> ch;
+
+	for (int t : timers)
+		ch.emplace_back(t);
+
+	for (auto &c : ch)
+		c.enable();
+
+	for (unsigned int i = 0; i < rounds; i++) {
+		for (auto &c : ch) {
+			try {
+				c.duty(1 + (seed + i) % 99);
+				c.frequency();
+				calls += 2;
+			} catch (const std::system_error &) {
+				errors++;
+			}
+		}
+	}
+}
+
+/* all changes of a round in one batch, the driver wants each channel open */
+static void run_batch(unsigned int seed)
+{
+	std::vector<pwm::Channel> ch;
+	pwm::Batch b;
+
+	for (int t : timers)
+		ch.emplace_back(t);
+
+	const pwm::Channel &via = ch.front();
+
+	for (int t : timers)
+		b.enable(t);
+	b.submit(via);
+
+	for (unsigned int i = 0; i < rounds; i++) {
+		b.clear();
+
+		for (int t : timers) {
+			b.duty(t, 1 + (seed + i) % 99);
+			b.get_frequency(t);
+		}
+
+		try {
+			b.submit(via);
+			calls += b.calls();
+		} catch (const std::system_error &) {
+			errors++;
+		}
+	}
+}
+
+static void run(const char *mode, void (*fn)(unsigned int))
+{
+	std::vector<std::thread> threads;
+
+	errors = 0;
+	calls = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < nthreads; i++)
+		threads.emplace_back([fn, i] {
+			try {
+				fn(i * 37);
+			} catch (const std::system_error &e) {
+				std::fprintf(stderr, "%s\n", e.what());
+				errors += rounds;
+			}
+		});
+
+	for (auto &t : threads)
+		t.join();
+
+	std::chrono::duration<double> elapsed =
+	    std::chrono::steady_clock::now() - start;
+	double changes = 2.0 * timers.size() * rounds * nthreads;
+
+	std::printf("{\"mode\":\"%s\",\"threads\":%d,\"channels\":%zu,"
+		    "\"rounds\":%u,\"errors\":%lu,\"seconds\":%.6f,"
+		    "\"changes_per_sec\":%.1f,\"calls_per_round\":%.2f}\n",
+		    mode, nthreads, timers.size(), rounds, errors.load(),
+		    elapsed.count(), changes / elapsed.count(),
+		    (double)calls / ((double)rounds * nthreads));
+	std::fflush(stdout);
+}
+
+static void usage(const char *argv0)
+{
+	std::fprintf(stderr, "usage: %s [-n rounds] [-t threads] "
+		     "timer [timer...]\n", argv0);
+	std::exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+		switch (opt) {
+		case 'n':
+			rounds = std::strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nthreads = std::atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	for (int i = optind; i < argc; i++)
+		timers.push_back(std::atoi(argv[i]));
+
+	if (timers.empty() || rounds < 1 || nthreads < 1)
+		usage(argv[0]);
+
+	run("single", run_single);
+	run("batch", run_batch);
+
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Header-only C++ layer over pwmlib.
+ *
+ *   pwm::Channel ch(9);           // opens /dev/pwm9, throws on failure
+ *   ch.frequency(1024);
+ *   ch.duty(25);
+ *   ch.enable();
+ *
+ *   pwm::Batch b;
+ *   b.duty(9, 10).duty(10, 90).enable(9).enable(10);
+ *   b.submit(ch);                 // one PWM_BATCH ioctl
+ *
+ * The register helpers compute what the driver will program for a
+ * given input clock, frequency and duty, at compile time if the
+ * arguments are constants.
+ */
+
+#ifndef PWM_HPP
+#define PWM_HPP
+
+#include <cstdint>
+#include <system_error>
+#include <utility>
+
+#include "pwmlib.h"
+
+namespace pwm {
+
+namespace regs {
+
+/*
+ * The driver only runs even frequencies up to half the input clock.
+ * Below 2 Hz it falls back to its default, which is not known here.
+ */
+constexpr std::uint32_t frequency(std::uint32_t input_hz, std::uint32_t hz)
+{
+	return (hz & ~1u) == 0 ? 0
+	    : (hz & ~1u) > input_hz / 2 ? input_hz / 2 : (hz & ~1u);
+}
+
+/* PWM_FREQ = input / ((0xFFFFFFFF - TLDR) + 1) */
+constexpr std::uint32_t tldr(std::uint32_t input_hz, std::uint32_t hz)
+{
+	return 0xFFFFFFFFu - (input_hz / frequency(input_hz, hz) - 1);
+}
+
+constexpr std::uint32_t num_freqs(std::uint32_t input_hz, std::uint32_t hz)
+{
+	return 0xFFFFFFFEu - tldr(input_hz, hz);
+}
+
+/* TMAR for duty percent, 0 for a duty of 0 where the timer is stopped */
+constexpr std::uint32_t tmar(std::uint32_t input_hz, std::uint32_t hz,
+			     std::uint32_t percent)
+{
+	return percent == 0 ? 0
+	    : tldr(input_hz, hz)
+	    + (percent * num_freqs(input_hz, hz) / 100 < 1 ? 1
+	       : percent * num_freqs(input_hz, hz) / 100
+	       > num_freqs(input_hz, hz) ? num_freqs(input_hz, hz)
+	       : percent * num_freqs(input_hz, hz) / 100);
+}
+
+static_assert(tldr(PWM_INPUT_32K, 1024) == 0xFFFFFFE0u,
+	      "32 ticks per period at 1024 Hz");
+static_assert(tmar(PWM_INPUT_32K, 1024, 50) == 0xFFFFFFEFu,
+	      "half of the 30 usable steps");
+
+} // namespace regs
+
+inline void check(int ret, const char *what)
+{
+	if (ret < 0)
+		throw std::system_error(-ret, std::generic_category(), what);
+}
+
+class Channel {
+public:
+	explicit Channel(int timer)
+	{
+		check(pwmlib_open(&ch_, timer), "open");
+	}
+
+	~Channel()
+	{
+		pwmlib_close(&ch_);
+	}
+
+	Channel(const Channel &) = delete;
+	Channel &operator=(const Channel &) = delete;
+
+	Channel(Channel &&other) noexcept : ch_(other.ch_)
+	{
+		other.ch_.fd = -1;
+	}
+
+	Channel &operator=(Channel &&other) noexcept
+	{
+		if (this != &other) {
+			pwmlib_close(&ch_);
+			ch_ = other.ch_;
+			other.ch_.fd = -1;
+		}
+		return *this;
+	}
+
+	int timer() const { return ch_.timer; }
+	int fd() const { return ch_.fd; }
+
+	void frequency(int hz)
+	{
+		check(pwmlib_set_frequency(&ch_, hz), "PWM_SET_FREQUENCY");
+	}
+
+	int frequency()
+	{
+		int ret = pwmlib_get_frequency(&ch_);
+
+		check(ret, "PWM_GET_FREQUENCY");
+		return ret;
+	}
+
+	void duty(int percent)
+	{
+		check(pwmlib_set_duty(&ch_, percent), "PWM_SET_DUTYCYCLE");
+	}
+
+	int duty()
+	{
+		int ret = pwmlib_get_duty(&ch_);
+
+		check(ret, "PWM_GET_DUTYCYCLE");
+		return ret;
+	}
+
+	void polarity(bool inverted)
+	{
+		check(pwmlib_set_polarity(&ch_, inverted), "PWM_SET_POLARITY");
+	}
+
+	void enable() { check(pwmlib_enable(&ch_), "PWM_ON"); }
+	void disable() { check(pwmlib_disable(&ch_), "PWM_OFF"); }
+
+private:
+	pwmlib_channel ch_;
+};
+
+class Batch {
+public:
+	Batch() { pwmlib_batch_init(&b_); }
+
+	Batch &frequency(int timer, int hz)
+	{
+		return add(timer, PWM_SET_FREQUENCY, hz);
+	}
+
+	Batch &duty(int timer, int percent)
+	{
+		return add(timer, PWM_SET_DUTYCYCLE, percent);
+	}
+
+	Batch &polarity(int timer, bool inverted)
+	{
+		return add(timer, PWM_SET_POLARITY, inverted);
+	}
+
+	/* the value ends up in result() */
+	Batch &get_frequency(int timer)
+	{
+		return add(timer, PWM_GET_FREQUENCY, 0);
+	}
+
+	Batch &get_duty(int timer)
+	{
+		return add(timer, PWM_GET_DUTYCYCLE, 0);
+	}
+
+	Batch &enable(int timer) { return add(timer, PWM_ON, 0); }
+	Batch &disable(int timer) { return add(timer, PWM_OFF, 0); }
+
+	/* throws on the first failed op, result() has all of them */
+	void submit(const Channel &via)
+	{
+		check(pwmlib_batch_submit(via.fd(), &b_, &calls_),
+		      "PWM_BATCH");
+	}
+
+	void clear() { pwmlib_batch_init(&b_); }
+
+	unsigned int size() const { return b_.count; }
+	int calls() const { return calls_; }
+	int result(unsigned int i) const { return b_.op[i].result; }
+
+private:
+	Batch &add(int timer, unsigned int cmd, int value)
+	{
+		check(pwmlib_batch_add(&b_, timer, cmd, value), "batch");
+		return *this;
+	}
+
+	pwmlib_batch b_;
+	int calls_ = 0;
+};
+
+} // namespace pwm
+
+#endif // PWM_HPP
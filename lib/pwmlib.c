@@ -0,0 +1,183 @@
+/*
+ * Userspace access to the /dev/pwmN channels, see pwmlib.h.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "pwmlib.h"
+
+/* the getters return their value, everything else 0 */
+static int pwmlib_ioctl(struct pwmlib_channel *ch, unsigned int cmd,
+			unsigned long arg)
+{
+	int ret;
+
+	if (ch->fd < 0)
+		return -EBADF;
+
+	ret = ioctl(ch->fd, cmd, arg);
+
+	return ret < 0 ? -errno : ret;
+}
+
+int pwmlib_open(struct pwmlib_channel *ch, int timer)
+{
+	char path[32];
+
+	snprintf(path, sizeof(path), "/dev/pwm%d", timer);
+
+	ch->timer = timer;
+	ch->fd = open(path, O_RDWR | O_CLOEXEC);
+
+	return ch->fd < 0 ? -errno : 0;
+}
+
+void pwmlib_close(struct pwmlib_channel *ch)
+{
+	if (ch->fd >= 0)
+		close(ch->fd);
+
+	ch->fd = -1;
+}
+
+int pwmlib_set_frequency(struct pwmlib_channel *ch, int hz)
+{
+	return pwmlib_ioctl(ch, PWM_SET_FREQUENCY, hz);
+}
+
+int pwmlib_get_frequency(struct pwmlib_channel *ch)
+{
+	return pwmlib_ioctl(ch, PWM_GET_FREQUENCY, 0);
+}
+
+int pwmlib_set_duty(struct pwmlib_channel *ch, int percent)
+{
+	return pwmlib_ioctl(ch, PWM_SET_DUTYCYCLE, percent);
+}
+
+int pwmlib_get_duty(struct pwmlib_channel *ch)
+{
+	return pwmlib_ioctl(ch, PWM_GET_DUTYCYCLE, 0);
+}
+
+int pwmlib_set_polarity(struct pwmlib_channel *ch, int inverted)
+{
+	return pwmlib_ioctl(ch, PWM_SET_POLARITY, inverted ? 1 : 0);
+}
+
+int pwmlib_enable(struct pwmlib_channel *ch)
+{
+	return pwmlib_ioctl(ch, PWM_ON, 0);
+}
+
+int pwmlib_disable(struct pwmlib_channel *ch)
+{
+	return pwmlib_ioctl(ch, PWM_OFF, 0);
+}
+
+void pwmlib_batch_init(struct pwmlib_batch *b)
+{
+	b->count = 0;
+}
+
+int pwmlib_batch_add(struct pwmlib_batch *b, int timer, unsigned int cmd,
+		     int value)
+{
+	struct pwm_batch_op *op;
+	unsigned int i;
+
+	/* only the last value counts for the setters */
+	if (cmd != PWM_ON && cmd != PWM_OFF) {
+		for (i = 0; i < b->count; i++) {
+			op = &b->op[i];
+			if (op->timer == (__u32)timer && op->cmd == cmd) {
+				op->value = value;
+				return 0;
+			}
+		}
+	}
+
+	if (b->count >= PWMLIB_BATCH_MAX)
+		return -ENOSPC;
+
+	op = &b->op[b->count++];
+	op->timer = timer;
+	op->cmd = cmd;
+	op->value = value;
+	op->result = 0;
+
+	return 0;
+}
+
+/* one ioctl per op on /dev/pwm<timer>, for drivers without PWM_BATCH */
+static int pwmlib_batch_fallback(struct pwmlib_batch *b, int *calls)
+{
+	struct pwmlib_channel ch;
+	struct pwm_batch_op *op;
+	unsigned int i;
+	int error = 0;
+
+	for (i = 0; i < b->count; i++) {
+		op = &b->op[i];
+
+		op->result = pwmlib_open(&ch, op->timer);
+		if (!op->result) {
+			op->result = pwmlib_ioctl(&ch, op->cmd, op->value);
+			pwmlib_close(&ch);
+			(*calls)++;
+		}
+
+		if (op->result < 0 && !error)
+			error = op->result;
+	}
+
+	return error;
+}
+
+int pwmlib_batch_submit(int fd, struct pwmlib_batch *b, int *calls)
+{
+	struct pwm_batch req;
+	unsigned int done, n;
+	int error = 0, ncalls = 0;
+
+	for (done = 0; done < b->count; done += n) {
+		n = b->count - done;
+		if (n > PWM_BATCH_MAX)
+			n = PWM_BATCH_MAX;
+
+		req.count = n;
+		memcpy(req.op, &b->op[done], n * sizeof(req.op[0]));
+
+		ncalls++;
+
+		if (ioctl(fd, PWM_BATCH, &req) < 0) {
+			if (errno == ENOTTY && done == 0) {
+				ncalls = 0;
+				error = pwmlib_batch_fallback(b, &ncalls);
+				break;
+			}
+
+			/* results are only valid if the ops were run */
+			if (errno == EINVAL || errno == EFAULT
+			    || errno == ENOMEM) {
+				error = -errno;
+				break;
+			}
+
+			if (!error)
+				error = -errno;
+		}
+
+		memcpy(&b->op[done], req.op, n * sizeof(req.op[0]));
+	}
+
+	if (calls)
+		*calls = ncalls;
+
+	return error;
+}
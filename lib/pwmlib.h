@@ -0,0 +1,65 @@
+/*
+ * Userspace access to the /dev/pwmN channels.
+ *
+ * A channel keeps its file descriptor open until pwmlib_close(). The
+ * batch functions gather changes for any number of channels and send
+ * them with as few PWM_BATCH ioctls as possible, falling back to one
+ * ioctl per change on drivers without PWM_BATCH.
+ *
+ * Functions return 0 or a value on success and -errno on failure.
+ */
+
+#ifndef PWMLIB_H
+#define PWMLIB_H
+
+#include "../pwm_ioctl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pwmlib_channel {
+	int fd;
+	int timer;		/* GPT number, /dev/pwm<timer> */
+};
+
+int pwmlib_open(struct pwmlib_channel *ch, int timer);
+void pwmlib_close(struct pwmlib_channel *ch);
+
+int pwmlib_set_frequency(struct pwmlib_channel *ch, int hz);
+int pwmlib_get_frequency(struct pwmlib_channel *ch);
+int pwmlib_set_duty(struct pwmlib_channel *ch, int percent);
+int pwmlib_get_duty(struct pwmlib_channel *ch);
+int pwmlib_set_polarity(struct pwmlib_channel *ch, int inverted);
+int pwmlib_enable(struct pwmlib_channel *ch);
+int pwmlib_disable(struct pwmlib_channel *ch);
+
+/*
+ * Ops are kept in the order added, except that a second op with the
+ * same timer and cmd replaces the value of the first one.
+ */
+#define PWMLIB_BATCH_MAX	256
+
+struct pwmlib_batch {
+	unsigned int count;
+	struct pwm_batch_op op[PWMLIB_BATCH_MAX];
+};
+
+void pwmlib_batch_init(struct pwmlib_batch *b);
+int pwmlib_batch_add(struct pwmlib_batch *b, int timer, unsigned int cmd,
+		     int value);
+
+/*
+ * Sends the batch through the driver on fd, any open channel will do.
+ * The driver only runs ops on channels the process has open itself,
+ * see PWM_BATCH.
+ * op[].result is filled in, the return value is the first error or 0.
+ * Returns the number of kernel calls made in *calls if not NULL.
+ */
+int pwmlib_batch_submit(int fd, struct pwmlib_batch *b, int *calls);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef PWMLIB_H */
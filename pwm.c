@@ -33,13 +33,36 @@
 #include <linux/fs.h>
 #include <linux/errno.h>
 #include <asm/io.h>
-#include <asm/uaccess.h>
+#include <linux/uaccess.h>
 #include <linux/moduleparam.h>
 #include <linux/string.h>
 #include <linux/ioctl.h>
 #include <linux/slab.h>
-
-#include "pwm.h"
+#include <linux/interrupt.h>
+#include <linux/mutex.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/err.h>
+#include <linux/math64.h>
+#include <linux/delay.h>
+#ifdef CONFIG_PWM
+#include <linux/platform_device.h>
+#include <linux/pwm.h>
+#endif
+
+#include "pwm_core.h"
+#include "pwm_conv.h"
+#include "pwm_gpt_sim.h"
+
+#define PWM_SEQ_DEV	struct pwm_dev
+#define pwm_seq_read	pwm_reg_read
+#define pwm_seq_write	pwm_reg_write
+#include "pwm_seq.h"
+
+#define CREATE_TRACE_POINTS
+#include "pwm_trace.h"
 
 /* default frequency of 1 kHz */
 #define DEFAULT_TLDR	0xFFFFFFE0
@@ -48,14 +71,9 @@
 /* TMAR = (0xFFFFFFFF - ((0xFFFFFFFF - (DEFAULT_TLDR + 1)) / 2)) */
 #define DEFAULT_TMAR	0xFFFFFFEF
 
-/* default TCLR is off state */
-#define DEFAULT_TCLR (GPT_TCLR_PT | GPT_TCLR_TRG_OVFL_MATCH | GPT_TCLR_CE | GPT_TCLR_AR)
-
-#define DEFAULT_PWM_FREQUENCY 1024
+#define DEFAULT_PWM_FREQUENCY PWM_CONV_DEFAULT_FREQUENCY
 #define DEFAULT_DUTY_CYCLE 100
 
-#define MAX 1000		//some high value
-
 static int frequency_param = DEFAULT_PWM_FREQUENCY;
 module_param(frequency_param, int, S_IWUSR);
 MODULE_PARM_DESC(frequency_param,
@@ -64,6 +82,38 @@ MODULE_PARM_DESC(frequency_param,
 static int duty_cycle_param = DEFAULT_DUTY_CYCLE;
 module_param(duty_cycle_param, int, S_IWUSR);
 
+/*
+ * Every GP timer that has its PWM output (PWM_EVT) routed to a pad.
+ * Adding a timer is a matter of adding a line here.
+ */
+struct pwm_timer_desc {
+	u32 timer_num;
+	u32 gpt_base;
+	u32 mux_offset;
+	u16 mux_mode;
+	u32 clocks;		/* PWM_CLK_* sources the timer can use */
+	int irq;
+};
+
+static const struct pwm_timer_desc pwm_timers[] = {
+	{ 8, PWM8_CTL_BASE, GPT8_MUX_OFFSET, PWM_ENABLE_MUX, PWM_CLK_32K,
+	  GPT8_IRQ },
+	{ 9, PWM9_CTL_BASE, GPT9_MUX_OFFSET, PWM_ENABLE_MUX, PWM_CLK_32K,
+	  GPT9_IRQ },
+	{ 10, PWM10_CTL_BASE, GPT10_MUX_OFFSET, PWM_ENABLE_MUX,
+	  PWM_CLK_32K | PWM_CLK_13K, GPT10_IRQ },
+	{ 11, PWM11_CTL_BASE, GPT11_MUX_OFFSET, PWM_ENABLE_MUX,
+	  PWM_CLK_32K | PWM_CLK_13K, GPT11_IRQ },
+};
+
+#define PWM_NR ARRAY_SIZE(pwm_timers)
+
+static int timers[ARRAY_SIZE(pwm_timers)];
+static int timers_count;
+module_param_array(timers, int, &timers_count, S_IRUGO);
+MODULE_PARM_DESC(timers, "GP timers to use for PWM, e.g. timers=8,10,11");
+
+/* older per-timer switches, folded into the timers list */
 static int pwm9_enable = 0;
 module_param(pwm9_enable, int, S_IWUSR);
 
@@ -73,410 +123,2227 @@ module_param(pwm10_enable, int, S_IWUSR);
 static int pwm11_enable = 0;
 module_param(pwm11_enable, int, S_IWUSR);
 
-int pwm_enable[3] = { 0, 0, 0 };
+static bool sim;
+module_param(sim, bool, S_IRUGO);
+MODULE_PARM_DESC(sim, "Use a software model in place of the OMAP3 "
+		 "timers, to run the driver on any machine");
+
+static bool handoff;
+module_param(handoff, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(handoff, "Adopt running outputs at load and leave them "
+		 "running at unload, for reloads without a glitch");
+
+/* bit i set means pwm_timers[i] is in use */
+static unsigned long pwm_enabled;
 
 int pwm_major = PWM_MAJOR;
 int pwm_minor = 0;
 dev_t dv = 0;
 
+static struct class *pwm_class;
+static void __iomem *pwm_padconf;
+static struct dentry *pwm_debugfs;
+
 #define USER_BUFF_SIZE	128
 
-struct gpt {
-	u32 timer_num;
-	u32 mux_offset;
-	u32 gpt_base;
-	u32 input_freq;
-	u32 old_mux;
-	u32 tldr;
-	u32 tmar;
-	u32 tclr;
-	u32 num_freqs;
-};
+static struct pwm_dev *pwm_devs;
 
-struct pwm_dev {
-	struct cdev cdev;
-	struct class *class;
-	struct semaphore sem;
-	struct gpt gpt;
-	int frequency, duty_cycle;
-	char *user_buff;
-};
-struct pwm_dev *pwm_devs;
+static LIST_HEAD(pwm_ioctl_exts);
+static DEFINE_MUTEX(pwm_ioctl_lock);
+
+/* serializes phase group changes */
+static DEFINE_MUTEX(pwm_group_lock);
 //unsigned int duty_cycle;
 
-static int init_mux(struct pwm_dev *dev)
+static const struct pwm_reg_ops *pwm_ops;
+
+static irqreturn_t pwm_irq_handler(int irq, void *dev_id);
+static void pwm_stamp_irq(struct pwm_dev *dev);
+
+static inline u64 pwm_now_ns(void)
 {
-	void __iomem *base;
+	return ktime_to_ns(ktime_get());
+}
 
-	base = ioremap(OMAP34XX_PADCONF_START, OMAP34XX_PADCONF_SIZE);
-	if (!base) {
-		printk(KERN_ALERT "init_mux(): ioremap() failed\n");
-		return -1;
-	}
+/* the OMAP3 registers */
 
-	dev->gpt.old_mux = ioread16(base + dev->gpt.mux_offset);
-	iowrite16(PWM_ENABLE_MUX, base + dev->gpt.mux_offset);
-	iounmap(base);
+static int pwm_mmio_map(struct pwm_dev *dev)
+{
+	dev->base = ioremap(dev->gpt.gpt_base, GPT_REGS_PAGE_SIZE);
 
-	return 0;
+	return dev->base ? 0 : -ENOMEM;
 }
 
-static int restore_mux(struct pwm_dev *dev)
+static void pwm_mmio_unmap(struct pwm_dev *dev)
 {
-	void __iomem *base;
-
-	if (dev->gpt.old_mux) {
-		base = ioremap(OMAP34XX_PADCONF_START, OMAP34XX_PADCONF_SIZE);
+	iounmap(dev->base);
+	dev->base = NULL;
+}
 
-		if (!base) {
-			printk(KERN_ALERT "restore_mux(): ioremap() failed\n");
-			return -1;
-		}
+static u32 pwm_mmio_read(struct pwm_dev *dev, u32 reg)
+{
+	return ioread32(dev->base + reg);
+}
 
-		iowrite16(dev->gpt.old_mux, base + dev->gpt.mux_offset);
-		iounmap(base);
-	}
+static void pwm_mmio_write(struct pwm_dev *dev, u32 reg, u32 val)
+{
+	iowrite32(val, dev->base + reg);
+}
 
-	return 0;
+static int pwm_mmio_request_irq(struct pwm_dev *dev)
+{
+	return request_irq(dev->gpt.irq, pwm_irq_handler, 0,
+			   dev_name(dev->device), dev);
 }
 
-static int set_pwm_frequency(struct pwm_dev *dev, int freq)
+static void pwm_mmio_free_irq(struct pwm_dev *dev)
 {
-	void __iomem *base;
-	//int frequency = dev->frequency;
-	dev->frequency=freq;
-	base = ioremap(dev->gpt.gpt_base, GPT_REGS_PAGE_SIZE);
-	if (!base) {
-		printk(KERN_ALERT "set_pwm_frequency(): ioremap failed\n");
-		return -1;
-	}
+	free_irq(dev->gpt.irq, dev);
+}
 
-	if (dev->frequency < 0) {
-		dev->frequency = DEFAULT_PWM_FREQUENCY;
-	} else {
-		/* only powers of two, for simplicity */
-		dev->frequency &= ~0x01;
+static int pwm_mmio_pad_map(void)
+{
+	pwm_padconf = ioremap(OMAP34XX_PADCONF_START, OMAP34XX_PADCONF_SIZE);
 
-		if (dev->frequency > (dev->gpt.input_freq / 2))
-			dev->frequency = dev->gpt.input_freq / 2;
-		else if (dev->frequency == 0)
-			dev->frequency = DEFAULT_PWM_FREQUENCY;
-	}
+	return pwm_padconf ? 0 : -ENOMEM;
+}
 
-	/* PWM_FREQ = 32768 / ((0xFFFF FFFF - TLDR) + 1) */
-	dev->gpt.tldr =
-	    0xFFFFFFFF - ((dev->gpt.input_freq / dev->frequency) - 1);
+static void pwm_mmio_pad_unmap(void)
+{
+	iounmap(pwm_padconf);
+}
 
-	/* just for convenience */
-	dev->gpt.num_freqs = 0xFFFFFFFE - dev->gpt.tldr;
+static u16 pwm_mmio_pad_read(u32 offset)
+{
+	return ioread16(pwm_padconf + offset);
+}
 
-	iowrite32(dev->gpt.tldr, base + GPT_TLDR);
+static void pwm_mmio_pad_write(u32 offset, u16 val)
+{
+	iowrite16(val, pwm_padconf + offset);
+}
 
-	/* initialize TCRR to TLDR, have to start somewhere */
-	iowrite32(dev->gpt.tldr, base + GPT_TCRR);
+static const struct pwm_reg_ops pwm_mmio_ops = {
+	.name = "omap3",
+	.map = pwm_mmio_map,
+	.unmap = pwm_mmio_unmap,
+	.read = pwm_mmio_read,
+	.write = pwm_mmio_write,
+	.request_irq = pwm_mmio_request_irq,
+	.free_irq = pwm_mmio_free_irq,
+	.pad_map = pwm_mmio_pad_map,
+	.pad_unmap = pwm_mmio_pad_unmap,
+	.pad_read = pwm_mmio_pad_read,
+	.pad_write = pwm_mmio_pad_write,
+};
 
-	iounmap(base);
+/*
+ * The software model. An hrtimer armed for the model's next interrupt
+ * takes the place of the irq line.
+ */
 
-	return 0;
-}
+static u16 *pwm_sim_padconf;
 
-static int pwm_off(struct pwm_dev *dev)
+static void pwm_sim_arm(struct pwm_dev *dev)
 {
-	void __iomem *base;
+	unsigned long flags;
+	u64 next;
 
-	base = ioremap(dev->gpt.gpt_base, GPT_REGS_PAGE_SIZE);
-	if (!base) {
-		printk(KERN_ALERT "pwm_off(): ioremap failed\n");
-		return -1;
-	}
+	if (!dev->sim_irq)
+		return;
 
-	dev->gpt.tclr &= ~GPT_TCLR_ST;
-	iowrite32(dev->gpt.tclr, base + GPT_TCLR);
-	iounmap(base);
+	spin_lock_irqsave(&dev->sim_lock, flags);
+	next = pwm_gpt_sim_next_event(dev->sim);
+	spin_unlock_irqrestore(&dev->sim_lock, flags);
 
-	return 0;
+	if (next)
+		hrtimer_start(&dev->sim_timer, ns_to_ktime(next),
+			      HRTIMER_MODE_ABS);
 }
 
-static int pwm_on(struct pwm_dev *dev)
+static enum hrtimer_restart pwm_sim_timer_fn(struct hrtimer *timer)
 {
-	void __iomem *base;
+	struct pwm_dev *dev = container_of(timer, struct pwm_dev, sim_timer);
+	u32 pending;
 
-	base = ioremap(dev->gpt.gpt_base, GPT_REGS_PAGE_SIZE);
+	spin_lock(&dev->sim_lock);
+	pwm_gpt_sim_advance(dev->sim, pwm_now_ns());
+	pending = pwm_gpt_sim_irq(dev->sim);
+	spin_unlock(&dev->sim_lock);
 
-	if (!base) {
-		printk(KERN_ALERT "pwm_on(): ioremap failed\n");
-		return -1;
-	}
+	if (pending)
+		pwm_irq_handler(0, dev);
 
-	/* set the duty cycle */
-	iowrite32(dev->gpt.tmar, base + GPT_TMAR);
+	pwm_sim_arm(dev);
 
-	/* now turn it on */
-	dev->gpt.tclr = ioread32(base + GPT_TCLR);
-	dev->gpt.tclr |= GPT_TCLR_ST;
-	iowrite32(dev->gpt.tclr, base + GPT_TCLR);
-	iounmap(base);
-
-	return 0;
+	return HRTIMER_NORESTART;
 }
 
-static int scpwm(struct pwm_dev *dev, int sc)
+static int pwm_sim_map(struct pwm_dev *dev)
 {
-	void __iomem *base;
-
-	base = ioremap(dev->gpt.gpt_base, GPT_REGS_PAGE_SIZE);
-	if (!base) {
-		printk(KERN_ALERT "pwm_off(): ioremap failed\n");
-		return -1;
-	}
+	dev->sim = kmalloc(sizeof(*dev->sim), GFP_KERNEL);
+	if (!dev->sim)
+		return -ENOMEM;
 
-	if (sc == 1)
-		dev->gpt.tclr |= GPT_TCLR_SCPWM;
-	else
-		dev->gpt.tclr &= ~GPT_TCLR_SCPWM;
-
-	iowrite32(dev->gpt.tclr, base + GPT_TCLR);
-	iounmap(base);
+	pwm_gpt_sim_init(dev->sim, CLK_32K_FREQ, pwm_now_ns());
+	spin_lock_init(&dev->sim_lock);
+	hrtimer_init(&dev->sim_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	dev->sim_timer.function = pwm_sim_timer_fn;
 
 	return 0;
 }
 
-static int prescale(struct pwm_dev *dev, int div)
+static void pwm_sim_unmap(struct pwm_dev *dev)
 {
-	void __iomem *base;
-	int i = 0;
-	base = ioremap(dev->gpt.gpt_base, GPT_REGS_PAGE_SIZE);
-	if (!base) {
-		printk(KERN_ALERT "pwm_off(): ioremap failed\n");
-		return -1;
-	}
+	kfree(dev->sim);
+	dev->sim = NULL;
+}
 
-	while (div > 2) {
-		i++;
-		div /= 2;
-	}
+static u32 pwm_sim_read(struct pwm_dev *dev, u32 reg)
+{
+	unsigned long flags;
+	u32 val;
 
-	dev->gpt.tclr |= GPT_TCLR_PRE;	//enable prescaler
-	dev->gpt.tclr &= i << 2;	//set prescaler ratio
-	iowrite32(dev->gpt.tclr, base + GPT_TCLR);
-	iounmap(base);
+	spin_lock_irqsave(&dev->sim_lock, flags);
+	val = pwm_gpt_sim_read(dev->sim, reg, pwm_now_ns());
+	spin_unlock_irqrestore(&dev->sim_lock, flags);
 
-	return 0;
+	return val;
 }
 
-static int set_duty_cycle(struct pwm_dev *dev,int duty_cycle)
+static void pwm_sim_write(struct pwm_dev *dev, u32 reg, u32 val)
 {
-	unsigned int new_tmar;
-	pwm_off(dev);
-	dev->duty_cycle=duty_cycle;
+	unsigned long flags;
 
-	if (dev->duty_cycle == 0)
-		return 0;
+	spin_lock_irqsave(&dev->sim_lock, flags);
+	pwm_gpt_sim_write(dev->sim, reg, val, pwm_now_ns());
+	spin_unlock_irqrestore(&dev->sim_lock, flags);
 
-	new_tmar = (dev->duty_cycle * dev->gpt.num_freqs) / 100;
+	pwm_sim_arm(dev);
+}
 
-	if (new_tmar < 1) {
-		new_tmar = 1;
-		printk(KERN_ALERT "new_tmar = 1\n");
-	} else if (new_tmar > dev->gpt.num_freqs) {
-		new_tmar = dev->gpt.num_freqs;
-		printk(KERN_ALERT "new_tmar = dev->gpt.num_freqs\n");
-	}
+static int pwm_sim_request_irq(struct pwm_dev *dev)
+{
+	dev->sim_irq = 1;
+	pwm_sim_arm(dev);
 
-	dev->gpt.tmar = dev->gpt.tldr + new_tmar;
+	return 0;
+}
 
-	return pwm_on(dev);
+static void pwm_sim_free_irq(struct pwm_dev *dev)
+{
+	dev->sim_irq = 0;
+	hrtimer_cancel(&dev->sim_timer);
 }
 
-long pwm_ioctl(struct file *filp,
-	      unsigned int cmd, unsigned long arg)
+static int pwm_sim_pad_map(void)
 {
+	pwm_sim_padconf = kzalloc(OMAP34XX_PADCONF_SIZE, GFP_KERNEL);
 
-	//int err = 0, tmp;
-	int retval = 0;
-	struct pwm_dev *dev = filp->private_data;
-	/*
-	 * extract the type and number bitfields, and don't decode
-	 * wrong cmds: return ENOTTY (inappropriate ioctl) before access_ok()
-	 */
-	if (_IOC_TYPE(cmd) != PWM_IOC_MAGIC)
-		return -ENOTTY;
-	if (_IOC_NR(cmd) > PWM_IOC_MAXNR)
-		return -ENOTTY;
+	return pwm_sim_padconf ? 0 : -ENOMEM;
+}
 
-	/*
-	 * the direction is a bitmask, and VERIFY_WRITE catches R/W
-	 * transfers. `Type' is user-oriented, while
-	 * access_ok is kernel-oriented, so the concept of "read" and
-	 * "write" is reversed
-	 */
-	/*if (_IOC_DIR(cmd) & _IOC_READ)
-	   err = !access_ok(VERIFY_WRITE, (void __user *)arg, _IOC_SIZE(cmd));
-	   else if (_IOC_DIR(cmd) & _IOC_WRITE)
-	   err =  !access_ok(VERIFY_READ, (void __user *)arg, _IOC_SIZE(cmd));
-	   if (err) return -EFAULT; */
+static void pwm_sim_pad_unmap(void)
+{
+	kfree(pwm_sim_padconf);
+}
 
-	switch (cmd) {
+static u16 pwm_sim_pad_read(u32 offset)
+{
+	return pwm_sim_padconf[offset / 2];
+}
 
-	case PWM_ON:
-		if (pwm_on(dev))
-			retval = -EIO;
-		break;
+static void pwm_sim_pad_write(u32 offset, u16 val)
+{
+	pwm_sim_padconf[offset / 2] = val;
+}
 
-	case PWM_OFF:
-		if (pwm_off(dev))
-			retval = -EIO;
-		break;
+static const struct pwm_reg_ops pwm_sim_ops = {
+	.name = "sim",
+	.map = pwm_sim_map,
+	.unmap = pwm_sim_unmap,
+	.read = pwm_sim_read,
+	.write = pwm_sim_write,
+	.request_irq = pwm_sim_request_irq,
+	.free_irq = pwm_sim_free_irq,
+	.pad_map = pwm_sim_pad_map,
+	.pad_unmap = pwm_sim_pad_unmap,
+	.pad_read = pwm_sim_pad_read,
+	.pad_write = pwm_sim_pad_write,
+};
 
-	case PWM_SET_DUTYCYCLE:
-		//dev->duty_cycle = arg;
-		if (set_duty_cycle(dev,arg))
-			retval = -EIO;
-		break;
+static void pwm_hist_add(struct pwm_dev *dev, struct pwm_hist *h, u64 ns)
+{
+	unsigned long flags;
+	int i = fls64(ns);
+
+	if (i >= PWM_HIST_BUCKETS)
+		i = PWM_HIST_BUCKETS - 1;
+
+	spin_lock_irqsave(&dev->stats_lock, flags);
+	h->count++;
+	h->sum += ns;
+	if (ns > h->max)
+		h->max = ns;
+	h->bucket[i]++;
+	spin_unlock_irqrestore(&dev->stats_lock, flags);
+}
 
-	case PWM_GET_DUTYCYCLE:
+/* marks the start of a request for pwm_op_end() */
+struct pwm_op_mark {
+	u64 start;
+	u32 reg_writes;
+};
 
-		if (dev->gpt.tclr & GPT_TCLR_ST) {	//PWM is on
-			retval = (100 * (dev->gpt.tmar - dev->gpt.tldr))
-			    / dev->gpt.num_freqs;	//real duty cycle
-		} else {
-			printk(KERN_ALERT "PWM%d is OFF\n", dev->gpt.timer_num);
-			retval = -EIO;
-		}
+static inline void pwm_op_begin(struct pwm_dev *dev, struct pwm_op_mark *m)
+{
+	m->start = pwm_now_ns();
+	m->reg_writes = dev->stats.reg_writes;
+}
 
-		break;
+static void pwm_op_end(struct pwm_dev *dev, int op, struct pwm_op_mark *m)
+{
+	u64 ns = pwm_now_ns() - m->start;
+	unsigned long flags;
 
-	case PWM_SET_FREQUENCY:
-		//dev->frequency = arg;
-		if (set_pwm_frequency(dev,arg))
-			retval = -EIO;
+	spin_lock_irqsave(&dev->stats_lock, flags);
+	dev->stats.ops[op]++;
+	dev->stats.op_writes[op] += dev->stats.reg_writes - m->reg_writes;
+	spin_unlock_irqrestore(&dev->stats_lock, flags);
 
-		//if(set_duty_cycle(dev))
-		//retval = -EIO;
-		break;
+	pwm_hist_add(dev, &dev->stats.request, ns);
+}
 
-	case PWM_GET_FREQUENCY:
-		retval = dev->frequency;
-		break;
+static int pwm_sem_down(struct pwm_dev *dev)
+{
+	u64 start = pwm_now_ns();
 
-	case PWM_SET_POLARITY:
-		if (scpwm(dev, arg))
-			retval = -EIO;
-		break;
+	if (down_interruptible(&dev->sem))
+		return -ERESTARTSYS;
 
-	case PWM_SET_CLK:
-		if (dev->gpt.timer_num == 9) {
-			printk(KERN_ALERT
-			       "Only 32K clk can be used with GPT9\n");
-			retval = -EIO;
-		} else {
-			if (arg == 1)
-				dev->gpt.input_freq = CLK_13K_FREQ;
-			else
-				dev->gpt.input_freq = CLK_32K_FREQ;
-		}
-		break;
+	pwm_hist_add(dev, &dev->stats.sem_wait, pwm_now_ns() - start);
 
-	case PWM_SET_PRE:
-		if (prescale(dev, arg))
-			retval = -EIO;
-		break;
+	return 0;
+}
 
-	default:		/* redundant, as cmd was checked against MAXNR */
-		return -ENOTTY;
-	}
-	return retval;
+static int init_mux(struct pwm_dev *dev)
+{
+	dev->gpt.old_mux = dev->ops->pad_read(dev->gpt.mux_offset);
+	dev->ops->pad_write(dev->gpt.mux_offset, dev->gpt.mux_mode);
 
+	return 0;
 }
 
-static ssize_t pwm_read(struct file *filp, char __user * buff, size_t count,
-			loff_t * offp)
+static int restore_mux(struct pwm_dev *dev)
 {
-	size_t len;
-	ssize_t error = 0;
-	struct pwm_dev *dev = filp->private_data;
+	if (dev->gpt.old_mux)
+		dev->ops->pad_write(dev->gpt.mux_offset, dev->gpt.old_mux);
 
-	if (!buff)
-		return -EFAULT;
+	return 0;
+}
 
-	/* tell the user there is no more */
-	if (*offp > 0)
-		return 0;
+/*
+ * The register helpers below expect dev->lock to be held, they do not
+ * sleep.
+ */
+
+/* the sysfs attributes, in pwm_attrs[] order */
+enum {
+	PWM_ATTR_PERIOD_NS,
+	PWM_ATTR_DUTY_NS,
+	PWM_ATTR_TLDR,
+	PWM_ATTR_TMAR,
+	PWM_ATTR_ENABLE,
+	PWM_ATTR_POLARITY,
+	PWM_ATTR_CLOCK,
+	PWM_ATTR_ACHIEVED,
+};
 
-	if (down_interruptible(&(dev->sem)))
-		return -ERESTARTSYS;
+/* which attributes read differently after the snapshot went old -> new */
+static unsigned long pwm_attr_changed(const struct pwm_snap *old,
+				      const struct pwm_snap *new)
+{
+	unsigned long changed = 0;
+
+	if (old->tldr != new->tldr || old->input_freq != new->input_freq)
+		changed |= BIT(PWM_ATTR_PERIOD_NS) | BIT(PWM_ATTR_DUTY_NS)
+		    | BIT(PWM_ATTR_ACHIEVED);
+	if (old->tldr != new->tldr)
+		changed |= BIT(PWM_ATTR_TLDR);
+	if (old->tmar != new->tmar)
+		changed |= BIT(PWM_ATTR_TMAR) | BIT(PWM_ATTR_DUTY_NS);
+	if ((old->tclr ^ new->tclr) & GPT_TCLR_ST)
+		changed |= BIT(PWM_ATTR_ENABLE);
+	if ((old->tclr ^ new->tclr) & GPT_TCLR_SCPWM)
+		changed |= BIT(PWM_ATTR_POLARITY);
+	if (old->input_freq != new->input_freq)
+		changed |= BIT(PWM_ATTR_CLOCK);
+
+	return changed;
+}
 
-	if (set_pwm_frequency(dev,dev->frequency))
-		error = -EIO;
+/*
+ * Copies the state the lock free readers see, see pwm_snapshot(), and
+ * queues the sysfs notifications, sysfs_notify() cannot be called with
+ * the lock held.
+ */
+void pwm_publish(struct pwm_dev *dev)
+{
+	struct pwm_snap old = dev->snap;
+	unsigned long changed;
 
-	if (dev->gpt.tclr & GPT_TCLR_ST) {
-		dev->duty_cycle = (100 * (dev->gpt.tmar - dev->gpt.tldr))
-		    / dev->gpt.num_freqs;
+	write_seqcount_begin(&dev->snap_seq);
+	pwm_seq_snap(dev, &dev->snap);
+	write_seqcount_end(&dev->snap_seq);
 
-		snprintf(dev->user_buff, USER_BUFF_SIZE,
-			 "PWM%d Frequency %u Hz Duty Cycle %u%%\n",
-			 dev->gpt.timer_num, dev->frequency, dev->duty_cycle);
-	} else {
-		snprintf(dev->user_buff, USER_BUFF_SIZE,
-			 "PWM%d Frequency %u Hz Stopped\n",
-			 dev->gpt.timer_num, dev->frequency);
+	changed = pwm_attr_changed(&old, &dev->snap);
+	if (changed && dev->notify_on) {
+		dev->notify |= changed;
+		schedule_work(&dev->notify_work);
 	}
+}
 
-	len = strlen(dev->user_buff);
+/* the frequency set_pwm_frequency() ends up with for a request */
+static int pwm_clamp_frequency(struct pwm_dev *dev, int freq)
+{
+	return pwm_conv_frequency(dev->gpt.input_freq, freq);
+}
 
-	if (len + 1 < count)
-		count = len + 1;
+static int set_pwm_frequency(struct pwm_dev *dev, int freq)
+{
+	u64 start = pwm_now_ns();
 
-	if (copy_to_user(buff, dev->user_buff, count)) {
-		printk(KERN_ALERT "pwm_read(): copy_to_user() failed\n");
-		error = -EFAULT;
-	} else {
-		*offp += count;
-		error = count;
-	}
+	pwm_seq_frequency(dev, freq);
+	pwm_publish(dev);
 
-	up(&(dev->sem));
+	pwm_hist_add(dev, &dev->stats.reg_access, pwm_now_ns() - start);
+	trace_pwm_set_frequency(dev->gpt.timer_num, dev->frequency,
+				dev->gpt.tldr);
 
-	return error;
+	return 0;
 }
 
-static ssize_t pwm_write(struct file *filp, const char __user * buff,
-			 size_t count, loff_t * offp)
+/* set_pwm_frequency() restarts the period, skip it if nothing changes */
+static void pwm_update_frequency(struct pwm_dev *dev, int freq)
 {
-	size_t len;
+	if (pwm_clamp_frequency(dev, freq) != dev->frequency)
+		set_pwm_frequency(dev, freq);
+}
 
-	ssize_t error = 0;
-	struct pwm_dev *dev = filp->private_data;
+static int pwm_off(struct pwm_dev *dev)
+{
+	u64 start = pwm_now_ns();
 
-	if (down_interruptible(&(dev->sem)))
-		return -ERESTARTSYS;
+	pwm_seq_off(dev);
+	pwm_publish(dev);
 
-	if (!buff || count < 1) {
-		printk(KERN_ALERT "pwm_write(): input check failed\n");
-		error = -EFAULT;
-		goto pwm_write_done;
-	}
+	pwm_hist_add(dev, &dev->stats.reg_access, pwm_now_ns() - start);
+	trace_pwm_off(dev->gpt.timer_num, dev->gpt.tclr, dev->gpt.tmar);
 
-	/* we are only expecting a small integer, ignore anything else */
-	if (count > 8)
-		len = 8;
-	else
-		len = count;
+	return 0;
+}
 
-	if (set_pwm_frequency(dev,dev->frequency))
-		error = -EIO;
+/* writes gpt.tmar, which supersedes a move pwm_update_tmar() deferred */
+static void pwm_write_tmar(struct pwm_dev *dev)
+{
+	pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+	dev->tmar_pending = 0;
+}
 
-	memset(dev->user_buff, 0, 16);
+static int pwm_on(struct pwm_dev *dev)
+{
+	u64 start = pwm_now_ns();
 
-	if (copy_from_user(dev->user_buff, buff, len)) {
-		printk(KERN_ALERT "pwm_write(): copy_from_user() failed\n");
-		error = -EFAULT;
+	/* the TMAR write supersedes a deferred move */
+	dev->tmar_pending = 0;
+	pwm_seq_on(dev);
+	pwm_publish(dev);
+
+	pwm_hist_add(dev, &dev->stats.reg_access, pwm_now_ns() - start);
+	trace_pwm_on(dev->gpt.timer_num, dev->gpt.tclr, dev->gpt.tmar);
+
+	return 0;
+}
+
+static int scpwm(struct pwm_dev *dev, int sc)
+{
+	u64 start = pwm_now_ns();
+
+	pwm_seq_polarity(dev, sc);
+	pwm_publish(dev);
+
+	pwm_hist_add(dev, &dev->stats.reg_access, pwm_now_ns() - start);
+
+	return 0;
+}
+
+static int prescale(struct pwm_dev *dev, int div)
+{
+	u64 start = pwm_now_ns();
+	int i = 0;
+
+	while (div > 2) {
+		i++;
+		div /= 2;
+	}
+
+	dev->gpt.tclr |= GPT_TCLR_PRE;	//enable prescaler
+	dev->gpt.tclr &= i << 2;	//set prescaler ratio
+	pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+	pwm_publish(dev);
+
+	pwm_hist_add(dev, &dev->stats.reg_access, pwm_now_ns() - start);
+
+	return 0;
+}
+
+/* computes gpt.tmar for duty_cycle, returns 0 if the output should be off */
+static int pwm_duty_to_tmar(struct pwm_dev *dev, int duty_cycle)
+{
+	return pwm_seq_duty(dev, duty_cycle);
+}
+
+/* pwm_seq_tmar_ticks() in nanoseconds, 0 if TMAR can be written now */
+static u64 pwm_tmar_wait(struct pwm_dev *dev, u32 hw_tmar)
+{
+	u32 ticks = pwm_seq_tmar_ticks(dev, hw_tmar);
+
+	if (!ticks)
+		return 0;
+
+	return div_u64((u64)ticks * NSEC_PER_SEC, dev->gpt.input_freq) + 1;
+}
+
+/* which period a pwm_update_tmar() move shows in */
+enum pwm_tmar_move {
+	PWM_TMAR_NOW,		/* written before either match, this one */
+	PWM_TMAR_NEXT,		/* written past both, the next one */
+	PWM_TMAR_DEFERRED,	/* the one after tmar_timer writes it */
+};
+
+/*
+ * Moves the match of a running timer to dev->gpt.tmar without stopping
+ * it. When the counter is in the way the write is left to tmar_timer,
+ * at most |new - old| ticks later, instead of spinning with the lock
+ * held. A later update before then only changes what it will write.
+ */
+static enum pwm_tmar_move pwm_update_tmar(struct pwm_dev *dev, u32 old_tmar)
+{
+	enum pwm_tmar_move move = PWM_TMAR_DEFERRED;
+	u32 first;
+	u64 wait;
+
+	/* the register still has what the deferred write would replace */
+	if (dev->tmar_pending)
+		old_tmar = dev->tmar_hw;
+
+	wait = pwm_tmar_wait(dev, old_tmar);
+	if (wait) {
+		dev->tmar_hw = old_tmar;
+		dev->tmar_pending = 1;
+		hrtimer_start(&dev->tmar_timer, ns_to_ktime(wait),
+			      HRTIMER_MODE_REL);
+	} else {
+		pwm_write_tmar(dev);
+
+		/* still short of both matches after the write */
+		first = min(old_tmar, dev->gpt.tmar) - dev->gpt.tldr;
+		move = pwm_reg_read(dev, GPT_TCRR) - dev->gpt.tldr < first ?
+		    PWM_TMAR_NOW : PWM_TMAR_NEXT;
+	}
+
+	pwm_publish(dev);
+
+	return move;
+}
+
+static enum hrtimer_restart pwm_tmar_timer_fn(struct hrtimer *timer)
+{
+	struct pwm_dev *dev = container_of(timer, struct pwm_dev, tmar_timer);
+	enum hrtimer_restart ret = HRTIMER_NORESTART;
+	unsigned long flags;
+	u64 wait;
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	/* a mode or a stop has taken over TMAR since */
+	if (!dev->tmar_pending || dev->mode
+	    || !(dev->gpt.tclr & GPT_TCLR_ST)) {
+		dev->tmar_pending = 0;
+	} else {
+		wait = pwm_tmar_wait(dev, dev->tmar_hw);
+		if (wait) {
+			hrtimer_forward_now(timer, ns_to_ktime(wait));
+			ret = HRTIMER_RESTART;
+		} else {
+			pwm_write_tmar(dev);
+		}
+	}
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return ret;
+}
+
+/* counter value that puts a member 'phase' behind a counter at 0 */
+static u32 pwm_phase_offset(struct pwm_dev *dev, u32 phase)
+{
+	u32 period = 0xFFFFFFFF - dev->gpt.tldr + 1;
+	u32 ticks = div_u64((u64)phase * period, PWM_PHASE_UNITS);
+
+	return ticks ? period - ticks : 0;
+}
+
+static void pwm_group_lock_all(unsigned long mask, unsigned long *flags)
+{
+	unsigned int i;
+
+	local_irq_save(*flags);
+
+	for_each_set_bit(i, &mask, PWM_NR)
+		spin_lock_nested(&pwm_devs[i].lock, i);
+}
+
+static void pwm_group_unlock_all(unsigned long mask, unsigned long flags)
+{
+	unsigned int i;
+
+	for_each_set_bit(i, &mask, PWM_NR)
+		spin_unlock(&pwm_devs[i].lock);
+
+	local_irq_restore(flags);
+}
+
+/*
+ * Takes dev->lock, or the locks of the whole phase group if dev is in
+ * one. Returns the group that was locked, for pwm_unlock().
+ */
+static unsigned long pwm_lock(struct pwm_dev *dev, unsigned long *flags)
+{
+	unsigned long mask;
+
+	for (;;) {
+		spin_lock_irqsave(&dev->lock, *flags);
+		mask = dev->group;
+		if (!mask)
+			return 0;
+		spin_unlock_irqrestore(&dev->lock, *flags);
+
+		/* group locks go in index order */
+		pwm_group_lock_all(mask, flags);
+		if (dev->group == mask)
+			return mask;
+		pwm_group_unlock_all(mask, *flags);
+	}
+}
+
+static void pwm_unlock(struct pwm_dev *dev, unsigned long mask,
+		       unsigned long flags)
+{
+	if (mask)
+		pwm_group_unlock_all(mask, flags);
+	else
+		spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+unsigned long pwm_channel_bit(struct pwm_dev *dev)
+{
+	return 1UL << (dev - pwm_devs);
+}
+
+/* for modes driving several channels, same order as the phase groups */
+void pwm_lock_channels(unsigned long mask, unsigned long *flags)
+{
+	pwm_group_lock_all(mask, flags);
+}
+
+void pwm_unlock_channels(unsigned long mask, unsigned long flags)
+{
+	pwm_group_unlock_all(mask, flags);
+}
+
+/*
+ * Starts a stopped group member in phase with one that is running,
+ * or just starts it if it is the only one.
+ */
+static int pwm_group_rejoin(struct pwm_dev *dev)
+{
+	struct pwm_dev *ref = NULL;
+	unsigned int i;
+	u64 period, now;
+
+	for_each_set_bit(i, &dev->group, PWM_NR) {
+		if (&pwm_devs[i] != dev
+		    && (pwm_devs[i].gpt.tclr & GPT_TCLR_ST)) {
+			ref = &pwm_devs[i];
+			break;
+		}
+	}
+
+	if (ref) {
+		period = 0xFFFFFFFF - dev->gpt.tldr + 1;
+		now = pwm_reg_read(ref, GPT_TCRR) - ref->gpt.tldr;
+		now += period - pwm_phase_offset(dev, ref->phase);
+		now += pwm_phase_offset(dev, dev->phase);
+		while (now >= period)
+			now -= period;
+		pwm_reg_write(dev, GPT_TCRR, dev->gpt.tldr + (u32)now);
+	}
+
+	return pwm_on(dev);
+}
+
+/*
+ * Reprograms every member for freq and restarts the ones that were
+ * running, with their counters preloaded to the group phases. All
+ * group locks held.
+ */
+static void pwm_group_retime(unsigned long mask, int freq)
+{
+	unsigned long run = 0;
+	struct pwm_dev *dev;
+	unsigned int i;
+
+	for_each_set_bit(i, &mask, PWM_NR) {
+		dev = &pwm_devs[i];
+		if (dev->gpt.tclr & GPT_TCLR_ST)
+			__set_bit(i, &run);
+		pwm_off(dev);
+	}
+
+	for_each_set_bit(i, &mask, PWM_NR) {
+		dev = &pwm_devs[i];
+		set_pwm_frequency(dev, freq);
+
+		if (pwm_duty_to_tmar(dev, dev->duty_cycle))
+			pwm_write_tmar(dev);
+		else
+			__clear_bit(i, &run);
+
+		pwm_reg_write(dev, GPT_TCRR, dev->gpt.tldr
+			      + pwm_phase_offset(dev, dev->phase));
+	}
+
+	/* back to back, the start skew is all the phase error there is */
+	for_each_set_bit(i, &run, PWM_NR) {
+		dev = &pwm_devs[i];
+		dev->gpt.tclr |= GPT_TCLR_ST;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+	}
+
+	for_each_set_bit(i, &mask, PWM_NR)
+		pwm_publish(&pwm_devs[i]);
+}
+
+static int set_duty_cycle(struct pwm_dev *dev,int duty_cycle)
+{
+	u32 old_tmar = dev->gpt.tmar;
+
+	/* stopping a group member would lose its phase, move TMAR instead */
+	if (dev->group && duty_cycle && (dev->gpt.tclr & GPT_TCLR_ST)) {
+		pwm_duty_to_tmar(dev, duty_cycle);
+		pwm_update_tmar(dev, old_tmar);
+		return 0;
+	}
+
+	pwm_off(dev);
+
+	if (!pwm_duty_to_tmar(dev, duty_cycle))
+		return 0;
+
+	trace_pwm_set_duty_cycle(dev->gpt.timer_num, dev->duty_cycle,
+				 dev->gpt.tldr, dev->gpt.tmar);
+
+	return dev->group ? pwm_group_rejoin(dev) : pwm_on(dev);
+}
+
+/* the channel belongs to a mode or an in-kernel consumer */
+static inline int pwm_busy(struct pwm_dev *dev)
+{
+	return dev->mode || dev->consumer;
+}
+
+/* another process holds PWM_CLAIM on dev */
+static inline int pwm_claimed(struct pwm_dev *dev)
+{
+	pid_t tgid = READ_ONCE(dev->writer_tgid);
+
+	return tgid && tgid != task_tgid_nr(current);
+}
+
+/*
+ * dev->lock, or all of dev->mode_locks in index order if the mode
+ * drives other channels from this interrupt. Returns what was locked.
+ */
+static unsigned long pwm_irq_lock(struct pwm_dev *dev, unsigned long *flags)
+{
+	unsigned long mask;
+
+	for (;;) {
+		spin_lock(&dev->lock);
+		mask = dev->mode_locks;
+		if (!mask)
+			return 0;
+		spin_unlock(&dev->lock);
+
+		pwm_group_lock_all(mask, flags);
+		if (dev->mode_locks == mask)
+			return mask;
+		pwm_group_unlock_all(mask, *flags);
+	}
+}
+
+static irqreturn_t pwm_irq_handler(int irq, void *dev_id)
+{
+	struct pwm_dev *dev = dev_id;
+	unsigned long mask, flags;
+	u32 status;
+
+	mask = pwm_irq_lock(dev, &flags);
+
+	status = pwm_reg_read(dev, GPT_TISR);
+	pwm_reg_write(dev, GPT_TISR, status);
+
+	if ((status & GPT_IRQ_OVF) && dev->stamp)
+		pwm_stamp_irq(dev);
+
+	if (status && dev->mode && dev->mode->irq)
+		dev->mode->irq(dev, dev->mode_data, status);
+
+	if (mask)
+		pwm_group_unlock_all(mask, flags);
+	else
+		spin_unlock(&dev->lock);
+
+	return status ? IRQ_HANDLED : IRQ_NONE;
+}
+
+int pwm_mode_attach_locks(struct pwm_dev *dev, const struct pwm_mode *mode,
+			  void *data, unsigned long locks)
+{
+	unsigned long flags;
+	int error = 0;
+
+	if (pwm_sem_down(dev))
+		return -ERESTARTSYS;
+
+	if (pwm_busy(dev) || dev->group || dev->stamp) {
+		error = -EBUSY;
+		goto attach_done;
+	}
+
+	error = dev->ops->request_irq(dev);
+	if (error) {
+		printk(KERN_ALERT "pwm%d: request_irq() failed: %d\n",
+		       dev->gpt.timer_num, error);
+		goto attach_done;
+	}
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->mode = mode;
+	dev->mode_data = data;
+	dev->mode_locks = locks ? locks | pwm_channel_bit(dev) : 0;
+	pwm_reg_write(dev, GPT_TISR, GPT_IRQ_ALL);
+	pwm_reg_write(dev, GPT_TIER, mode->irq_events);
+	pwm_publish(dev);
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+      attach_done:
+	up(&dev->sem);
+
+	return error;
+}
+
+int pwm_mode_attach(struct pwm_dev *dev, const struct pwm_mode *mode,
+		    void *data)
+{
+	return pwm_mode_attach_locks(dev, mode, data, 0);
+}
+
+/*
+ * Hands the channel back stopped, in the same state a fresh load
+ * would leave it.
+ */
+void pwm_mode_detach(struct pwm_dev *dev, const struct pwm_mode *mode)
+{
+	unsigned long flags;
+	void *data;
+
+	down(&dev->sem);
+
+	if (dev->mode != mode) {
+		up(&dev->sem);
+		return;
+	}
+
+	spin_lock_irqsave(&dev->lock, flags);
+	pwm_reg_write(dev, GPT_TIER, 0);
+	pwm_reg_write(dev, GPT_TISR, GPT_IRQ_ALL);
+	data = dev->mode_data;
+	dev->mode = NULL;
+	dev->mode_data = NULL;
+	dev->mode_locks = 0;
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	dev->ops->free_irq(dev);
+
+	if (mode->stop)
+		mode->stop(dev, data);
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->gpt.tclr = DEFAULT_TCLR;
+	pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+	set_pwm_frequency(dev, dev->frequency);
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	up(&dev->sem);
+}
+
+int pwm_register_ioctl(struct pwm_ioctl_ext *ext)
+{
+	struct pwm_ioctl_ext *e;
+	int error = 0;
+
+	if (ext->nr_first <= PWM_IOC_MAXNR || ext->nr_last < ext->nr_first)
+		return -EINVAL;
+
+	mutex_lock(&pwm_ioctl_lock);
+
+	list_for_each_entry(e, &pwm_ioctl_exts, list) {
+		if (ext->nr_first <= e->nr_last && e->nr_first <= ext->nr_last) {
+			error = -EBUSY;
+			goto register_done;
+		}
+	}
+
+	list_add_tail(&ext->list, &pwm_ioctl_exts);
+
+      register_done:
+	mutex_unlock(&pwm_ioctl_lock);
+
+	return error;
+}
+
+void pwm_unregister_ioctl(struct pwm_ioctl_ext *ext)
+{
+	mutex_lock(&pwm_ioctl_lock);
+	list_del(&ext->list);
+	mutex_unlock(&pwm_ioctl_lock);
+}
+
+static long pwm_ext_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct pwm_ioctl_ext *e, *found = NULL;
+	long retval;
+
+	mutex_lock(&pwm_ioctl_lock);
+
+	list_for_each_entry(e, &pwm_ioctl_exts, list) {
+		if (_IOC_NR(cmd) >= e->nr_first && _IOC_NR(cmd) <= e->nr_last) {
+			if (try_module_get(e->owner))
+				found = e;
+			break;
+		}
+	}
+
+	mutex_unlock(&pwm_ioctl_lock);
+
+	if (!found)
+		return -ENOTTY;
+
+	retval = found->ioctl(dev, cmd, arg);
+	module_put(found->owner);
+
+	return retval;
+}
+
+/*
+ * PWM_SET_PHASE_GROUP. The group runs at the frequency of the channel
+ * the ioctl was issued on, members that were running restart in phase.
+ */
+static int pwm_phase_set(struct pwm_dev *dev, struct pwm_phase_group *req)
+{
+	unsigned long mask = 0, all, flags;
+	struct pwm_dev *m;
+	unsigned int i, j;
+	int error = 0;
+
+	if (req->count > PWM_GROUP_MAX)
+		return -EINVAL;
+
+	for (i = 0; i < req->count; i++) {
+		m = pwm_get_dev(req->timer[i]);
+		if (!m || req->phase[i] >= PWM_PHASE_UNITS)
+			return -EINVAL;
+
+		j = m - pwm_devs;
+		if (test_bit(j, &mask))
+			return -EINVAL;
+
+		__set_bit(j, &mask);
+	}
+
+	if (mask && !test_bit(dev - pwm_devs, &mask))
+		return -EINVAL;
+
+	mutex_lock(&pwm_group_lock);
+
+	/* members can only move between groups by dissolving the old one */
+	for_each_set_bit(j, &mask, PWM_NR) {
+		if (pwm_devs[j].group && pwm_devs[j].group != dev->group) {
+			error = -EBUSY;
+			goto set_done;
+		}
+	}
+
+	all = mask | dev->group;
+
+	/* keeps modes and in-kernel consumers out while we look */
+	for_each_set_bit(j, &all, PWM_NR)
+		down(&pwm_devs[j].sem);
+
+	pwm_group_lock_all(all, &flags);
+
+	for_each_set_bit(j, &mask, PWM_NR) {
+		m = &pwm_devs[j];
+		if (pwm_busy(m) || pwm_claimed(m))
+			error = -EBUSY;
+		else if (m->gpt.input_freq != dev->gpt.input_freq)
+			error = -EINVAL;
+	}
+
+	if (!error) {
+		for_each_set_bit(j, &all, PWM_NR) {
+			pwm_devs[j].group = 0;
+			pwm_devs[j].phase = 0;
+		}
+
+		for (i = 0; i < req->count; i++) {
+			m = pwm_get_dev(req->timer[i]);
+			m->group = mask;
+			m->phase = req->phase[i];
+
+			if (m->gpt.old_mux == 0)
+				init_mux(m);
+		}
+
+		if (mask)
+			pwm_group_retime(mask, dev->frequency);
+	}
+
+	pwm_group_unlock_all(all, flags);
+
+	for_each_set_bit(j, &all, PWM_NR)
+		up(&pwm_devs[j].sem);
+
+      set_done:
+	mutex_unlock(&pwm_group_lock);
+
+	return error;
+}
+
+/* counter distance a - b, both relative to TLDR, modulo period */
+static u32 pwm_phase_diff(u32 a, u32 b, u32 period)
+{
+	return a >= b ? a - b : a + (period - b);
+}
+
+/*
+ * PWM_GET_PHASE_GROUP. The counters are read back to back, once in
+ * index order and once in reverse, and the two averaged so the time
+ * between the reads cancels out.
+ */
+static int pwm_phase_get(struct pwm_dev *dev, struct pwm_phase_group *req)
+{
+	u32 fwd[PWM_GROUP_MAX], rev[PWM_GROUP_MAX];
+	struct pwm_dev *member[PWM_GROUP_MAX];
+	unsigned long mask, flags;
+	int ref = -1;
+	unsigned int i, j, n = 0;
+	u32 period, d1, d2, ticks, ref_ticks;
+
+	memset(req, 0, sizeof(*req));
+
+	mutex_lock(&pwm_group_lock);
+
+	mask = dev->group;
+	if (!mask)
+		goto get_done;
+
+	for_each_set_bit(j, &mask, PWM_NR)
+		member[n++] = &pwm_devs[j];
+
+	pwm_group_lock_all(mask, &flags);
+
+	for (i = 0; i < n; i++)
+		fwd[i] = pwm_reg_read(member[i], GPT_TCRR);
+
+	for (i = n; i-- > 0;)
+		rev[i] = pwm_reg_read(member[i], GPT_TCRR);
+
+	period = 0xFFFFFFFF - dev->gpt.tldr + 1;
+
+	for (i = 0; i < n; i++) {
+		fwd[i] -= member[i]->gpt.tldr;
+		rev[i] -= member[i]->gpt.tldr;
+
+		if (ref < 0 && (member[i]->gpt.tclr & GPT_TCLR_ST))
+			ref = i;
+	}
+
+	req->count = n;
+
+	for (i = 0; i < n; i++) {
+		req->timer[i] = member[i]->gpt.timer_num;
+		req->phase[i] = member[i]->phase;
+
+		if (!(member[i]->gpt.tclr & GPT_TCLR_ST)) {
+			req->measured[i] = PWM_PHASE_STOPPED;
+			continue;
+		}
+
+		d1 = pwm_phase_diff(fwd[ref], fwd[i], period);
+		d2 = pwm_phase_diff(rev[ref], rev[i], period);
+
+		/* the two reads straddle a wrap */
+		if (d1 > d2 && d1 - d2 > period / 2)
+			d2 += period;
+		else if (d2 > d1 && d2 - d1 > period / 2)
+			d1 += period;
+
+		/* measured relative to ref, which is taken to be where it should */
+		ref_ticks = div_u64((u64)member[ref]->phase * period,
+				    PWM_PHASE_UNITS);
+		div_u64_rem(((u64)d1 + d2) / 2 + ref_ticks, period, &ticks);
+		req->measured[i] = div_u64((u64)ticks * PWM_PHASE_UNITS,
+					   period);
+	}
+
+	pwm_group_unlock_all(mask, flags);
+
+      get_done:
+	mutex_unlock(&pwm_group_lock);
+
+	return 0;
+}
+
+static long pwm_phase_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct pwm_phase_group req;
+	long retval;
+
+	switch (cmd) {
+	case PWM_SET_PHASE_GROUP:
+		if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			return -EFAULT;
+		return pwm_phase_set(dev, &req);
+
+	case PWM_GET_PHASE_GROUP:
+		retval = pwm_phase_get(dev, &req);
+		if (!retval && copy_to_user((void __user *)arg, &req,
+					    sizeof(req)))
+			retval = -EFAULT;
+		return retval;
+	}
+
+	return -ENOTTY;
+}
+
+/* registered like the engine modules, just never goes away */
+static struct pwm_ioctl_ext pwm_phase_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_SET_PHASE_GROUP),
+	.nr_last = _IOC_NR(PWM_GET_PHASE_GROUP),
+	.ioctl = pwm_phase_ioctl,
+};
+
+/*
+ * The setters, shared by the ioctls and the scheduled changes. Called
+ * with pwm_lock() held, group is what it returned.
+ */
+static int pwm_apply(struct pwm_dev *dev, unsigned long group,
+		     unsigned int cmd, int arg)
+{
+	int retval = 0;
+
+	switch (cmd) {
+
+	case PWM_ON:
+		if (group && !(dev->gpt.tclr & GPT_TCLR_ST))
+			retval = pwm_group_rejoin(dev);
+		else
+			retval = pwm_on(dev);
+		if (retval)
+			retval = -EIO;
+		break;
+
+	case PWM_OFF:
+		if (pwm_off(dev))
+			retval = -EIO;
+		break;
+
+	case PWM_SET_DUTYCYCLE:
+		//dev->duty_cycle = arg;
+		if (set_duty_cycle(dev,arg))
+			retval = -EIO;
+		break;
+
+	case PWM_SET_FREQUENCY:
+		//dev->frequency = arg;
+		if (group)
+			pwm_group_retime(group, arg);
+		else if (set_pwm_frequency(dev,arg))
+			retval = -EIO;
+
+		//if(set_duty_cycle(dev))
+		//retval = -EIO;
+		break;
+
+	case PWM_SET_POLARITY:
+		if (scpwm(dev, arg))
+			retval = -EIO;
+		break;
+
+	default:
+		retval = -ENOTTY;
+	}
+
+	return retval;
+}
+
+static long pwm_do_ioctl(struct pwm_dev *dev,
+			 unsigned int cmd, unsigned long arg)
+{
+
+	//int err = 0, tmp;
+	int retval = 0;
+	unsigned long flags, group;
+	/*
+	 * extract the type and number bitfields, and don't decode
+	 * wrong cmds: return ENOTTY (inappropriate ioctl) before access_ok()
+	 */
+	if (_IOC_TYPE(cmd) != PWM_IOC_MAGIC)
+		return -ENOTTY;
+	if (_IOC_NR(cmd) > PWM_IOC_MAXNR)
+		return pwm_ext_ioctl(dev, cmd, arg);
+
+	/*
+	 * the direction is a bitmask, and VERIFY_WRITE catches R/W
+	 * transfers. `Type' is user-oriented, while
+	 * access_ok is kernel-oriented, so the concept of "read" and
+	 * "write" is reversed
+	 */
+	/*if (_IOC_DIR(cmd) & _IOC_READ)
+	   err = !access_ok(VERIFY_WRITE, (void __user *)arg, _IOC_SIZE(cmd));
+	   else if (_IOC_DIR(cmd) & _IOC_WRITE)
+	   err =  !access_ok(VERIFY_READ, (void __user *)arg, _IOC_SIZE(cmd));
+	   if (err) return -EFAULT; */
+
+	group = pwm_lock(dev, &flags);
+
+	/* someone else owns the timer, only let the getters through */
+	if ((pwm_busy(dev) || pwm_claimed(dev)) && cmd != PWM_GET_DUTYCYCLE
+	    && cmd != PWM_GET_FREQUENCY) {
+		retval = -EBUSY;
+		goto ioctl_done;
+	}
+
+	switch (cmd) {
+
+	case PWM_ON:
+	case PWM_OFF:
+	case PWM_SET_DUTYCYCLE:
+	case PWM_SET_FREQUENCY:
+	case PWM_SET_POLARITY:
+		retval = pwm_apply(dev, group, cmd, arg);
+		break;
+
+	case PWM_GET_DUTYCYCLE:
+
+		if (dev->gpt.tclr & GPT_TCLR_ST) {	//PWM is on
+			retval = (100 * (dev->gpt.tmar - dev->gpt.tldr))
+			    / dev->gpt.num_freqs;	//real duty cycle
+		} else {
+			printk(KERN_ALERT "PWM%d is OFF\n", dev->gpt.timer_num);
+			retval = -EIO;
+		}
+
+		break;
+
+	case PWM_GET_FREQUENCY:
+		retval = dev->frequency;
+		break;
+
+	case PWM_SET_CLK:
+		if (group) {
+			/* the members have to share one clock */
+			retval = -EBUSY;
+		} else if (!(dev->gpt.clocks & PWM_CLK_13K)) {
+			printk(KERN_ALERT
+			       "Only 32K clk can be used with GPT%d\n",
+			       dev->gpt.timer_num);
+			retval = -EIO;
+		} else {
+			if (arg == 1)
+				dev->gpt.input_freq = CLK_13K_FREQ;
+			else
+				dev->gpt.input_freq = CLK_32K_FREQ;
+			pwm_publish(dev);
+		}
+		break;
+
+	case PWM_SET_PRE:
+		if (group)
+			retval = -EBUSY;
+		else if (prescale(dev, arg))
+			retval = -EIO;
+		break;
+
+	default:		/* redundant, as cmd was checked against MAXNR */
+		retval = -ENOTTY;
+	}
+
+      ioctl_done:
+	pwm_unlock(dev, group, flags);
+
+	return retval;
+
+}
+
+static long pwm_dev_ioctl(struct pwm_dev *dev,
+			  unsigned int cmd, unsigned long arg)
+{
+	struct pwm_op_mark m;
+	long retval;
+
+	trace_pwm_ioctl(dev->gpt.timer_num, cmd, arg);
+
+	pwm_op_begin(dev, &m);
+	retval = pwm_do_ioctl(dev, cmd, arg);
+
+	if (_IOC_TYPE(cmd) == PWM_IOC_MAGIC && _IOC_NR(cmd) <= PWM_IOC_MAXNR)
+		pwm_op_end(dev, _IOC_NR(cmd), &m);
+
+	return retval;
+}
+
+/* one per open(), in filp->private_data */
+struct pwm_file {
+	struct pwm_dev *dev;
+	fmode_t mode;
+	pid_t tgid;		/* of the process that opened it */
+	struct list_head list;	/* in dev->files */
+};
+
+static void pwm_snapshot(struct pwm_dev *dev, struct pwm_snap *snap)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&dev->snap_seq);
+		*snap = dev->snap;
+	} while (read_seqcount_retry(&dev->snap_seq, seq));
+}
+
+/*
+ * PWM_GET_DUTYCYCLE and PWM_GET_FREQUENCY without dev->lock, traced and
+ * counted in the stats like the ioctls pwm_dev_ioctl() runs.
+ */
+static long pwm_snap_get(struct pwm_dev *dev, unsigned int cmd)
+{
+	struct pwm_op_mark m;
+	struct pwm_snap snap;
+	long retval;
+
+	trace_pwm_ioctl(dev->gpt.timer_num, cmd, 0);
+
+	pwm_op_begin(dev, &m);
+	pwm_snapshot(dev, &snap);
+
+	if (cmd == PWM_GET_FREQUENCY)
+		retval = snap.frequency;
+	else if (!(snap.tclr & GPT_TCLR_ST))
+		retval = -EIO;
+	else
+		retval = (100 * (snap.tmar - snap.tldr)) / snap.num_freqs;
+
+	pwm_op_end(dev, _IOC_NR(cmd), &m);
+
+	return retval;
+}
+
+/* the ioctls a read only file may use, none of them change anything */
+static int pwm_monitor_cmd(unsigned int cmd)
+{
+	/* PWM_SCHED_DONE hands out the completions, that is the writer's */
+	if (cmd == PWM_SCHED_DONE)
+		return 0;
+
+	return cmd == PWM_STAMP_READ || _IOC_DIR(cmd) == _IOC_READ;
+}
+
+/*
+ * Checks that a file opened with mode may change dev. The first change
+ * muxes the pad and loads the timer, open() leaves the hardware alone.
+ */
+static int pwm_control(struct pwm_dev *dev, fmode_t mode)
+{
+	if (!(mode & FMODE_WRITE))
+		return -EBADF;
+
+	if (pwm_claimed(dev))
+		return -EBUSY;
+
+	if (dev->gpt.old_mux == 0) {
+		spin_lock_irq(&dev->lock);
+		if (dev->gpt.old_mux == 0 && !pwm_busy(dev) && !dev->group) {
+			init_mux(dev);
+			set_pwm_frequency(dev, dev->frequency);
+		}
+		spin_unlock_irq(&dev->lock);
+	}
+
+	return 0;
+}
+
+static int pwm_claim(struct pwm_file *f)
+{
+	struct pwm_dev *dev = f->dev;
+	int error = 0;
+
+	if (!(f->mode & FMODE_WRITE))
+		return -EBADF;
+
+	spin_lock_irq(&dev->lock);
+
+	if (dev->writer && dev->writer != f) {
+		error = -EBUSY;
+	} else {
+		dev->writer = f;
+		WRITE_ONCE(dev->writer_tgid, task_tgid_nr(current));
+	}
+
+	spin_unlock_irq(&dev->lock);
+
+	return error;
+}
+
+static int pwm_unclaim(struct pwm_file *f)
+{
+	struct pwm_dev *dev = f->dev;
+	int error = 0;
+
+	spin_lock_irq(&dev->lock);
+
+	if (dev->writer == f) {
+		dev->writer = NULL;
+		WRITE_ONCE(dev->writer_tgid, 0);
+	} else {
+		error = -EINVAL;
+	}
+
+	spin_unlock_irq(&dev->lock);
+
+	return error;
+}
+
+long pwm_ioctl(struct file *filp,
+	      unsigned int cmd, unsigned long arg)
+{
+	struct pwm_file *f = filp->private_data;
+	int error;
+
+	switch (cmd) {
+	case PWM_GET_DUTYCYCLE:
+	case PWM_GET_FREQUENCY:
+		return pwm_snap_get(f->dev, cmd);
+
+	case PWM_CLAIM:
+		return pwm_claim(f);
+
+	case PWM_UNCLAIM:
+		return pwm_unclaim(f);
+	}
+
+	/* a batch is checked op by op against its targets, not this file */
+	if (!pwm_monitor_cmd(cmd) && cmd != PWM_BATCH) {
+		error = pwm_control(f->dev, f->mode);
+		if (error)
+			return error;
+	}
+
+	return pwm_dev_ioctl(f->dev, cmd, arg);
+}
+
+/* the core ioctls that take their argument by value */
+static int pwm_batch_cmd_ok(unsigned int cmd)
+{
+	switch (cmd) {
+	case PWM_SET_DUTYCYCLE:
+	case PWM_GET_DUTYCYCLE:
+	case PWM_SET_FREQUENCY:
+	case PWM_GET_FREQUENCY:
+	case PWM_ON:
+	case PWM_OFF:
+	case PWM_SET_POLARITY:
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * A batch op may do what the caller could do on the target's own
+ * /dev/pwmN: its process needs a file open there, opened for writing
+ * for anything but the getters.
+ */
+static int pwm_batch_control(struct pwm_dev *dev, unsigned int cmd)
+{
+	pid_t tgid = task_tgid_nr(current);
+	struct pwm_file *f;
+	fmode_t mode = 0;
+	int open = 0;
+
+	spin_lock_irq(&dev->lock);
+
+	list_for_each_entry(f, &dev->files, list) {
+		if (f->tgid == tgid) {
+			mode |= f->mode;
+			open = 1;
+		}
+	}
+
+	spin_unlock_irq(&dev->lock);
+
+	if (!open)
+		return -EBADF;
+
+	if (cmd == PWM_GET_DUTYCYCLE || cmd == PWM_GET_FREQUENCY)
+		return 0;
+
+	return pwm_control(dev, mode);
+}
+
+/*
+ * PWM_BATCH. Every op goes through pwm_dev_ioctl() as if issued on its
+ * own /dev/pwmN, so open modes, claims, busy and grouped channels
+ * behave the same and the stats count each op.
+ */
+static long pwm_batch_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct pwm_batch *b;
+	struct pwm_dev *target;
+	long retval = 0;
+	int i;
+
+	if (cmd != PWM_BATCH)
+		return -ENOTTY;
+
+	b = kmalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+
+	if (copy_from_user(b, (void __user *)arg, sizeof(*b))) {
+		retval = -EFAULT;
+		goto batch_done;
+	}
+
+	if (b->count > PWM_BATCH_MAX) {
+		retval = -EINVAL;
+		goto batch_done;
+	}
+
+	for (i = 0; i < b->count; i++) {
+		if (!pwm_get_dev(b->op[i].timer)
+		    || !pwm_batch_cmd_ok(b->op[i].cmd)) {
+			retval = -EINVAL;
+			goto batch_done;
+		}
+	}
+
+	for (i = 0; i < b->count; i++) {
+		target = pwm_get_dev(b->op[i].timer);
+		b->op[i].result = pwm_batch_control(target, b->op[i].cmd);
+		if (!b->op[i].result)
+			b->op[i].result = pwm_dev_ioctl(target, b->op[i].cmd,
+							b->op[i].value);
+		if (b->op[i].result < 0 && !retval)
+			retval = b->op[i].result;
+	}
+
+	if (copy_to_user((void __user *)arg, b, sizeof(*b)))
+		retval = -EFAULT;
+
+      batch_done:
+	kfree(b);
+
+	return retval;
+}
+
+static struct pwm_ioctl_ext pwm_batch_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_BATCH),
+	.nr_last = _IOC_NR(PWM_BATCH),
+	.ioctl = pwm_batch_ioctl,
+};
+
+struct pwm_sched_item {
+	struct list_head list;
+	struct pwm_sched_entry e;
+};
+
+/* applies one entry and records the completion, pwm_lock() held */
+static void pwm_sched_run(struct pwm_dev *dev, unsigned long group,
+			  const struct pwm_sched_entry *e)
+{
+	struct pwm_sched_done *d;
+	u32 old_tmar = dev->gpt.tmar;
+	int running = dev->gpt.tclr & GPT_TCLR_ST;
+	int moved = 0;
+	enum pwm_tmar_move move = PWM_TMAR_NEXT;
+	u64 period_ns, due;
+	u32 pos;
+
+	d = &dev->sched_done[(dev->sched_head + dev->sched_count)
+			     % PWM_SCHED_DONE_MAX];
+
+	/* full, the oldest completion goes */
+	if (dev->sched_count == PWM_SCHED_DONE_MAX) {
+		dev->sched_head = (dev->sched_head + 1) % PWM_SCHED_DONE_MAX;
+		dev->sched_lost++;
+	} else {
+		dev->sched_count++;
+	}
+
+	d->id = e->id;
+
+	if (pwm_busy(dev)) {
+		d->result = -EBUSY;
+	} else if (e->cmd == PWM_SET_DUTYCYCLE && e->value > 0 && running) {
+		/* keep the counter going, only the match moves */
+		pwm_duty_to_tmar(dev, e->value);
+		move = pwm_update_tmar(dev, old_tmar);
+		moved = 1;
+		d->result = 0;
+	} else {
+		d->result = pwm_apply(dev, group, e->cmd, e->value);
+	}
+
+	/* frequency, on and off restart or stop the period right here */
+	d->applied_ns = pwm_now_ns();
+	d->effective_ns = d->applied_ns;
+
+	if (!moved)
+		return;
+
+	pos = pwm_reg_read(dev, GPT_TCRR) - dev->gpt.tldr;
+	period_ns = div_u64((u64)(0xFFFFFFFF - dev->gpt.tldr + 1)
+			    * NSEC_PER_SEC, dev->gpt.input_freq);
+
+	/* the period running now, the next one, or the one after the write */
+	d->effective_ns -= div_u64((u64)pos * NSEC_PER_SEC,
+				   dev->gpt.input_freq);
+	if (move == PWM_TMAR_NOW)
+		return;
+
+	d->effective_ns += period_ns;
+
+	/*
+	 * tmar_timer is due before the next overflow, past both matches.
+	 * Should it be due later, the write lands early in that period.
+	 */
+	if (move == PWM_TMAR_DEFERRED) {
+		due = ktime_to_ns(hrtimer_get_expires(&dev->tmar_timer));
+		if (due > d->effective_ns)
+			d->effective_ns += div64_u64(due - d->effective_ns,
+						     period_ns) * period_ns;
+	}
+}
+
+static enum hrtimer_restart pwm_sched_timer_fn(struct hrtimer *timer)
+{
+	struct pwm_dev *dev = container_of(timer, struct pwm_dev, sched_timer);
+	enum hrtimer_restart ret = HRTIMER_NORESTART;
+	struct pwm_sched_item *it, *next;
+	unsigned long flags, group;
+	u64 now;
+
+	group = pwm_lock(dev, &flags);
+
+	now = pwm_now_ns();
+
+	list_for_each_entry_safe(it, next, &dev->sched_queue, list) {
+		if (it->e.at_ns > now) {
+			hrtimer_set_expires(timer, ns_to_ktime(it->e.at_ns));
+			ret = HRTIMER_RESTART;
+			break;
+		}
+
+		list_del(&it->list);
+		dev->sched_pending--;
+		pwm_sched_run(dev, group, &it->e);
+		kfree(it);
+	}
+
+	pwm_unlock(dev, group, flags);
+
+	return ret;
+}
+
+static int pwm_sched_add(struct pwm_dev *dev, struct pwm_sched_entry *e)
+{
+	struct pwm_sched_item *it, *pos;
+	unsigned long flags;
+	int error = 0;
+
+	switch (e->cmd) {
+	case PWM_SET_DUTYCYCLE:
+	case PWM_SET_FREQUENCY:
+	case PWM_ON:
+	case PWM_OFF:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	it = kmalloc(sizeof(*it), GFP_KERNEL);
+	if (!it)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	if (pwm_busy(dev)) {
+		error = -EBUSY;
+	} else if (dev->sched_pending >= PWM_SCHED_MAX) {
+		error = -ENOSPC;
+	} else {
+		e->id = ++dev->sched_id;
+		it->e = *e;
+
+		/* behind everything due at the same time or earlier */
+		list_for_each_entry_reverse(pos, &dev->sched_queue, list) {
+			if (pos->e.at_ns <= e->at_ns)
+				break;
+		}
+		list_add(&it->list, &pos->list);
+		dev->sched_pending++;
+
+		if (dev->sched_queue.next == &it->list)
+			hrtimer_start(&dev->sched_timer,
+				      ns_to_ktime(e->at_ns), HRTIMER_MODE_ABS);
+	}
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	if (error)
+		kfree(it);
+
+	return error;
+}
+
+/* the timer may still fire, it finds the queue empty */
+static void pwm_sched_flush(struct pwm_dev *dev)
+{
+	struct pwm_sched_item *it, *next;
+	unsigned long flags;
+	LIST_HEAD(drop);
+
+	spin_lock_irqsave(&dev->lock, flags);
+	list_splice_init(&dev->sched_queue, &drop);
+	dev->sched_pending = 0;
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	list_for_each_entry_safe(it, next, &drop, list)
+		kfree(it);
+}
+
+static void pwm_sched_collect(struct pwm_dev *dev, struct pwm_sched_status *st)
+{
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	st->pending = dev->sched_pending;
+	st->lost = dev->sched_lost;
+	st->count = dev->sched_count;
+	st->reserved = 0;
+
+	for (i = 0; i < dev->sched_count; i++)
+		st->done[i] = dev->sched_done[(dev->sched_head + i)
+					      % PWM_SCHED_DONE_MAX];
+
+	dev->sched_head = 0;
+	dev->sched_count = 0;
+	dev->sched_lost = 0;
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+static long pwm_sched_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct pwm_sched_status *st;
+	struct pwm_sched_entry e;
+	long retval = 0;
+
+	switch (cmd) {
+	case PWM_SCHED_ADD:
+		if (copy_from_user(&e, (void __user *)arg, sizeof(e)))
+			return -EFAULT;
+
+		retval = pwm_sched_add(dev, &e);
+		if (!retval && copy_to_user((void __user *)arg, &e, sizeof(e)))
+			retval = -EFAULT;
+		return retval;
+
+	case PWM_SCHED_FLUSH:
+		pwm_sched_flush(dev);
+		return 0;
+
+	case PWM_SCHED_DONE:
+		st = kzalloc(sizeof(*st), GFP_KERNEL);
+		if (!st)
+			return -ENOMEM;
+
+		pwm_sched_collect(dev, st);
+		if (copy_to_user((void __user *)arg, st, sizeof(*st)))
+			retval = -EFAULT;
+
+		kfree(st);
+		return retval;
+	}
+
+	return -ENOTTY;
+}
+
+static struct pwm_ioctl_ext pwm_sched_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_SCHED_ADD),
+	.nr_last = _IOC_NR(PWM_SCHED_DONE),
+	.ioctl = pwm_sched_ioctl,
+};
+
+/*
+ * Period start timestamps, see PWM_STAMP_START in pwm_ioctl.h. The ring
+ * and its header are only written from the interrupt, under dev->lock.
+ */
+
+/* timer ticks to ns, long spans included */
+static u64 pwm_ticks_to_ns(struct pwm_dev *dev, u64 ticks)
+{
+	u32 rem;
+	u64 q = div_u64_rem(ticks, dev->gpt.input_freq, &rem);
+
+	return q * NSEC_PER_SEC
+	    + div_u64((u64)rem * NSEC_PER_SEC, dev->gpt.input_freq);
+}
+
+/* new period or first record, the averages start from the nominal */
+static void pwm_stamp_rebase(struct pwm_dev *dev, u64 start, u32 nominal)
+{
+	struct pwm_stamp_ring *r = dev->stamp;
+
+	dev->stamp_base = start;
+	dev->stamp_base_period = dev->stamp_period;
+	dev->stamp_avg = (s64)nominal << 8;
+	r->nominal_ns = nominal;
+	r->period_ns = nominal;
+	r->drift_ppb = 0;
+}
+
+static void pwm_stamp_update(struct pwm_dev *dev, u64 start, u32 nominal)
+{
+	struct pwm_stamp_ring *r = dev->stamp;
+	u32 period = 0xFFFFFFFF - dev->gpt.tldr + 1;
+	s64 dt = start - dev->stamp_last;
+	s64 err, diff;
+	u64 span;
+	u32 k;
+
+	/* periods since the last record, more than every if irqs were lost */
+	k = dt > 0 ? div_u64(dt + nominal / 2, nominal) : 1;
+	if (k < 1)
+		k = 1;
+	if (k > r->every)
+		r->missed += k - r->every;
+	dev->stamp_period += k;
+
+	/* stopped or held off for a while, the old baseline is no good */
+	if (k > 2 * r->every) {
+		pwm_stamp_rebase(dev, start, nominal);
+		return;
+	}
+
+	dev->stamp_avg += (div_s64(dt << 8, k) - dev->stamp_avg) >> 4;
+	err = dt - ((k * dev->stamp_avg) >> 8);
+	dev->stamp_dev += (err < 0 ? -err : err) - (dev->stamp_dev >> 4);
+	r->period_ns = dev->stamp_avg >> 8;
+	r->jitter_ns = dev->stamp_dev >> 4;
+
+	/* whole run against the timer clock, so the rate converges */
+	span = pwm_ticks_to_ns(dev, (dev->stamp_period - dev->stamp_base_period)
+			       * period);
+	diff = clamp_t(s64, span - (start - dev->stamp_base),
+		       -NSEC_PER_SEC, NSEC_PER_SEC);
+	r->drift_ppb = clamp_t(s64, div64_s64(diff * NSEC_PER_SEC, span),
+			       S32_MIN, S32_MAX);
+}
+
+static void pwm_stamp_irq(struct pwm_dev *dev)
+{
+	struct pwm_stamp_ring *r = dev->stamp;
+	struct pwm_stamp *rec;
+	u64 now, start;
+	u32 since, nominal;
+
+	if (--dev->stamp_skip)
+		return;
+
+	dev->stamp_skip = r->every;
+
+	/* back from now to the overflow by what the counter did since */
+	now = pwm_now_ns();
+	since = pwm_reg_read(dev, GPT_TCRR) - dev->gpt.tldr;
+	start = now - pwm_ticks_to_ns(dev, since);
+	nominal = min_t(u64, U32_MAX,
+			pwm_ticks_to_ns(dev, 0xFFFFFFFF - dev->gpt.tldr + 1));
+
+	if (r->head == 0) {
+		dev->stamp_period = r->every - 1;
+		pwm_stamp_rebase(dev, start, nominal);
+	} else if (nominal != r->nominal_ns) {
+		/* frequency or clock changed under us */
+		dev->stamp_period += r->every;
+		pwm_stamp_rebase(dev, start, nominal);
+	} else {
+		pwm_stamp_update(dev, start, nominal);
+	}
+
+	dev->stamp_last = start;
+	rec = &r->stamp[r->head & (r->size - 1)];
+	rec->time = start;
+	rec->period = dev->stamp_period;
+
+	/* the record before the head that covers it */
+	smp_wmb();
+	r->head++;
+}
+
+static int pwm_stamp_start(struct pwm_dev *dev, struct pwm_stamp_config *cfg)
+{
+	struct pwm_stamp_ring *r;
+	unsigned long flags;
+	int error;
+
+	if (!is_power_of_2(cfg->size) || cfg->size < PWM_STAMP_SIZE_MIN
+	    || cfg->size > PWM_STAMP_SIZE_MAX
+	    || cfg->every < 1 || cfg->every > PWM_STAMP_EVERY_MAX)
+		return -EINVAL;
+
+	r = vmalloc_user(sizeof(*r) + cfg->size * sizeof(r->stamp[0]));
+	if (!r)
+		return -ENOMEM;
+
+	r->size = cfg->size;
+	r->every = cfg->every;
+
+	if (pwm_sem_down(dev)) {
+		vfree(r);
+		return -ERESTARTSYS;
+	}
+
+	/* a mode has the interrupt to itself */
+	if (dev->mode || dev->stamp) {
+		error = -EBUSY;
+		goto start_fail;
+	}
+
+	error = dev->ops->request_irq(dev);
+	if (error)
+		goto start_fail;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->stamp = r;
+	dev->stamp_skip = r->every;
+	dev->stamp_period = 0;
+	dev->stamp_dev = 0;
+	pwm_reg_write(dev, GPT_TISR, GPT_IRQ_ALL);
+	pwm_reg_write(dev, GPT_TIER, GPT_IRQ_OVF);
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	up(&dev->sem);
+
+	return 0;
+
+      start_fail:
+	up(&dev->sem);
+	vfree(r);
+
+	return error;
+}
+
+/*
+ * vfree() only drops the kernel's reference, a mapping that is still
+ * around keeps its pages until munmap().
+ */
+static int pwm_stamp_stop(struct pwm_dev *dev)
+{
+	struct pwm_stamp_ring *r;
+	unsigned long flags;
+
+	down(&dev->sem);
+
+	r = dev->stamp;
+	if (!r) {
+		up(&dev->sem);
+		return -ENODEV;
+	}
+
+	spin_lock_irqsave(&dev->lock, flags);
+	pwm_reg_write(dev, GPT_TIER, 0);
+	pwm_reg_write(dev, GPT_TISR, GPT_IRQ_ALL);
+	dev->stamp = NULL;
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	dev->ops->free_irq(dev);
+	vfree(r);
+
+	up(&dev->sem);
+
+	return 0;
+}
+
+static int pwm_stamp_status(struct pwm_dev *dev, struct pwm_stamp_ring *st)
+{
+	unsigned long flags;
+	int error = 0;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	if (dev->stamp)
+		*st = *dev->stamp;
+	else
+		error = -ENODEV;
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return error;
+}
+
+/*
+ * Copies straight out of the ring like an mmap() reader would and
+ * starts over if the oldest record got overwritten meanwhile. dev->sem
+ * keeps the ring from going away under the copy.
+ */
+static int pwm_stamp_read(struct pwm_dev *dev, struct pwm_stamp_read *req)
+{
+	struct pwm_stamp __user *buf = (void __user *)(unsigned long)req->buf;
+	struct pwm_stamp_ring *r;
+	u32 head, seq, avail, n, i, first;
+	int error = 0;
+
+	if (pwm_sem_down(dev))
+		return -ERESTARTSYS;
+
+	r = dev->stamp;
+	if (!r) {
+		error = -ENODEV;
+		goto read_done;
+	}
+
+	seq = req->seq;
+	req->lost = 0;
+
+	do {
+		head = READ_ONCE(r->head);
+		smp_rmb();
+
+		/* a seq from the future gets nothing yet */
+		avail = (s32)(head - seq) > 0 ? head - seq : 0;
+		if (avail > r->size) {
+			req->lost += avail - r->size;
+			seq = head - r->size;
+			avail = r->size;
+		}
+
+		n = min(avail, req->count);
+		i = seq & (r->size - 1);
+		first = min(n, r->size - i);
+
+		if (copy_to_user(buf, &r->stamp[i], first * sizeof(*buf))
+		    || copy_to_user(buf + first, &r->stamp[0],
+				    (n - first) * sizeof(*buf))) {
+			error = -EFAULT;
+			goto read_done;
+		}
+
+		smp_rmb();
+		head = READ_ONCE(r->head);
+	} while (n && head - seq >= r->size);
+
+	req->seq = seq + n;
+	req->count = n;
+
+      read_done:
+	up(&dev->sem);
+
+	return error;
+}
+
+static long pwm_stamp_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct pwm_stamp_config cfg;
+	struct pwm_stamp_ring st;
+	struct pwm_stamp_read req;
+	long retval;
+
+	switch (cmd) {
+	case PWM_STAMP_START:
+		if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+			return -EFAULT;
+
+		return pwm_stamp_start(dev, &cfg);
+
+	case PWM_STAMP_STOP:
+		return pwm_stamp_stop(dev);
+
+	case PWM_STAMP_STATUS:
+		retval = pwm_stamp_status(dev, &st);
+		if (!retval && copy_to_user((void __user *)arg, &st, sizeof(st)))
+			retval = -EFAULT;
+		return retval;
+
+	case PWM_STAMP_READ:
+		if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			return -EFAULT;
+
+		retval = pwm_stamp_read(dev, &req);
+		if (!retval
+		    && copy_to_user((void __user *)arg, &req, sizeof(req)))
+			retval = -EFAULT;
+		return retval;
+	}
+
+	return -ENOTTY;
+}
+
+static struct pwm_ioctl_ext pwm_stamp_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_STAMP_START),
+	.nr_last = _IOC_NR(PWM_STAMP_READ),
+	.ioctl = pwm_stamp_ioctl,
+};
+
+/*
+ * Served from the snapshot, without the semaphore or the lock, so
+ * monitors never wait for the writer or each other.
+ */
+static ssize_t pwm_read(struct file *filp, char __user * buff, size_t count,
+			loff_t * offp)
+{
+	struct pwm_file *f = filp->private_data;
+	struct pwm_dev *dev = f->dev;
+	struct pwm_snap snap;
+	char buf[USER_BUFF_SIZE];
+	size_t len;
+
+	if (!buff)
+		return -EFAULT;
+
+	/* tell the user there is no more */
+	if (*offp > 0)
+		return 0;
+
+	pwm_snapshot(dev, &snap);
+
+	if (snap.tclr & GPT_TCLR_ST) {
+		snprintf(buf, sizeof(buf),
+			 "PWM%d Frequency %u Hz Duty Cycle %u%%\n",
+			 dev->gpt.timer_num, snap.frequency,
+			 (100 * (snap.tmar - snap.tldr)) / snap.num_freqs);
+	} else {
+		snprintf(buf, sizeof(buf),
+			 "PWM%d Frequency %u Hz Stopped\n",
+			 dev->gpt.timer_num, snap.frequency);
+	}
+
+	len = strlen(buf);
+
+	if (len + 1 < count)
+		count = len + 1;
+
+	if (copy_to_user(buff, buf, count)) {
+		printk(KERN_ALERT "pwm_read(): copy_to_user() failed\n");
+		return -EFAULT;
+	}
+
+	*offp += count;
+
+	return count;
+}
+
+static ssize_t pwm_write(struct file *filp, const char __user * buff,
+			 size_t count, loff_t * offp)
+{
+	size_t len;
+
+	ssize_t error = 0;
+	struct pwm_file *f = filp->private_data;
+	struct pwm_dev *dev = f->dev;
+	struct pwm_op_mark m;
+	unsigned long flags, group;
+	int duty_cycle;
+	char buf[16];
+
+	error = pwm_control(f->dev, f->mode);
+	if (error)
+		return error;
+
+	pwm_op_begin(dev, &m);
+
+	if (pwm_sem_down(dev))
+		return -ERESTARTSYS;
+
+	if (!buff || count < 1) {
+		printk(KERN_ALERT "pwm_write(): input check failed\n");
+		error = -EFAULT;
+		goto pwm_write_done;
+	}
+
+	/* we are only expecting a small integer, ignore anything else */
+	if (count > 8)
+		len = 8;
+	else
+		len = count;
+
+	memset(buf, 0, sizeof(buf));
+
+	if (copy_from_user(buf, buff, len)) {
+		printk(KERN_ALERT "pwm_write(): copy_from_user() failed\n");
+		error = -EFAULT;
+		goto pwm_write_done;
+	}
+
+	duty_cycle = simple_strtoul(buf, NULL, 0);
+
+	trace_pwm_write(dev->gpt.timer_num, duty_cycle);
+
+	group = pwm_lock(dev, &flags);
+
+	if (pwm_busy(dev)) {
+		pwm_unlock(dev, group, flags);
+		error = -EBUSY;
 		goto pwm_write_done;
 	}
 
-	dev->duty_cycle = simple_strtoul(dev->user_buff, NULL, 0);
+	if (!group)
+		set_pwm_frequency(dev,dev->frequency);
+	set_duty_cycle(dev,duty_cycle);
 
-	set_duty_cycle(dev,dev->duty_cycle);
+	pwm_unlock(dev, group, flags);
 
 	/* pretend we ate it all */
 	*offp += count;
@@ -487,49 +2354,193 @@ static ssize_t pwm_write(struct file *filp, const char __user * buff,
 
 	up(&(dev->sem));
 
+	pwm_op_end(dev, PWM_OP_WRITE, &m);
+
 	return error;
 }
 
+/*
+ * Only sets up the file, the hardware is touched by the first change,
+ * see pwm_control(). O_EXCL claims the channel as with PWM_CLAIM.
+ */
 static int pwm_open(struct inode *inode, struct file *filp)
 {
-	int error = 0;
 	struct pwm_dev *dev;	/* device information */
-	/*int d=PWM_DUTYCYCLE;
-	   int f=PWM_FREQUENCY;
-	   int on=PWM_ON;
-	   int off=PWM_OFF; */
-	int f = PWM_SET_DUTYCYCLE;
+	struct pwm_op_mark m;
+	struct pwm_file *f;
+	int error = 0;
+
 	dev = container_of(inode->i_cdev, struct pwm_dev, cdev);
-	filp->private_data = dev;	/* for other methods */
 
-	if (down_interruptible(&(dev->sem)))
+	pwm_op_begin(dev, &m);
+
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (!f)
+		return -ENOMEM;
+
+	f->dev = dev;
+	f->mode = filp->f_mode;
+	f->tgid = task_tgid_nr(current);
+
+	if (filp->f_flags & O_EXCL)
+		error = pwm_claim(f);
+
+	if (error) {
+		kfree(f);
+	} else {
+		spin_lock_irq(&dev->lock);
+		list_add(&f->list, &dev->files);
+		spin_unlock_irq(&dev->lock);
+		filp->private_data = f;	/* for other methods */
+	}
+
+	pwm_op_end(dev, PWM_OP_OPEN, &m);
+
+	return error;
+}
+
+static int pwm_release(struct inode *inode, struct file *filp)
+{
+	struct pwm_file *f = filp->private_data;
+
+	pwm_unclaim(f);
+
+	spin_lock_irq(&f->dev->lock);
+	list_del(&f->list);
+	spin_unlock_irq(&f->dev->lock);
+
+	kfree(f);
+
+	return 0;
+}
+
+/* the PWM_STAMP_* ring, read only */
+static int pwm_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct pwm_file *f = filp->private_data;
+	struct pwm_dev *dev = f->dev;
+	int error;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	if (pwm_sem_down(dev))
 		return -ERESTARTSYS;
 
-	if (dev->gpt.old_mux == 0) {
-		if (init_mux(dev))
-			error = -EIO;
-		else if (set_pwm_frequency(dev,dev->frequency))
-			error = -EIO;
-	}
+	if (dev->stamp) {
+		vm_flags_clear(vma, VM_MAYWRITE);
+		error = remap_vmalloc_range(vma, dev->stamp, vma->vm_pgoff);
+	} else {
+		error = -ENODEV;
+	}
+
+	up(&dev->sem);
+
+	return error;
+}
+
+static struct file_operations pwm_fops = {
+	.owner = THIS_MODULE,
+	.read = pwm_read,
+	.write = pwm_write,
+	.open = pwm_open,
+	.release = pwm_release,
+	.mmap = pwm_mmap,
+	.unlocked_ioctl = pwm_ioctl,
+};
+
+static const char *const pwm_op_names[PWM_OP_NR] = {
+	[_IOC_NR(PWM_SET_DUTYCYCLE)] = "set_dutycycle",
+	[_IOC_NR(PWM_GET_DUTYCYCLE)] = "get_dutycycle",
+	[_IOC_NR(PWM_SET_FREQUENCY)] = "set_frequency",
+	[_IOC_NR(PWM_GET_FREQUENCY)] = "get_frequency",
+	[_IOC_NR(PWM_ON)] = "on",
+	[_IOC_NR(PWM_OFF)] = "off",
+	[_IOC_NR(PWM_SET_POLARITY)] = "set_polarity",
+	[_IOC_NR(PWM_SET_CLK)] = "set_clk",
+	[_IOC_NR(PWM_SET_PRE)] = "set_pre",
+	[PWM_OP_READ] = "read",
+	[PWM_OP_WRITE] = "write",
+	[PWM_OP_OPEN] = "open",
+};
+
+static void pwm_hist_show(struct seq_file *m, const char *name,
+			  struct pwm_hist *h)
+{
+	int i;
+
+	seq_printf(m, "%s count %llu sum_ns %llu max_ns %llu\n", name,
+		   h->count, h->sum, h->max);
+
+	for (i = 0; i < PWM_HIST_BUCKETS; i++) {
+		if (h->bucket[i])
+			seq_printf(m, "%s lt_ns %llu %llu\n", name,
+				   1ULL << i, h->bucket[i]);
+	}
+}
+
+/*
+ * One line per value, "<name> <key> <value> ..." so that scripts can
+ * grep for what they want. Writing anything to the file clears it.
+ */
+static int pwm_stats_show(struct seq_file *m, void *v)
+{
+	struct pwm_dev *dev = m->private;
+	struct pwm_stats *st;
+	int i;
+
+	st = kmalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return -ENOMEM;
+
+	spin_lock_irq(&dev->stats_lock);
+	*st = dev->stats;
+	spin_unlock_irq(&dev->stats_lock);
+
+	for (i = 0; i < PWM_OP_NR; i++) {
+		if (pwm_op_names[i] && st->ops[i])
+			seq_printf(m, "op %s count %llu reg_writes %llu\n",
+				   pwm_op_names[i], st->ops[i],
+				   st->op_writes[i]);
+	}
+
+	pwm_hist_show(m, "sem_wait", &st->sem_wait);
+	pwm_hist_show(m, "reg_access", &st->reg_access);
+	pwm_hist_show(m, "request", &st->request);
+
+	kfree(st);
+
+	return 0;
+}
+
+static int pwm_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pwm_stats_show, inode->i_private);
+}
 
-	if (!dev->user_buff) {
-		dev->user_buff = kmalloc(USER_BUFF_SIZE, GFP_KERNEL);
-		if (!dev->user_buff)
-			error = -ENOMEM;
-	}
-	printk(KERN_ALERT "%d \n", f);
+static ssize_t pwm_stats_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct pwm_dev *dev = m->private;
+	u32 reg_writes;
 
-	up(&(dev->sem));
+	spin_lock_irq(&dev->stats_lock);
+	reg_writes = dev->stats.reg_writes;
+	memset(&dev->stats, 0, sizeof(dev->stats));
+	dev->stats.reg_writes = reg_writes;
+	spin_unlock_irq(&dev->stats_lock);
 
-	return error;
+	return count;
 }
 
-static struct file_operations pwm_fops = {
+static const struct file_operations pwm_stats_fops = {
 	.owner = THIS_MODULE,
-	.read = pwm_read,
-	.write = pwm_write,
-	.open = pwm_open,
-	.unlocked_ioctl = pwm_ioctl,
+	.open = pwm_stats_open,
+	.read = seq_read,
+	.write = pwm_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
 };
 
 static int __init pwm_init_cdev(struct pwm_dev *dev, int index)
@@ -543,138 +2554,771 @@ static int __init pwm_init_cdev(struct pwm_dev *dev, int index)
 	error = cdev_add(&(dev->cdev), d, 1);
 	if (error) {
 		printk(KERN_ALERT "cdev_add() failed: %d\n", error);
-		unregister_chrdev_region(d, 1);
 		return -1;
 	}
 
 	return 0;
 }
 
+/*
+ * Per channel attributes on the class device, one value each and read
+ * from the snapshot without locks. Changes are signalled with
+ * sysfs_notify(), so a monitor can poll() them.
+ */
+static u64 pwm_snap_period(const struct pwm_snap *snap)
+{
+	return (u64)0xFFFFFFFF - snap->tldr + 1;
+}
+
+static ssize_t period_ns_show(struct device *d,
+			      struct device_attribute *attr, char *buf)
+{
+	struct pwm_snap snap;
+
+	pwm_snapshot(dev_get_drvdata(d), &snap);
+
+	return sprintf(buf, "%llu\n",
+		       div_u64(pwm_snap_period(&snap) * NSEC_PER_SEC,
+			       snap.input_freq));
+}
+
+static ssize_t duty_ns_show(struct device *d,
+			    struct device_attribute *attr, char *buf)
+{
+	struct pwm_snap snap;
+
+	pwm_snapshot(dev_get_drvdata(d), &snap);
+
+	return sprintf(buf, "%llu\n",
+		       div_u64((u64)(snap.tmar - snap.tldr) * NSEC_PER_SEC,
+			       snap.input_freq));
+}
+
+static ssize_t tldr_show(struct device *d,
+			 struct device_attribute *attr, char *buf)
+{
+	struct pwm_snap snap;
+
+	pwm_snapshot(dev_get_drvdata(d), &snap);
+
+	return sprintf(buf, "0x%08x\n", snap.tldr);
+}
+
+static ssize_t tmar_show(struct device *d,
+			 struct device_attribute *attr, char *buf)
+{
+	struct pwm_snap snap;
+
+	pwm_snapshot(dev_get_drvdata(d), &snap);
+
+	return sprintf(buf, "0x%08x\n", snap.tmar);
+}
+
+static ssize_t enable_show(struct device *d,
+			   struct device_attribute *attr, char *buf)
+{
+	struct pwm_snap snap;
+
+	pwm_snapshot(dev_get_drvdata(d), &snap);
+
+	return sprintf(buf, "%d\n", !!(snap.tclr & GPT_TCLR_ST));
+}
+
+static ssize_t polarity_show(struct device *d,
+			     struct device_attribute *attr, char *buf)
+{
+	struct pwm_snap snap;
+
+	pwm_snapshot(dev_get_drvdata(d), &snap);
+
+	return sprintf(buf, "%s\n",
+		       (snap.tclr & GPT_TCLR_SCPWM) ? "inversed" : "normal");
+}
+
+static ssize_t clock_show(struct device *d,
+			  struct device_attribute *attr, char *buf)
+{
+	struct pwm_snap snap;
+
+	pwm_snapshot(dev_get_drvdata(d), &snap);
+
+	return sprintf(buf, "%s\n",
+		       snap.input_freq == CLK_13K_FREQ ? "13m" : "32k");
+}
+
+/* the frequency the period really gives, in mHz */
+static ssize_t achieved_mhz_show(struct device *d,
+				 struct device_attribute *attr, char *buf)
+{
+	struct pwm_snap snap;
+
+	pwm_snapshot(dev_get_drvdata(d), &snap);
+
+	return sprintf(buf, "%llu\n",
+		       div64_u64((u64)snap.input_freq * 1000,
+				 pwm_snap_period(&snap)));
+}
+
+static DEVICE_ATTR_RO(period_ns);
+static DEVICE_ATTR_RO(duty_ns);
+static DEVICE_ATTR_RO(tldr);
+static DEVICE_ATTR_RO(tmar);
+static DEVICE_ATTR_RO(enable);
+static DEVICE_ATTR_RO(polarity);
+static DEVICE_ATTR_RO(clock);
+static DEVICE_ATTR_RO(achieved_mhz);
+
+/* PWM_ATTR_* order */
+static struct attribute *pwm_attrs[] = {
+	&dev_attr_period_ns.attr,
+	&dev_attr_duty_ns.attr,
+	&dev_attr_tldr.attr,
+	&dev_attr_tmar.attr,
+	&dev_attr_enable.attr,
+	&dev_attr_polarity.attr,
+	&dev_attr_clock.attr,
+	&dev_attr_achieved_mhz.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(pwm);
+
+static void pwm_notify_work(struct work_struct *work)
+{
+	struct pwm_dev *dev = container_of(work, struct pwm_dev,
+					   notify_work);
+	unsigned long changed;
+	unsigned int i;
+
+	spin_lock_irq(&dev->lock);
+	changed = dev->notify;
+	dev->notify = 0;
+	spin_unlock_irq(&dev->lock);
+
+	for_each_set_bit(i, &changed, ARRAY_SIZE(pwm_attrs) - 1)
+		sysfs_notify(&dev->device->kobj, NULL, pwm_attrs[i]->name);
+}
+
 static int __init pwm_init_class(struct pwm_dev *dev, int index)
 {
 	dev_t d;
-	char name[] = "pwm";
-	char temp = index + 9;
-	strcat(name, &temp);
 
-	dev->class = class_create(THIS_MODULE, name);
 	d = MKDEV(MAJOR(dv), MINOR(dv) + index);
-	if (!dev->class) {
-		printk(KERN_ALERT "class_create() failed\n");
+	dev->device = device_create(pwm_class, NULL, d, dev, "pwm%d",
+				    dev->gpt.timer_num);
+	if (IS_ERR_OR_NULL(dev->device)) {
+		printk(KERN_ALERT "device_create(..., pwm%d) failed\n",
+		       dev->gpt.timer_num);
+		dev->device = NULL;
 		return -1;
 	}
 
-	if (!device_create(dev->class, NULL, d, NULL, "pwm%d", 9 + index)) {	//MINOR(pwm_dev.devt)
-		printk(KERN_ALERT "device_create(..., pwm) failed\n");
-		class_destroy(dev->class);
-		return -1;
+	return 0;
+}
+
+/*
+ * Takes over an output a previous instance left running with handoff
+ * set. Nothing is written, the software state is rebuilt from TCLR,
+ * TLDR and TMAR, and the pad counts as muxed so the first open does not
+ * restart the period. The pad setting from before that instance is
+ * gone, a later unload without handoff leaves the pad muxed. The
+ * clock source is in CM_CLKSEL, which the driver does not map, so only
+ * outputs on the 32 kHz clock are handed off; one with the prescaler on
+ * is left alone too, the rest of the driver does not account for it.
+ */
+static void __init pwm_adopt(struct pwm_dev *dev)
+{
+	u32 tclr = pwm_reg_read(dev, GPT_TCLR);
+	u32 tldr = pwm_reg_read(dev, GPT_TLDR);
+	u32 tmar = pwm_reg_read(dev, GPT_TMAR);
+	u32 mode = GPT_TCLR_ST | GPT_TCLR_AR | GPT_TCLR_CE | GPT_TCLR_PT;
+
+	if ((tclr & mode) != mode
+	    || (tclr & GPT_TCLR_TRG_MASK) != GPT_TCLR_TRG_OVFL_MATCH
+	    || (tclr & GPT_TCLR_PRE)
+	    || tldr >= 0xFFFFFFFE || tmar <= tldr)
+		return;
+
+	dev->gpt.tclr = tclr;
+	dev->gpt.tldr = tldr;
+	dev->gpt.tmar = tmar;
+	dev->gpt.num_freqs = 0xFFFFFFFE - tldr;
+	dev->gpt.old_mux = dev->ops->pad_read(dev->gpt.mux_offset);
+	dev->frequency = dev->gpt.input_freq / (0xFFFFFFFF - tldr + 1);
+	dev->duty_cycle = (100 * (tmar - tldr)) / dev->gpt.num_freqs;
+
+	printk(KERN_INFO "pwm%d: adopted running output, %d Hz %d%%\n",
+	       dev->gpt.timer_num, dev->frequency, dev->duty_cycle);
+}
+
+static int __init pwm_setup_dev(int index)
+{
+	const struct pwm_timer_desc *desc = &pwm_timers[index];
+	struct pwm_dev *dev = &pwm_devs[index];
+
+	dev->gpt.timer_num = desc->timer_num;
+	dev->gpt.mux_offset = desc->mux_offset;
+	dev->gpt.mux_mode = desc->mux_mode;
+	dev->gpt.gpt_base = desc->gpt_base;
+	dev->gpt.clocks = desc->clocks;
+	dev->gpt.irq = desc->irq;
+	dev->gpt.input_freq = CLK_32K_FREQ;
+	dev->gpt.tldr = DEFAULT_TLDR;
+	dev->gpt.tmar = DEFAULT_TMAR;
+	dev->gpt.tclr = DEFAULT_TCLR;
+	dev->frequency = frequency_param;
+	dev->duty_cycle = duty_cycle_param;
+	sema_init(&dev->sem, 1);
+	spin_lock_init(&dev->lock);
+	INIT_LIST_HEAD(&dev->files);
+	seqcount_init(&dev->snap_seq);
+	INIT_WORK(&dev->notify_work, pwm_notify_work);
+	spin_lock_init(&dev->stats_lock);
+	INIT_LIST_HEAD(&dev->sched_queue);
+	hrtimer_init(&dev->sched_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	dev->sched_timer.function = pwm_sched_timer_fn;
+	hrtimer_init(&dev->tmar_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	dev->tmar_timer.function = pwm_tmar_timer_fn;
+
+	if (pwm_ops->map(dev)) {
+		printk(KERN_ALERT "pwm%d: %s map failed\n",
+		       desc->timer_num, pwm_ops->name);
+		return -ENOMEM;
 	}
 
+	dev->ops = pwm_ops;
+
+	if (handoff)
+		pwm_adopt(dev);
+
+	pwm_publish(dev);
+
+	if (pwm_init_cdev(dev, index))
+		goto setup_fail_1;
+
+	if (pwm_init_class(dev, index))
+		goto setup_fail_2;
+
+	spin_lock_irq(&dev->lock);
+	dev->notify_on = 1;
+	spin_unlock_irq(&dev->lock);
+
+	/* debugfs is optional, carry on without it */
+	if (pwm_debugfs)
+		dev->debugfs = debugfs_create_file(dev_name(dev->device),
+						   S_IRUGO | S_IWUSR,
+						   pwm_debugfs, dev,
+						   &pwm_stats_fops);
+
 	return 0;
+
+      setup_fail_2:
+	cdev_del(&dev->cdev);
+      setup_fail_1:
+	dev->ops->unmap(dev);
+	dev->ops = NULL;
+	return -EIO;
 }
 
-static void __exit pwm_exit(void)
+/*
+ * Lands a move pwm_update_tmar() left to tmar_timer once the counter is
+ * out of the way, process context. A handed off output keeps it, the
+ * next instance reads TMAR back.
+ */
+static void pwm_tmar_flush(struct pwm_dev *dev)
 {
-	int i = 0;
-	dev_t d;
-	for (i = 0; i < PWM_NR; i++) {
-		if (pwm_enable[i]) {
-			d = MKDEV(MAJOR(dv), MINOR(dv) + i);
-			device_destroy(pwm_devs[i].class, d);
-			class_destroy(pwm_devs[i].class);
-			cdev_del(&pwm_devs[i].cdev);
-			unregister_chrdev_region(d, 1);
-			pwm_off(&pwm_devs[i]);
-			restore_mux(&pwm_devs[i]);
-			if (pwm_devs[i].user_buff)
-				kfree(pwm_devs[i].user_buff);
+	u64 wait;
+
+	spin_lock_irq(&dev->lock);
+	while (dev->tmar_pending && (dev->gpt.tclr & GPT_TCLR_ST)) {
+		wait = pwm_tmar_wait(dev, dev->tmar_hw);
+		if (!wait) {
+			pwm_write_tmar(dev);
+			break;
 		}
+
+		spin_unlock_irq(&dev->lock);
+		wait = div_u64(wait, NSEC_PER_USEC) + 1;
+		usleep_range(wait, wait + 100);
+		spin_lock_irq(&dev->lock);
+	}
+	dev->tmar_pending = 0;
+	spin_unlock_irq(&dev->lock);
+}
+
+static void pwm_teardown_dev(int index)
+{
+	struct pwm_dev *dev = &pwm_devs[index];
+
+	if (!dev->ops)
+		return;
+
+	/* no notifications for a device that is going away */
+	spin_lock_irq(&dev->lock);
+	dev->notify_on = 0;
+	spin_unlock_irq(&dev->lock);
+	cancel_work_sync(&dev->notify_work);
+
+	debugfs_remove(dev->debugfs);
+	device_destroy(pwm_class, MKDEV(MAJOR(dv), MINOR(dv) + index));
+	cdev_del(&dev->cdev);
+	hrtimer_cancel(&dev->sched_timer);
+	hrtimer_cancel(&dev->tmar_timer);
+	if (handoff)
+		pwm_tmar_flush(dev);
+	pwm_sched_flush(dev);
+	if (dev->stamp)
+		pwm_stamp_stop(dev);
+	/*
+	 * With handoff a running output is left to the next instance, if
+	 * pwm_adopt() can read its frequency back from the registers.
+	 */
+	spin_lock_irq(&dev->lock);
+	if (!handoff || !(dev->gpt.tclr & GPT_TCLR_ST)
+	    || dev->gpt.input_freq != CLK_32K_FREQ
+	    || (dev->gpt.tclr & GPT_TCLR_PRE)) {
+		pwm_off(dev);
+		restore_mux(dev);
+	}
+	spin_unlock_irq(&dev->lock);
+	dev->ops->unmap(dev);
+	dev->ops = NULL;
+}
+
+#ifdef CONFIG_PWM
+/*
+ * Generic PWM framework provider. Every timer in pwm_timers[] is a
+ * hwpwm of one chip, the ones not enabled at load time fail the
+ * request. A requested pwm holds its channel like any other in-kernel
+ * consumer, so /dev/pwmN goes read-only meanwhile.
+ */
+
+static struct platform_device *pwm_provider_pdev;
+static struct pwm_chip pwm_provider;
+
+static int pwm_provider_request(struct pwm_chip *chip, struct pwm_device *pwm)
+{
+	struct pwm_dev *dev;
+
+	dev = pwm_channel_request(pwm_timers[pwm->hwpwm].timer_num,
+				  pwm->label ? pwm->label : "pwm_chip");
+
+	return IS_ERR(dev) ? PTR_ERR(dev) : 0;
+}
+
+static void pwm_provider_free(struct pwm_chip *chip, struct pwm_device *pwm)
+{
+	pwm_channel_free(&pwm_devs[pwm->hwpwm]);
+}
+
+static int pwm_provider_apply(struct pwm_chip *chip, struct pwm_device *pwm,
+			      const struct pwm_state *state)
+{
+	struct pwm_dev *dev = &pwm_devs[pwm->hwpwm];
+	int inversed = state->polarity == PWM_POLARITY_INVERSED;
+	unsigned long flags;
+	u64 ticks;
+	u32 old_tmar;
+	int frequency;
+
+	if (!state->enabled)
+		return pwm_channel_disable(dev);
+
+	if (state->period == 0 || state->duty_cycle > state->period)
+		return -EINVAL;
+
+	frequency = div64_u64(NSEC_PER_SEC + state->period / 2, state->period);
+	if (frequency == 0)
+		return -ERANGE;
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	pwm_update_frequency(dev, frequency);
+
+	if (!!(dev->gpt.tclr & GPT_TCLR_SCPWM) != inversed)
+		scpwm(dev, inversed);
+
+	/* ticks of the clock, get_state() reads them back the same way */
+	ticks = div_u64(state->duty_cycle * dev->gpt.input_freq,
+			NSEC_PER_SEC);
+	dev->duty_cycle = div64_u64(state->duty_cycle * 100, state->period);
+
+	if (ticks == 0) {
+		dev->duty_cycle = 0;
+		pwm_off(dev);
+	} else {
+		/* on below 1% too, pwm_channel_enable() goes by this */
+		if (dev->duty_cycle == 0)
+			dev->duty_cycle = 1;
+		if (ticks > dev->gpt.num_freqs)
+			ticks = dev->gpt.num_freqs;
+
+		old_tmar = dev->gpt.tmar;
+		dev->gpt.tmar = dev->gpt.tldr + ticks;
+
+		/* no need to stop a running counter for a new duty */
+		if (dev->gpt.tclr & GPT_TCLR_ST)
+			pwm_update_tmar(dev, old_tmar);
+		else
+			pwm_on(dev);
+	}
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
+}
+
+static int pwm_provider_get_state(struct pwm_chip *chip,
+				  struct pwm_device *pwm,
+				  struct pwm_state *state)
+{
+	struct pwm_dev *dev = &pwm_devs[pwm->hwpwm];
+	unsigned long flags;
+	u64 period_ticks, duty_ticks;
+
+	if (!test_bit(pwm->hwpwm, &pwm_enabled))
+		return -ENODEV;
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	period_ticks = 0x100000000ULL - dev->gpt.tldr;
+	duty_ticks = dev->duty_cycle ? dev->gpt.tmar - dev->gpt.tldr : 0;
+
+	/* rounded up, so apply() of the result gives the same ticks */
+	state->enabled = !!(dev->gpt.tclr & GPT_TCLR_ST);
+	state->polarity = (dev->gpt.tclr & GPT_TCLR_SCPWM) ?
+	    PWM_POLARITY_INVERSED : PWM_POLARITY_NORMAL;
+	state->period = DIV_ROUND_UP_ULL(period_ticks * NSEC_PER_SEC,
+					 dev->gpt.input_freq);
+	state->duty_cycle = DIV_ROUND_UP_ULL(duty_ticks * NSEC_PER_SEC,
+					     dev->gpt.input_freq);
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
+}
+
+static const struct pwm_ops pwm_provider_ops = {
+	.request = pwm_provider_request,
+	.free = pwm_provider_free,
+	.apply = pwm_provider_apply,
+	.get_state = pwm_provider_get_state,
+	.owner = THIS_MODULE,
+};
+
+static int __init pwm_provider_add(void)
+{
+	int error;
+
+	/* gives the chip a stable name for pwm_add_table() lookups */
+	pwm_provider_pdev = platform_device_register_simple("omap-pwm", -1,
+							    NULL, 0);
+	if (IS_ERR(pwm_provider_pdev))
+		return PTR_ERR(pwm_provider_pdev);
+
+	pwm_provider.dev = &pwm_provider_pdev->dev;
+	pwm_provider.ops = &pwm_provider_ops;
+	pwm_provider.npwm = PWM_NR;
+
+	error = pwmchip_add(&pwm_provider);
+	if (error) {
+		printk(KERN_ALERT "pwmchip_add() failed: %d\n", error);
+		platform_device_unregister(pwm_provider_pdev);
+		pwm_provider_pdev = NULL;
 	}
+
+	return error;
+}
+
+static void pwm_provider_remove(void)
+{
+	if (!pwm_provider_pdev)
+		return;
+
+	pwmchip_remove(&pwm_provider);
+	platform_device_unregister(pwm_provider_pdev);
+	pwm_provider_pdev = NULL;
+}
+#else
+static inline int pwm_provider_add(void)
+{
+	return 0;
+}
+
+static inline void pwm_provider_remove(void)
+{
+}
+#endif
+
+static void pwm_cleanup(void)
+{
+	int i;
+
+	pwm_unregister_ioctl(&pwm_stamp_ext);
+	pwm_unregister_ioctl(&pwm_sched_ext);
+	pwm_unregister_ioctl(&pwm_batch_ext);
+	pwm_unregister_ioctl(&pwm_phase_ext);
+	pwm_provider_remove();
+
+	for (i = 0; i < PWM_NR; i++)
+		pwm_teardown_dev(i);
+
+	kfree(pwm_devs);
+	pwm_devs = NULL;
+	debugfs_remove(pwm_debugfs);
+	class_destroy(pwm_class);
+	pwm_ops->pad_unmap();
+	unregister_chrdev_region(dv, PWM_NR);
+}
+
+static void __exit pwm_exit(void)
+{
+	pwm_cleanup();
 }
 
 module_exit(pwm_exit);
 
-static int __init pwm_init(void)
+static int __init pwm_parse_params(void)
 {
-	int error = 0;
-	int count = 0;
-	int min = MAX;
-	int i = 0, j = 0;
-	dev_t d;
-	pwm_enable[0] = pwm9_enable;
-	pwm_enable[1] = pwm10_enable;
-	pwm_enable[2] = pwm11_enable;
+	int i, j;
 
-	for (i = 0; i < PWM_NR; i++) {
-		if (pwm_enable[i]) {
-			if (i + 9 < min)
-				min = i + 9;
-			count++;
+	for (i = 0; i < timers_count; i++) {
+		for (j = 0; j < PWM_NR; j++) {
+			if (pwm_timers[j].timer_num == timers[i])
+				break;
 		}
+
+		if (j == PWM_NR) {
+			printk(KERN_ALERT "GPT%d has no PWM output\n", timers[i]);
+			return -EINVAL;
+		}
+
+		__set_bit(j, &pwm_enabled);
+	}
+
+	for (j = 0; j < PWM_NR; j++) {
+		if ((pwm_timers[j].timer_num == 9 && pwm9_enable)
+		    || (pwm_timers[j].timer_num == 10 && pwm10_enable)
+		    || (pwm_timers[j].timer_num == 11 && pwm11_enable))
+			__set_bit(j, &pwm_enabled);
 	}
 
-	error = alloc_chrdev_region(&dv, min, count, "pwm");
+	return 0;
+}
+
+static int __init pwm_init(void)
+{
+	int error = 0;
+	int i = 0;
+
+	error = pwm_parse_params();
+	if (error)
+		return error;
+
+	error = alloc_chrdev_region(&dv, 0, PWM_NR, "pwm");
 
 	if (error < 0) {
 		printk(KERN_ALERT "alloc_chrdev_region() failed: %d \n", error);
 		return -1;
 	}
 
-	pwm_devs = kmalloc(PWM_NR * sizeof(struct pwm_dev), GFP_KERNEL);
+	pwm_class = class_create("omap-pwm");
+	if (IS_ERR_OR_NULL(pwm_class)) {
+		printk(KERN_ALERT "class_create() failed\n");
+		error = -ENOMEM;
+		goto init_fail_1;
+	}
+
+	pwm_class->dev_groups = pwm_groups;
+
+	pwm_ops = sim ? &pwm_sim_ops : &pwm_mmio_ops;
+
+	if (pwm_ops->pad_map()) {
+		printk(KERN_ALERT "pwm_init(): %s padconf map failed\n",
+		       pwm_ops->name);
+		error = -ENOMEM;
+		goto init_fail_2;
+	}
+
+	pwm_devs = kzalloc(PWM_NR * sizeof(struct pwm_dev), GFP_KERNEL);
 	if (!pwm_devs) {
 		error = -ENOMEM;
-		goto init_fail;	/* Make this more graceful */
+		goto init_fail_3;
 	}
 
-	memset(pwm_devs, 0, PWM_NR * sizeof(struct pwm_dev));
+	pwm_debugfs = debugfs_create_dir("omap-pwm", NULL);
+	if (IS_ERR(pwm_debugfs))
+		pwm_debugfs = NULL;
+
+	pwm_register_ioctl(&pwm_phase_ext);
+	pwm_register_ioctl(&pwm_batch_ext);
+	pwm_register_ioctl(&pwm_sched_ext);
+	pwm_register_ioctl(&pwm_stamp_ext);
 
 	for (i = 0; i < PWM_NR; i++) {
-		if (pwm_enable[i]) {
-			/* change these 4 values to use a different PWM */
-
-			pwm_devs[i].gpt.timer_num = 9 + i;
-			pwm_devs[i].gpt.mux_offset = gpt_offset[i];
-			pwm_devs[i].gpt.gpt_base = gpt_base[i];
-			pwm_devs[i].gpt.input_freq = CLK_32K_FREQ;
-			pwm_devs[i].gpt.tldr = DEFAULT_TLDR;
-			pwm_devs[i].gpt.tmar = DEFAULT_TMAR;
-			pwm_devs[i].gpt.tclr = DEFAULT_TCLR;
-			pwm_devs[i].frequency = frequency_param;
-			pwm_devs[i].duty_cycle = duty_cycle_param;
-			sema_init(&pwm_devs[i].sem, 1);
-			if (pwm_init_cdev(&pwm_devs[i], i))
-				goto init_fail_1;
-			if (pwm_init_class(&pwm_devs[i], i))
-				//er_count=i;
-				goto init_fail_2;
+		if (!test_bit(i, &pwm_enabled))
+			continue;
+
+		error = pwm_setup_dev(i);
+		if (error) {
+			pwm_cleanup();
+			return error;
 		}
+	}
 
+	error = pwm_provider_add();
+	if (error) {
+		pwm_cleanup();
+		return error;
 	}
+
 	return 0;
-      init_fail_2:
-	for (j = 0; j < PWM_NR; j++) {
-		if (pwm_enable[j]) {
-			cdev_del(&pwm_devs[j].cdev);
 
-			d = MKDEV(MAJOR(dv), MINOR(dv) + j);
-			unregister_chrdev_region(d, 1);
-		}
-	}
-	return error;
+      init_fail_3:
+	pwm_ops->pad_unmap();
+      init_fail_2:
+	class_destroy(pwm_class);
       init_fail_1:
+	unregister_chrdev_region(dv, PWM_NR);
 	return error;
+}
 
-      init_fail:
-	pwm_exit();
-	return error;
+/*
+ * Lookup for the engine modules and pwm_channel_request().
+ * Returns NULL if the timer was not enabled at load time.
+ */
+struct pwm_dev *pwm_get_dev(int timer_num)
+{
+	int i;
+
+	for (i = 0; i < PWM_NR; i++) {
+		if (pwm_timers[i].timer_num == timer_num)
+			return test_bit(i, &pwm_enabled) ? &pwm_devs[i] : NULL;
+	}
+
+	return NULL;
+}
+
+/*
+ * Claims a channel for an in-kernel user. /dev/pwmN keeps working for
+ * the getters, everything that would change the output gets -EBUSY
+ * until pwm_channel_free().
+ */
+struct pwm_dev *pwm_channel_request(int timer_num, const char *label)
+{
+	struct pwm_dev *dev = pwm_get_dev(timer_num);
+	int error = 0;
+
+	if (!dev)
+		return ERR_PTR(-ENODEV);
+
+	if (pwm_sem_down(dev))
+		return ERR_PTR(-ERESTARTSYS);
+
+	spin_lock_irq(&dev->lock);
+
+	if (pwm_busy(dev) || dev->group || dev->writer) {
+		error = -EBUSY;
+	} else {
+		dev->consumer = label ? label : "kernel";
+
+		if (dev->gpt.old_mux == 0)
+			init_mux(dev);
+
+		set_pwm_frequency(dev, dev->frequency);
+	}
+
+	spin_unlock_irq(&dev->lock);
+
+	up(&dev->sem);
+
+	return error ? ERR_PTR(error) : dev;
+}
+
+void pwm_channel_free(struct pwm_dev *dev)
+{
+	down(&dev->sem);
+
+	spin_lock_irq(&dev->lock);
+	pwm_off(dev);
+	dev->consumer = NULL;
+	spin_unlock_irq(&dev->lock);
+
+	up(&dev->sem);
+}
+
+/*
+ * Safe from any context. The timer is only reloaded when the frequency
+ * actually changes, a duty-only update leaves the counter alone. A
+ * stopped channel stays stopped until pwm_channel_enable().
+ */
+int pwm_channel_config(struct pwm_dev *dev, int frequency, int duty_cycle)
+{
+	unsigned long flags;
+	u32 old_tmar;
+
+	if (duty_cycle < 0 || duty_cycle > 100)
+		return -EINVAL;
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	pwm_update_frequency(dev, frequency);
+
+	old_tmar = dev->gpt.tmar;
+
+	/* a running counter keeps going, only the match moves */
+	if (!pwm_duty_to_tmar(dev, duty_cycle))
+		pwm_off(dev);
+	else if (dev->gpt.tclr & GPT_TCLR_ST)
+		pwm_update_tmar(dev, old_tmar);
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
+}
+
+int pwm_channel_enable(struct pwm_dev *dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	/* a zero duty cycle means the output is held off */
+	if (dev->duty_cycle && !(dev->gpt.tclr & GPT_TCLR_ST))
+		pwm_on(dev);
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
+}
+
+int pwm_channel_disable(struct pwm_dev *dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	pwm_off(dev);
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
 }
 
 module_init(pwm_init);
 
-EXPORT_SYMBOL(pwm_devs);
-EXPORT_SYMBOL(set_pwm_frequency);
-EXPORT_SYMBOL(set_duty_cycle);
-EXPORT_SYMBOL(pwm_off);
+EXPORT_SYMBOL(pwm_get_dev);
+EXPORT_SYMBOL(pwm_channel_request);
+EXPORT_SYMBOL(pwm_channel_free);
+EXPORT_SYMBOL(pwm_channel_config);
+EXPORT_SYMBOL(pwm_channel_enable);
+EXPORT_SYMBOL(pwm_channel_disable);
+EXPORT_SYMBOL(pwm_mode_attach);
+EXPORT_SYMBOL(pwm_mode_attach_locks);
+EXPORT_SYMBOL(pwm_mode_detach);
+EXPORT_SYMBOL(pwm_publish);
+EXPORT_SYMBOL(pwm_channel_bit);
+EXPORT_SYMBOL(pwm_lock_channels);
+EXPORT_SYMBOL(pwm_unlock_channels);
+EXPORT_SYMBOL(pwm_register_ioctl);
+EXPORT_SYMBOL(pwm_unregister_ioctl);
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Scott Ellis - Jumpnow");
 MODULE_DESCRIPTION("PWM example for OMAP3");
@@ -32,6 +32,8 @@
 #ifndef PWM_H
 #define PWM_H
 
+#include "pwm_ioctl.h"
+
 #define OMAP34XX_PADCONF_START  0x48002030
 #define OMAP34XX_PADCONF_SIZE   0x05cc
 
@@ -41,9 +43,10 @@
 #define GPT11_MUX_OFFSET	(0x48002178 - OMAP34XX_PADCONF_START)
 
 #define PWM_ENABLE_MUX		0x0002	/* IDIS | PTD | DIS | M2 */
+#define PWM_MUX_INPUT		0x0100	/* IEN, the pin is a capture input */
 
-#define CLK_32K_FREQ	32768
-#define CLK_13K_FREQ	13312
+#define CLK_32K_FREQ	PWM_INPUT_32K
+#define CLK_13K_FREQ	PWM_INPUT_13K
 #define CLK_SYS_FREQ	13000000
 
 #define GPTIMER8		0x4903E000
@@ -53,6 +56,12 @@
 
 #define GPT_REGS_PAGE_SIZE      4096
 
+/* MPU interrupt lines of the timers */
+#define GPT8_IRQ		44
+#define GPT9_IRQ		45
+#define GPT10_IRQ		46
+#define GPT11_IRQ		47
+
 #define PWM8_CTL_BASE		GPTIMER8
 #define PWM9_CTL_BASE		GPTIMER9
 #define PWM10_CTL_BASE		GPTIMER10
@@ -79,6 +88,23 @@
 #define GPT_TOCR      0x054
 #define GPT_TOWR      0x058
 
+/* TSICR bits */
+#define GPT_TSICR_SFT		(1 << 1)	/* software reset */
+#define GPT_TSICR_POSTED	(1 << 2)	/* posted write mode */
+
+/* TWPS bits, a posted write to the register is still in flight */
+#define GPT_TWPS_TCLR		(1 << 0)
+#define GPT_TWPS_TCRR		(1 << 1)
+#define GPT_TWPS_TLDR		(1 << 2)
+#define GPT_TWPS_TTGR		(1 << 3)
+#define GPT_TWPS_TMAR		(1 << 4)
+
+/* TISR/TIER/TWER bits */
+#define GPT_IRQ_MAT		(1 << 0)	/* match */
+#define GPT_IRQ_OVF		(1 << 1)	/* overflow */
+#define GPT_IRQ_TCAR		(1 << 2)	/* capture */
+#define GPT_IRQ_ALL		(GPT_IRQ_MAT | GPT_IRQ_OVF | GPT_IRQ_TCAR)
+
 /* TCLR bits for PWM */
 #define GPT_TCLR_ST     	(1 << 0)	/* stop/start */
 #define GPT_TCLR_AR     	(1 << 1)	/* one shot/auto-reload */
@@ -87,6 +113,7 @@
 #define GPT_TCLR_CE     	(1 << 6)	/* disable/enable compare */
 #define GPT_TCLR_SCPWM  	(1 << 7)	/* PWM value when off */
 #define GPT_TCLR_TCM_MASK    	(3 << 8)	/* transition capture mode */
+#define GPT_TCLR_TCM_RISING	(1 << 8)	/* capture on rising edges */
 
 #define GPT_TCLR_TRG_MASK 	(3 << 10)	/* trigger output mode */
 #define GPT_TCLR_TRG_OVFL	(1 << 10)	/* trigger on overflow */
@@ -96,31 +123,12 @@
 #define GPT_TCLR_CAPT_MODE      (1 << 13)	/* capture mode config */
 #define GPT_TCLR_GPO_CFG        (1 << 14)	/* pwm or capture mode */
 
-#define PWM_NR 3
+/* functional clock sources a timer can be switched to */
+#define PWM_CLK_32K	(1 << 0)
+#define PWM_CLK_13K	(1 << 1)
 
 #ifndef PWM_MAJOR
 #define PWM_MAJOR 0		/* dynamic major by default */
 #endif
 
-int gpt_offset[PWM_NR] =
-    { GPT9_MUX_OFFSET, GPT10_MUX_OFFSET, GPT11_MUX_OFFSET };
-int gpt_base[PWM_NR] = { PWM9_CTL_BASE, PWM10_CTL_BASE, PWM11_CTL_BASE };
-
-/*
- * Ioctl definitions
- */
-
-#define PWM_IOC_MAGIC  0x00
-
-#define PWM_SET_DUTYCYCLE _IOW(PWM_IOC_MAGIC ,  1, int)
-#define PWM_GET_DUTYCYCLE _IOW(PWM_IOC_MAGIC ,  2, int)
-#define PWM_SET_FREQUENCY _IOW(PWM_IOC_MAGIC ,  3, int)
-#define PWM_GET_FREQUENCY _IOW(PWM_IOC_MAGIC ,  4, int)
-#define PWM_ON _IO(PWM_IOC_MAGIC ,  5)
-#define PWM_OFF _IO(PWM_IOC_MAGIC ,  6)
-#define PWM_SET_POLARITY _IOW(PWM_IOC_MAGIC ,  7, int)
-#define PWM_SET_CLK _IOW(PWM_IOC_MAGIC ,  8, int)
-#define PWM_SET_PRE _IOW(PWM_IOC_MAGIC ,  9, int)
-#define PWM_IOC_MAXNR 9
-
 #endif /* ifndef PWM_H */
@@ -0,0 +1,434 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Three phase sinusoidal PWM for a BLDC/PMSM inverter. The channel the
+ ioctl is issued on drives phase U, the other two are claimed with
+ pwm_channel_request() for V and W. All three share one carrier and
+ are started back to back from the same counter value.
+
+ Every carrier period the U overflow interrupt steps a 32 bit
+ electrical angle and writes the three TMARs from the sine table in
+ pwm_wave.h, 120 degrees apart. With PWM_3PH_SVPWM the common mode of
+ the three is shifted by -(max + min) / 2, which gives the space vector
+ pattern and 15% more line voltage than plain sine.
+
+ Controlled with the PWM_3PH_* ioctls on the U channel's /dev/pwmN, see
+ pwm_ioctl.h.
+*/
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/errno.h>
+#include <linux/err.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/uaccess.h>
+
+#include "pwm_core.h"
+#include "pwm_wave.h"
+
+#define PWM_3PH_120	0x55555555	/* of a 2^32 turn */
+
+struct pwm_3ph {
+	struct list_head list;
+	struct pwm_dev *dev[3];	/* U, V and W, V and W claimed */
+	unsigned long locks;	/* of all three, see pwm_lock_channels() */
+	u32 flags;
+	u32 period;		/* carrier, ticks */
+	u32 off[3];		/* TMAR - TLDR the timers have now */
+	u32 angle;
+	u32 step;		/* angle per carrier period */
+	struct pwm_3ph_drive drive;
+	u32 periods;
+	u32 late;
+};
+
+static LIST_HEAD(pwm_3ph_list);
+static DEFINE_MUTEX(pwm_3ph_lock);
+
+/* duties for the U, V and W at angle, 0 to 0xFFFF */
+static void pwm_3ph_duty(struct pwm_3ph *t, u32 angle, u32 *duty)
+{
+	s32 v[3], lo, hi, shift = 0;
+	unsigned int i;
+
+	v[0] = ((s64)pwm_wave_sine(angle) * t->drive.modulation) >> 16;
+	v[1] = ((s64)pwm_wave_sine(angle - PWM_3PH_120)
+		* t->drive.modulation) >> 16;
+	v[2] = ((s64)pwm_wave_sine(angle + PWM_3PH_120)
+		* t->drive.modulation) >> 16;
+
+	if (t->flags & PWM_3PH_SVPWM) {
+		lo = min3(v[0], v[1], v[2]);
+		hi = max3(v[0], v[1], v[2]);
+		shift = -(hi + lo) / 2;
+	}
+
+	/* a full scale sample is half the duty range either way */
+	for (i = 0; i < 3; i++)
+		duty[i] = clamp_t(s32, 0x8000 + v[i] + shift, 0, 0xFFFF);
+}
+
+static u32 pwm_3ph_off(struct pwm_3ph *t, u32 duty)
+{
+	u32 off = ((u64)t->period * duty) >> 16;
+
+	return clamp_t(u32, off, 1, t->period - 1);
+}
+
+static void pwm_3ph_irq(struct pwm_dev *dev, void *data, u32 status)
+{
+	struct pwm_3ph *t = data;
+	u32 duty[3], off[3], now;
+	unsigned int i;
+
+	if (!(status & GPT_IRQ_OVF))
+		return;
+
+	t->angle += t->step;
+	t->periods++;
+	pwm_3ph_duty(t, t->angle, duty);
+
+	/* all three or none, the motor sees the differences between them */
+	for (i = 0; i < 3; i++) {
+		off[i] = pwm_3ph_off(t, duty[i]);
+		now = pwm_reg_read(t->dev[i], GPT_TCRR) - t->dev[i]->gpt.tldr;
+		if ((now < t->off[i]) != (now < off[i])) {
+			t->late++;
+			return;
+		}
+	}
+
+	for (i = 0; i < 3; i++) {
+		t->off[i] = off[i];
+		t->dev[i]->gpt.tmar = t->dev[i]->gpt.tldr + off[i];
+		pwm_reg_write(t->dev[i], GPT_TMAR, t->dev[i]->gpt.tmar);
+	}
+}
+
+/* all phases low */
+static void pwm_3ph_stop(struct pwm_dev *dev, void *data)
+{
+	struct pwm_3ph *t = data;
+	unsigned long flags;
+	unsigned int i;
+
+	pwm_lock_channels(t->locks, &flags);
+
+	for (i = 0; i < 3; i++) {
+		pwm_reg_write(t->dev[i], GPT_TCLR, 0);
+		t->dev[i]->gpt.tclr = DEFAULT_TCLR;
+		pwm_publish(t->dev[i]);
+	}
+
+	pwm_unlock_channels(t->locks, flags);
+}
+
+static const struct pwm_mode pwm_3ph_mode = {
+	.name = "3ph",
+	.irq_events = GPT_IRQ_OVF,
+	.irq = pwm_3ph_irq,
+	.stop = pwm_3ph_stop,
+};
+
+static struct pwm_3ph *pwm_3ph_find(struct pwm_dev *dev)
+{
+	struct pwm_3ph *t;
+
+	list_for_each_entry(t, &pwm_3ph_list, list) {
+		if (t->dev[0] == dev)
+			return t;
+	}
+
+	return NULL;
+}
+
+static int pwm_3ph_check(struct pwm_dev *dev, u32 flags, u32 period,
+			 const struct pwm_3ph_drive *drive)
+{
+	u32 max = flags & PWM_3PH_SVPWM ? PWM_3PH_MOD_MAX_SVPWM
+	    : PWM_3PH_MOD_MAX_SINE;
+	u64 mhz = drive->frequency < 0 ? -(s64)drive->frequency
+	    : drive->frequency;
+
+	if (drive->modulation > max)
+		return -EINVAL;
+
+	/* below half the carrier, a usable drive wants it much lower */
+	if (mhz * period * 2 >= (u64)dev->gpt.input_freq * 1000)
+		return -EINVAL;
+
+	return 0;
+}
+
+/* angle per carrier period, the sign of frequency picks the direction */
+static u32 pwm_3ph_step(struct pwm_3ph *t, s32 frequency)
+{
+	u64 mhz = frequency < 0 ? -(s64)frequency : frequency;
+	u32 step;
+
+	step = (u32)div64_u64((mhz * t->period) << 30,
+			      (u64)t->dev[0]->gpt.input_freq * 1000) << 2;
+
+	return frequency < 0 ? -step : step;
+}
+
+static int pwm_3ph_start(struct pwm_dev *u, struct pwm_3ph_config *cfg)
+{
+	struct pwm_3ph *t;
+	struct pwm_dev *dev;
+	unsigned long flags;
+	u32 duty[3], tldr;
+	unsigned int i;
+	int error;
+
+	if (cfg->carrier < 1 || (cfg->flags & ~PWM_3PH_SVPWM))
+		return -EINVAL;
+
+	if (pwm_3ph_find(u))
+		return -EBUSY;
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+
+	t->dev[0] = u;
+	t->flags = cfg->flags;
+	t->period = u->gpt.input_freq / cfg->carrier;
+	t->drive = cfg->drive;
+
+	if (t->period < 4) {
+		error = -EINVAL;
+		goto start_fail_1;
+	}
+
+	error = pwm_3ph_check(u, t->flags, t->period, &t->drive);
+	if (error)
+		goto start_fail_1;
+
+	t->dev[1] = pwm_channel_request(cfg->v_timer, "pwm_3ph");
+	if (IS_ERR(t->dev[1])) {
+		error = PTR_ERR(t->dev[1]);
+		goto start_fail_1;
+	}
+
+	t->dev[2] = pwm_channel_request(cfg->w_timer, "pwm_3ph");
+	if (IS_ERR(t->dev[2])) {
+		error = PTR_ERR(t->dev[2]);
+		goto start_fail_2;
+	}
+
+	/* one clock, so one period in ticks is one period in time */
+	if (t->dev[1] == u || t->dev[2] == u
+	    || t->dev[1]->gpt.input_freq != u->gpt.input_freq
+	    || t->dev[2]->gpt.input_freq != u->gpt.input_freq) {
+		error = -EINVAL;
+		goto start_fail_3;
+	}
+
+	t->step = pwm_3ph_step(t, t->drive.frequency);
+	t->locks = pwm_channel_bit(u) | pwm_channel_bit(t->dev[1])
+	    | pwm_channel_bit(t->dev[2]);
+
+	error = pwm_mode_attach_locks(u, &pwm_3ph_mode, t, t->locks);
+	if (error)
+		goto start_fail_3;
+
+	list_add(&t->list, &pwm_3ph_list);
+
+	tldr = 0xFFFFFFFF - t->period + 1;
+	pwm_3ph_duty(t, t->angle, duty);
+
+	pwm_lock_channels(t->locks, &flags);
+
+	for (i = 0; i < 3; i++) {
+		dev = t->dev[i];
+		t->off[i] = pwm_3ph_off(t, duty[i]);
+
+		dev->gpt.tclr = DEFAULT_TCLR;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+
+		dev->gpt.tldr = tldr;
+		dev->gpt.num_freqs = 0xFFFFFFFE - tldr;
+		dev->gpt.tmar = tldr + t->off[i];
+		dev->frequency = cfg->carrier;
+
+		pwm_reg_write(dev, GPT_TLDR, tldr);
+		pwm_reg_write(dev, GPT_TCRR, tldr);
+		pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+	}
+
+	/* back to back, U last so its first interrupt finds V and W running */
+	for (i = 3; i-- > 0;) {
+		dev = t->dev[i];
+		dev->gpt.tclr |= GPT_TCLR_ST;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+		/* the carrier, the modulation is not republished */
+		pwm_publish(dev);
+	}
+
+	pwm_unlock_channels(t->locks, flags);
+
+	return 0;
+
+      start_fail_3:
+	pwm_channel_free(t->dev[2]);
+      start_fail_2:
+	pwm_channel_free(t->dev[1]);
+      start_fail_1:
+	kfree(t);
+
+	return error;
+}
+
+static int pwm_3ph_set(struct pwm_3ph *t, struct pwm_3ph_drive *drive)
+{
+	unsigned long flags;
+	int error;
+
+	error = pwm_3ph_check(t->dev[0], t->flags, t->period, drive);
+	if (error)
+		return error;
+
+	/* both at once, the next interrupt picks them up */
+	spin_lock_irqsave(&t->dev[0]->lock, flags);
+	t->drive = *drive;
+	t->step = pwm_3ph_step(t, drive->frequency);
+	spin_unlock_irqrestore(&t->dev[0]->lock, flags);
+
+	return 0;
+}
+
+static void pwm_3ph_status(struct pwm_3ph *t, struct pwm_3ph_status *st)
+{
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&t->dev[0]->lock, flags);
+	st->carrier = t->dev[0]->gpt.input_freq / t->period;
+	st->angle = t->angle >> 16;
+	for (i = 0; i < 3; i++)
+		st->duty[i] = div_u64((u64)t->off[i] << 16, t->period);
+	st->periods = t->periods;
+	st->late = t->late;
+	st->drive = t->drive;
+	spin_unlock_irqrestore(&t->dev[0]->lock, flags);
+}
+
+static void pwm_3ph_release(struct pwm_3ph *t)
+{
+	list_del(&t->list);
+	pwm_mode_detach(t->dev[0], &pwm_3ph_mode);
+	pwm_channel_free(t->dev[2]);
+	pwm_channel_free(t->dev[1]);
+	kfree(t);
+}
+
+static long pwm_3ph_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct pwm_3ph_config cfg;
+	struct pwm_3ph_drive drive;
+	struct pwm_3ph_status st;
+	struct pwm_3ph *t;
+	long retval = 0;
+
+	mutex_lock(&pwm_3ph_lock);
+
+	if (cmd == PWM_3PH_START) {
+		if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+			retval = -EFAULT;
+		else
+			retval = pwm_3ph_start(dev, &cfg);
+		goto ioctl_done;
+	}
+
+	t = pwm_3ph_find(dev);
+	if (!t) {
+		retval = -ENODEV;
+		goto ioctl_done;
+	}
+
+	switch (cmd) {
+	case PWM_3PH_SET:
+		if (copy_from_user(&drive, (void __user *)arg, sizeof(drive)))
+			retval = -EFAULT;
+		else
+			retval = pwm_3ph_set(t, &drive);
+		break;
+
+	case PWM_3PH_STOP:
+		pwm_3ph_release(t);
+		break;
+
+	case PWM_3PH_STATUS:
+		pwm_3ph_status(t, &st);
+		if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+			retval = -EFAULT;
+		break;
+
+	default:
+		retval = -ENOTTY;
+	}
+
+      ioctl_done:
+	mutex_unlock(&pwm_3ph_lock);
+
+	return retval;
+}
+
+static struct pwm_ioctl_ext pwm_3ph_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_3PH_START),
+	.nr_last = _IOC_NR(PWM_3PH_STATUS),
+	.ioctl = pwm_3ph_ioctl,
+};
+
+static int __init pwm_3ph_init(void)
+{
+	return pwm_register_ioctl(&pwm_3ph_ext);
+}
+
+static void __exit pwm_3ph_exit(void)
+{
+	struct pwm_3ph *t, *next;
+
+	pwm_unregister_ioctl(&pwm_3ph_ext);
+
+	mutex_lock(&pwm_3ph_lock);
+	list_for_each_entry_safe(t, next, &pwm_3ph_list, list)
+		pwm_3ph_release(t);
+	mutex_unlock(&pwm_3ph_lock);
+}
+
+module_init(pwm_3ph_init);
+module_exit(pwm_3ph_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Three phase sine and space vector PWM on OMAP3 GP timers");
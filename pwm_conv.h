@@ -0,0 +1,98 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Frequency and duty cycle to timer register conversion of the driver.
+ Plain C so that host programs, tools/pwm_test.c among them, check the
+ same code pwm.c runs.
+
+ The timer counts from TLDR up to 0xFFFFFFFF and reloads, the output
+ toggles on the overflow and on the TMAR match.
+*/
+
+#ifndef PWM_CONV_H
+#define PWM_CONV_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint32_t u32;
+#endif
+
+#define PWM_CONV_DEFAULT_FREQUENCY	1024
+
+/*
+ * The frequency the timer really runs at for a requested one: even, at
+ * most half the input clock, the default for anything below 2 Hz.
+ */
+static inline int pwm_conv_frequency(u32 input_freq, int frequency)
+{
+	if (frequency < 0)
+		return PWM_CONV_DEFAULT_FREQUENCY;
+
+	/* only powers of two, for simplicity */
+	frequency &= ~0x01;
+
+	if (frequency > (int)(input_freq / 2))
+		frequency = input_freq / 2;
+	else if (frequency == 0)
+		frequency = PWM_CONV_DEFAULT_FREQUENCY;
+
+	return frequency;
+}
+
+/* PWM_FREQ = input_freq / ((0xFFFF FFFF - TLDR) + 1) */
+static inline u32 pwm_conv_tldr(u32 input_freq, int frequency)
+{
+	frequency = pwm_conv_frequency(input_freq, frequency);
+
+	return 0xFFFFFFFF - ((input_freq / frequency) - 1);
+}
+
+/*
+ * TMAR for a duty cycle in percent, at least one tick and at most the
+ * whole period. 0 for a zero duty, the channel is stopped then.
+ */
+static inline u32 pwm_conv_tmar(u32 tldr, int duty_cycle)
+{
+	u32 num_freqs = 0xFFFFFFFE - tldr;
+	u32 ticks;
+
+	if (duty_cycle == 0)
+		return 0;
+
+	ticks = (duty_cycle * num_freqs) / 100;
+
+	if (ticks < 1)
+		ticks = 1;
+	else if (ticks > num_freqs)
+		ticks = num_freqs;
+
+	return tldr + ticks;
+}
+
+#endif /* ifndef PWM_CONV_H */
@@ -0,0 +1,265 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Driver internals shared by pwm.c and the modules that build on it.
+ Nothing in here is visible to userspace, see pwm_ioctl.h for that.
+*/
+
+#ifndef PWM_CORE_H
+#define PWM_CORE_H
+
+#include <linux/cdev.h>
+#include <linux/hrtimer.h>
+#include <linux/list.h>
+#include <linux/semaphore.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+#include <asm/io.h>
+
+#include "pwm.h"
+
+/* default TCLR is off state, the engines start from it too */
+#define DEFAULT_TCLR (GPT_TCLR_PT | GPT_TCLR_TRG_OVFL_MATCH | GPT_TCLR_CE | GPT_TCLR_AR)
+
+struct pwm_dev;
+struct pwm_gpt_sim;
+
+/*
+ * All timer and PADCONF access goes through one of these. pwm.c has the
+ * OMAP3 one and a simulated one (sim=1) built on pwm_gpt_sim.h.
+ */
+struct pwm_reg_ops {
+	const char *name;
+	int (*map)(struct pwm_dev *dev);
+	void (*unmap)(struct pwm_dev *dev);
+	u32 (*read)(struct pwm_dev *dev, u32 reg);
+	void (*write)(struct pwm_dev *dev, u32 reg, u32 val);
+	int (*request_irq)(struct pwm_dev *dev);
+	void (*free_irq)(struct pwm_dev *dev);
+	int (*pad_map)(void);
+	void (*pad_unmap)(void);
+	u16 (*pad_read)(u32 offset);
+	void (*pad_write)(u32 offset, u16 val);
+};
+
+struct gpt {
+	u32 timer_num;
+	u32 mux_offset;
+	u16 mux_mode;
+	u32 gpt_base;
+	u32 clocks;
+	int irq;
+	u32 input_freq;
+	u32 old_mux;
+	u32 tldr;
+	u32 tmar;
+	u32 tclr;
+	u32 num_freqs;
+};
+
+/*
+ * What read() and the getters report. pwm.c republishes it from the
+ * register helpers, and modes that write the timer themselves call
+ * pwm_publish() once they have, so readers copy it under snap_seq
+ * without taking a lock.
+ */
+struct pwm_snap {
+	u32 tclr;
+	u32 tldr;
+	u32 tmar;
+	u32 num_freqs;
+	u32 input_freq;
+	int frequency;
+};
+
+struct pwm_file;
+
+/*
+ * A mode takes over the timer of a channel and is driven from its
+ * interrupt. Only one mode can own a channel at a time, and while it
+ * does the plain duty/frequency controls of /dev/pwmN return -EBUSY.
+ *
+ * irq() runs in hard interrupt context with dev->lock held, and the
+ * locks of the other channels given to pwm_mode_attach_locks(), and
+ * gets the TISR bits that fired. stop() is called on detach, with the
+ * interrupt already disabled, and may sleep. Both are optional, a mode
+ * timed by something else leaves irq and irq_events empty.
+ */
+struct pwm_mode {
+	const char *name;
+	u32 irq_events;		/* GPT_IRQ_* to enable */
+	void (*irq)(struct pwm_dev *dev, void *data, u32 status);
+	void (*stop)(struct pwm_dev *dev, void *data);
+};
+
+/*
+ * ioctl numbers above PWM_IOC_MAXNR are passed on to the module that
+ * registered the range. The handler runs in process context.
+ */
+struct pwm_ioctl_ext {
+	struct list_head list;
+	struct module *owner;
+	unsigned int nr_first;
+	unsigned int nr_last;
+	long (*ioctl)(struct pwm_dev *dev, unsigned int cmd,
+		      unsigned long arg);
+};
+
+/* log2 buckets of nanoseconds, bucket i counts [2^(i-1), 2^i) */
+#define PWM_HIST_BUCKETS	32
+
+struct pwm_hist {
+	u64 count;
+	u64 sum;
+	u64 max;
+	u64 bucket[PWM_HIST_BUCKETS];
+};
+
+/* one slot per core ioctl number, then the file operations */
+enum {
+	PWM_OP_READ = PWM_IOC_MAXNR + 1,
+	PWM_OP_WRITE,
+	PWM_OP_OPEN,
+	PWM_OP_NR
+};
+
+struct pwm_stats {
+	struct pwm_hist sem_wait;
+	struct pwm_hist reg_access;
+	struct pwm_hist request;
+	u64 ops[PWM_OP_NR];
+	u64 op_writes[PWM_OP_NR];	/* register writes done by each op */
+	u32 reg_writes;			/* running count of all writes */
+};
+
+struct pwm_dev {
+	struct cdev cdev;
+	struct device *device;
+	struct semaphore sem;
+	spinlock_t lock;	/* registers, gpt and mode, taken in irq context */
+	struct gpt gpt;
+	const struct pwm_reg_ops *ops;
+	void __iomem *base;
+	struct pwm_gpt_sim *sim;
+	spinlock_t sim_lock;
+	struct hrtimer sim_timer;	/* stands in for the irq line */
+	int sim_irq;
+	int frequency, duty_cycle;
+	/* a TMAR move pwm_update_tmar() could not make yet, under lock */
+	struct hrtimer tmar_timer;
+	u32 tmar_hw;		/* what the register has meanwhile */
+	int tmar_pending;
+	seqcount_t snap_seq;
+	struct pwm_snap snap;
+	/* sysfs_notify() for the attributes the snapshot changed */
+	struct work_struct notify_work;
+	unsigned long notify;	/* PWM_ATTR_* bits, under lock */
+	int notify_on;
+	struct pwm_file *writer;	/* PWM_CLAIM holder, under lock */
+	pid_t writer_tgid;		/* and its process */
+	struct list_head files;		/* every open pwm_file, under lock */
+	const struct pwm_mode *mode;
+	void *mode_data;
+	unsigned long mode_locks;	/* channel indexes irq() runs under */
+	const char *consumer;	/* in-kernel user, see pwm_channel_request() */
+	unsigned long group;	/* pwm.c channel indexes of the phase group */
+	u32 phase;		/* in PWM_PHASE_UNITS */
+	/* PWM_SCHED_*, under lock */
+	struct hrtimer sched_timer;	/* armed for the first entry */
+	struct list_head sched_queue;	/* by time */
+	unsigned int sched_pending;
+	u32 sched_id;
+	struct pwm_sched_done sched_done[PWM_SCHED_DONE_MAX];
+	unsigned int sched_head, sched_count;
+	u32 sched_lost;
+	/* PWM_STAMP_*, written from the irq under lock */
+	struct pwm_stamp_ring *stamp;	/* vmalloc_user(), mmap()ed */
+	u32 stamp_skip;			/* interrupts to the next record */
+	u32 stamp_tldr;			/* period the averages are for */
+	u64 stamp_period;		/* index of the last record */
+	u64 stamp_last;			/* and its time */
+	u64 stamp_base_period;		/* drift baseline */
+	u64 stamp_base;
+	s64 stamp_avg;			/* period, ns << 8 */
+	u64 stamp_dev;			/* mean |deviation|, ns << 4 */
+	spinlock_t stats_lock;
+	struct pwm_stats stats;
+	struct dentry *debugfs;
+};
+
+static inline u32 pwm_reg_read(struct pwm_dev *dev, u32 reg)
+{
+	return dev->ops->read(dev, reg);
+}
+
+static inline void pwm_reg_write(struct pwm_dev *dev, u32 reg, u32 val)
+{
+	dev->ops->write(dev, reg, val);
+	dev->stats.reg_writes++;
+}
+
+/*
+ * In-kernel consumer API. request/free may sleep, the rest only take
+ * the channel spinlock and can be called from any context, hard irq
+ * included. While a channel is requested /dev/pwmN can only read it.
+ */
+extern struct pwm_dev *pwm_get_dev(int timer_num);
+
+extern struct pwm_dev *pwm_channel_request(int timer_num, const char *label);
+extern void pwm_channel_free(struct pwm_dev *dev);
+extern int pwm_channel_config(struct pwm_dev *dev, int frequency,
+			      int duty_cycle);
+extern int pwm_channel_enable(struct pwm_dev *dev);
+extern int pwm_channel_disable(struct pwm_dev *dev);
+
+extern int pwm_mode_attach(struct pwm_dev *dev, const struct pwm_mode *mode,
+			   void *data);
+extern void pwm_mode_detach(struct pwm_dev *dev, const struct pwm_mode *mode);
+
+/*
+ * Modes that drive more than one channel lock them together, in
+ * channel index order like the phase groups. pwm_channel_bit() is a
+ * channel's bit in such a mask. A mode attached with the mask of its
+ * other channels gets their locks taken around irq() as well.
+ */
+extern unsigned long pwm_channel_bit(struct pwm_dev *dev);
+extern void pwm_lock_channels(unsigned long mask, unsigned long *flags);
+extern void pwm_unlock_channels(unsigned long mask, unsigned long flags);
+extern int pwm_mode_attach_locks(struct pwm_dev *dev,
+				 const struct pwm_mode *mode, void *data,
+				 unsigned long locks);
+/* refreshes dev->snap from dev->gpt, call with dev->lock held */
+extern void pwm_publish(struct pwm_dev *dev);
+extern int pwm_register_ioctl(struct pwm_ioctl_ext *ext);
+extern void pwm_unregister_ioctl(struct pwm_ioctl_ext *ext);
+
+/* pwm_pid.ko, feeds a PWM_PID_PUSHED loop on dev, any context */
+extern int pwm_pid_push(struct pwm_dev *dev, s32 value);
+
+#endif /* ifndef PWM_CORE_H */
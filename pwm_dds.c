@@ -0,0 +1,343 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Direct digital synthesis of tones. Every carrier period the overflow
+ interrupt steps a 32 bit phase accumulator per tone, looks the
+ waveforms up in pwm_wave.h and writes the sum as the next TMAR around
+ 50% duty. After an RC low pass on the pin that is the tone, with no
+ sample stream from userspace.
+
+ Controlled with the PWM_DDS_* ioctls on /dev/pwmN, see pwm_ioctl.h.
+*/
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/errno.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/uaccess.h>
+
+#include "pwm_core.h"
+#include "pwm_wave.h"
+
+struct pwm_dds_osc {
+	u32 phase;
+	u32 step;		/* phase per carrier period */
+	u32 amplitude;
+	u32 waveform;
+};
+
+struct pwm_dds {
+	struct list_head list;
+	struct pwm_dev *pwm;
+	struct pwm_dds_osc osc[PWM_DDS_TONES];
+	unsigned int count;
+	u32 period;		/* carrier, ticks */
+	u32 off;		/* TMAR - TLDR the timer has now */
+	u32 samples;
+	u32 late;
+};
+
+static LIST_HEAD(pwm_dds_list);
+static DEFINE_MUTEX(pwm_dds_lock);
+
+static u32 pwm_dds_next(struct pwm_dds *d)
+{
+	struct pwm_dds_osc *o;
+	s32 sum = 0;
+	u32 duty, off;
+	unsigned int i;
+
+	for (i = 0; i < d->count; i++) {
+		o = &d->osc[i];
+		o->phase += o->step;
+		sum += (pwm_wave_sample(o->waveform, o->phase)
+			* (s32)o->amplitude) >> 16;
+	}
+
+	duty = 0x8000 + clamp_t(s32, sum, -0x7FFF, 0x7FFF);
+	off = ((u64)d->period * duty) >> 16;
+
+	return clamp_t(u32, off, 1, d->period - 1);
+}
+
+static void pwm_dds_irq(struct pwm_dev *dev, void *data, u32 status)
+{
+	struct pwm_dds *d = data;
+	u32 now, off;
+
+	if (!(status & GPT_IRQ_OVF))
+		return;
+
+	off = pwm_dds_next(d);
+	d->samples++;
+
+	/* a sample the counter has already passed is dropped, not written */
+	now = pwm_reg_read(dev, GPT_TCRR) - dev->gpt.tldr;
+	if ((now < d->off) != (now < off)) {
+		d->late++;
+		return;
+	}
+
+	d->off = off;
+	dev->gpt.tmar = dev->gpt.tldr + off;
+	pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+}
+
+static void pwm_dds_stop(struct pwm_dev *dev, void *data)
+{
+	kfree(data);
+}
+
+static const struct pwm_mode pwm_dds_mode = {
+	.name = "dds",
+	.irq_events = GPT_IRQ_OVF,
+	.irq = pwm_dds_irq,
+	.stop = pwm_dds_stop,
+};
+
+static struct pwm_dds *pwm_dds_find(struct pwm_dev *dev)
+{
+	struct pwm_dds *d;
+
+	list_for_each_entry(d, &pwm_dds_list, list) {
+		if (d->pwm == dev)
+			return d;
+	}
+
+	return NULL;
+}
+
+/*
+ * Phase step for mhz at a carrier of input / period. Below Nyquist
+ * mhz * period < input * 500, so shifting by 30 cannot overflow, the
+ * last two bits of the step are dropped.
+ */
+static u32 pwm_dds_step(u32 input, u32 period, u32 mhz)
+{
+	return (u32)div64_u64(((u64)mhz * period) << 30,
+			      (u64)input * 1000) << 2;
+}
+
+static int pwm_dds_check(struct pwm_dev *dev, const struct pwm_dds_config *cfg,
+			 u32 period)
+{
+	const struct pwm_dds_tone *t;
+	unsigned int i;
+
+	if (cfg->count > PWM_DDS_TONES)
+		return -EINVAL;
+
+	for (i = 0; i < cfg->count; i++) {
+		t = &cfg->tone[i];
+
+		if (t->amplitude > PWM_DDS_AMPLITUDE_MAX
+		    || t->waveform > PWM_DDS_SAWTOOTH
+		    || (u64)t->frequency * period * 2
+		    >= (u64)dev->gpt.input_freq * 1000)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int pwm_dds_start(struct pwm_dev *dev, struct pwm_dds_config *cfg)
+{
+	struct pwm_dds_osc osc[PWM_DDS_TONES];
+	struct pwm_dds *d;
+	unsigned long flags;
+	u32 period;
+	unsigned int i;
+	int error, fresh = 0;
+
+	period = cfg->carrier ? dev->gpt.input_freq / cfg->carrier
+	    : 0xFFFFFFFF - dev->gpt.tldr + 1;
+	if (period < 4)
+		return -EINVAL;
+
+	error = pwm_dds_check(dev, cfg, period);
+	if (error)
+		return error;
+
+	d = pwm_dds_find(dev);
+	if (!d) {
+		d = kzalloc(sizeof(*d), GFP_KERNEL);
+		if (!d)
+			return -ENOMEM;
+
+		d->pwm = dev;
+
+		error = pwm_mode_attach(dev, &pwm_dds_mode, d);
+		if (error) {
+			kfree(d);
+			return error;
+		}
+
+		list_add(&d->list, &pwm_dds_list);
+		fresh = 1;
+	}
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	/* tones that keep running keep their phase */
+	for (i = 0; i < cfg->count; i++) {
+		osc[i].phase = !fresh && i < d->count ? d->osc[i].phase
+		    : cfg->tone[i].phase << 16;
+		osc[i].step = pwm_dds_step(dev->gpt.input_freq, period,
+					   cfg->tone[i].frequency);
+		osc[i].amplitude = cfg->tone[i].amplitude;
+		osc[i].waveform = cfg->tone[i].waveform;
+	}
+
+	memcpy(d->osc, osc, sizeof(osc));
+	d->count = cfg->count;
+
+	if (period != 0xFFFFFFFF - dev->gpt.tldr + 1
+	    || !(dev->gpt.tclr & GPT_TCLR_ST)) {
+		/* a new carrier restarts the timer, at 50% */
+		d->period = period;
+		d->off = period / 2;
+		dev->gpt.tldr = 0xFFFFFFFF - period + 1;
+		dev->gpt.num_freqs = 0xFFFFFFFE - dev->gpt.tldr;
+		dev->gpt.tmar = dev->gpt.tldr + d->off;
+		dev->frequency = dev->gpt.input_freq / period;
+		dev->gpt.tclr = DEFAULT_TCLR | (dev->gpt.tclr & GPT_TCLR_SCPWM);
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+		pwm_reg_write(dev, GPT_TLDR, dev->gpt.tldr);
+		pwm_reg_write(dev, GPT_TCRR, dev->gpt.tldr);
+		pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+		dev->gpt.tclr |= GPT_TCLR_ST;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+	} else if (fresh) {
+		d->period = period;
+		d->off = dev->gpt.tmar - dev->gpt.tldr;
+	}
+
+	/* the carrier, the samples themselves are not republished */
+	pwm_publish(dev);
+	pwm_reg_write(dev, GPT_TIER, GPT_IRQ_OVF);
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
+}
+
+static void pwm_dds_status(struct pwm_dds *d, struct pwm_dds_status *st)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&d->pwm->lock, flags);
+	st->carrier = d->pwm->gpt.input_freq / d->period;
+	st->samples = d->samples;
+	st->late = d->late;
+	spin_unlock_irqrestore(&d->pwm->lock, flags);
+}
+
+static void pwm_dds_release(struct pwm_dds *d)
+{
+	list_del(&d->list);
+	pwm_mode_detach(d->pwm, &pwm_dds_mode);
+}
+
+static long pwm_dds_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct pwm_dds_config cfg;
+	struct pwm_dds_status st;
+	struct pwm_dds *d;
+	long retval = 0;
+
+	mutex_lock(&pwm_dds_lock);
+
+	switch (cmd) {
+	case PWM_DDS_START:
+		if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+			retval = -EFAULT;
+		else
+			retval = pwm_dds_start(dev, &cfg);
+		break;
+
+	case PWM_DDS_STOP:
+		d = pwm_dds_find(dev);
+		if (!d)
+			retval = -ENODEV;
+		else
+			pwm_dds_release(d);
+		break;
+
+	case PWM_DDS_STATUS:
+		d = pwm_dds_find(dev);
+		if (!d) {
+			retval = -ENODEV;
+			break;
+		}
+
+		pwm_dds_status(d, &st);
+		if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+			retval = -EFAULT;
+		break;
+
+	default:
+		retval = -ENOTTY;
+	}
+
+	mutex_unlock(&pwm_dds_lock);
+
+	return retval;
+}
+
+static struct pwm_ioctl_ext pwm_dds_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_DDS_START),
+	.nr_last = _IOC_NR(PWM_DDS_STATUS),
+	.ioctl = pwm_dds_ioctl,
+};
+
+static int __init pwm_dds_init(void)
+{
+	return pwm_register_ioctl(&pwm_dds_ext);
+}
+
+static void __exit pwm_dds_exit(void)
+{
+	struct pwm_dds *d, *next;
+
+	pwm_unregister_ioctl(&pwm_dds_ext);
+
+	mutex_lock(&pwm_dds_lock);
+	list_for_each_entry_safe(d, next, &pwm_dds_list, list)
+		pwm_dds_release(d);
+	mutex_unlock(&pwm_dds_lock);
+}
+
+module_init(pwm_dds_init);
+module_exit(pwm_dds_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("DDS tone generator on OMAP3 GP timers");
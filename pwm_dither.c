@@ -0,0 +1,399 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Temporal duty dithering. At high carriers on the 32 kHz clock a period
+ is only a few ticks and the duty has as few steps. The overflow
+ interrupt runs a first order error accumulator that picks this period's
+ TMAR one tick up or down, so the average duty over a few periods
+ resolves far finer than a tick. Optionally the period is spread the
+ same way, TLDR for the next period moves around the nominal one, which
+ spreads the carrier harmonics for lower EMI peaks.
+
+ Controlled with the PWM_DITHER_* ioctls on /dev/pwmN, see pwm_ioctl.h.
+*/
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/errno.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/bitops.h>
+#include <linux/uaccess.h>
+
+#include "pwm_core.h"
+
+struct pwm_dither {
+	struct list_head list;
+	struct pwm_dev *pwm;
+	u32 duty;		/* 1/PWM_DITHER_ONE */
+	u32 spread;
+	u32 period;		/* nominal, ticks */
+	u32 cur;		/* period the counter is in */
+	u32 next;		/* loaded at the next overflow */
+	u32 tmar;		/* what the timer has */
+	s64 err;		/* wanted minus delivered on time, ticks << 16 */
+	u32 rand;
+	u64 sum_on, sum_period;	/* this window */
+	u32 window;
+	u32 achieved;
+	u32 min_period, max_period;
+	u32 periods;
+	u32 late;
+};
+
+static LIST_HEAD(pwm_dither_list);
+static DEFINE_MUTEX(pwm_dither_lock);
+
+static inline u32 pwm_dither_tldr(u32 period)
+{
+	return 0xFFFFFFFF - period + 1;
+}
+
+/* xorshift, only has to be cheap and evenly spread */
+static u32 pwm_dither_random(struct pwm_dither *d)
+{
+	d->rand ^= d->rand << 13;
+	d->rand ^= d->rand >> 17;
+	d->rand ^= d->rand << 5;
+
+	return d->rand;
+}
+
+/* on time for a period of len ticks, feeding back the error so far */
+static u32 pwm_dither_on(struct pwm_dither *d, u32 len)
+{
+	s64 want = ((u64)d->duty * len) + d->err;
+	u32 lo = 2 * d->spread + 1;
+	u32 on;
+
+	on = want <= 0 ? 0 : (u32)((want + 0x8000) >> 16);
+
+	return clamp_t(u32, on, lo, len - 1);
+}
+
+static void pwm_dither_account(struct pwm_dither *d, u32 len, u32 on)
+{
+	s64 limit = (s64)len << 16;
+
+	d->err += (s64)d->duty * len - ((s64)on << 16);
+	d->err = clamp_t(s64, d->err, -limit, limit);
+
+	d->sum_on += on;
+	d->sum_period += len;
+
+	if (++d->window == PWM_DITHER_WINDOW) {
+		d->achieved = (u32)min_t(u64, 0xFFFFFFFF,
+					 div64_u64(d->sum_on << 32,
+						   d->sum_period));
+		d->sum_on = 0;
+		d->sum_period = 0;
+		d->window = 0;
+	}
+
+	d->min_period = min(d->min_period, len);
+	d->max_period = max(d->max_period, len);
+}
+
+/*
+ * At the overflow the counter has just reloaded for the period in
+ * d->next. TMAR is only moved when the counter is before both the old
+ * and the new match, otherwise that period would see no match or two
+ * and the output would stay inverted. The clamp in pwm_dither_on()
+ * keeps the old match inside a shorter period.
+ */
+static void pwm_dither_irq(struct pwm_dev *dev, void *data, u32 status)
+{
+	struct pwm_dither *d = data;
+	u32 tldr, now, old, on;
+	s32 r;
+
+	if (!(status & GPT_IRQ_OVF))
+		return;
+
+	d->cur = d->next;
+	tldr = pwm_dither_tldr(d->cur);
+
+	now = pwm_reg_read(dev, GPT_TCRR) - tldr;
+	old = d->tmar - tldr;
+	on = pwm_dither_on(d, d->cur);
+
+	if (now < old && now < on) {
+		d->tmar = tldr + on;
+		pwm_reg_write(dev, GPT_TMAR, d->tmar);
+	} else if (on != old) {
+		on = old;
+		d->late++;
+	}
+
+	pwm_dither_account(d, d->cur, on);
+	d->periods++;
+
+	if (d->spread) {
+		r = (s32)(pwm_dither_random(d) % (2 * d->spread + 1))
+		    - (s32)d->spread;
+		d->next = d->period + r;
+		pwm_reg_write(dev, GPT_TLDR, pwm_dither_tldr(d->next));
+	} else if (d->next != d->period) {
+		d->next = d->period;
+		pwm_reg_write(dev, GPT_TLDR, pwm_dither_tldr(d->next));
+	}
+
+	dev->gpt.tmar = d->tmar;
+}
+
+static void pwm_dither_stop(struct pwm_dev *dev, void *data)
+{
+	kfree(data);
+}
+
+static const struct pwm_mode pwm_dither_mode = {
+	.name = "dither",
+	.irq_events = GPT_IRQ_OVF,
+	.irq = pwm_dither_irq,
+	.stop = pwm_dither_stop,
+};
+
+static struct pwm_dither *pwm_dither_find(struct pwm_dev *dev)
+{
+	struct pwm_dither *d;
+
+	list_for_each_entry(d, &pwm_dither_list, list) {
+		if (d->pwm == dev)
+			return d;
+	}
+
+	return NULL;
+}
+
+static void pwm_dither_reset_stats(struct pwm_dither *d)
+{
+	d->sum_on = 0;
+	d->sum_period = 0;
+	d->window = 0;
+	d->achieved = 0;
+	d->min_period = d->max_period = d->period;
+}
+
+static int pwm_dither_start(struct pwm_dev *dev,
+			    struct pwm_dither_config *cfg)
+{
+	struct pwm_dither *d;
+	unsigned long flags;
+	u32 period;
+	int error, fresh = 0;
+
+	period = cfg->carrier ? dev->gpt.input_freq / cfg->carrier
+	    : 0xFFFFFFFF - dev->gpt.tldr + 1;
+	if (period < 4 || cfg->duty > PWM_DITHER_ONE
+	    || cfg->spread > period / 8)
+		return -EINVAL;
+
+	/* on times outside the clamp of pwm_dither_on() cannot average out */
+	if ((u64)cfg->duty * period < (u64)(2 * cfg->spread + 1) << 16
+	    || (u64)cfg->duty * period > (u64)(period - 1) << 16)
+		return -EINVAL;
+
+	d = pwm_dither_find(dev);
+	if (!d) {
+		d = kzalloc(sizeof(*d), GFP_KERNEL);
+		if (!d)
+			return -ENOMEM;
+
+		d->pwm = dev;
+		d->rand = 0x2545F491;
+
+		error = pwm_mode_attach(dev, &pwm_dither_mode, d);
+		if (error) {
+			kfree(d);
+			return error;
+		}
+
+		list_add(&d->list, &pwm_dither_list);
+		fresh = 1;
+	}
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	d->duty = cfg->duty;
+	d->spread = cfg->spread;
+
+	if (period != 0xFFFFFFFF - dev->gpt.tldr + 1
+	    || !(dev->gpt.tclr & GPT_TCLR_ST)) {
+		/* a new carrier restarts the timer */
+		d->period = d->cur = d->next = period;
+		d->err = 0;
+		dev->gpt.tldr = pwm_dither_tldr(period);
+		dev->gpt.num_freqs = 0xFFFFFFFE - dev->gpt.tldr;
+		d->tmar = dev->gpt.tldr + pwm_dither_on(d, period);
+		dev->gpt.tmar = d->tmar;
+		dev->frequency = dev->gpt.input_freq / period;
+		dev->gpt.tclr = DEFAULT_TCLR | (dev->gpt.tclr & GPT_TCLR_SCPWM);
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+		pwm_reg_write(dev, GPT_TLDR, dev->gpt.tldr);
+		pwm_reg_write(dev, GPT_TCRR, dev->gpt.tldr);
+		pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+		dev->gpt.tclr |= GPT_TCLR_ST;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+		pwm_dither_reset_stats(d);
+	} else if (fresh) {
+		d->period = d->cur = d->next = period;
+		d->tmar = dev->gpt.tmar;
+		pwm_dither_reset_stats(d);
+	}
+
+	/* readers see the nominal duty, not each dithered period */
+	pwm_publish(dev);
+	pwm_reg_write(dev, GPT_TIER, GPT_IRQ_OVF);
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
+}
+
+/* log2(x) in 1/256 bit, the mantissa taken as linear, x > 0 */
+static u32 pwm_dither_log2(u32 x)
+{
+	u32 bit = fls(x) - 1;
+	u32 frac = bit >= 8 ? x >> (bit - 8) : x << (8 - bit);
+
+	return (bit << 8) | (frac & 0xFF);
+}
+
+static void pwm_dither_status(struct pwm_dither *d,
+			      struct pwm_dither_status *st)
+{
+	unsigned long flags;
+	u64 want, off;
+
+	spin_lock_irqsave(&d->pwm->lock, flags);
+	st->carrier = d->pwm->gpt.input_freq / d->period;
+	st->period = d->period;
+	st->duty = d->duty;
+	st->achieved = d->achieved;
+	st->min_period = d->min_period;
+	st->max_period = d->max_period;
+	st->periods = d->periods;
+	st->late = d->late;
+	spin_unlock_irqrestore(&d->pwm->lock, flags);
+
+	/* how many bits of the fraction the last window got right */
+	want = (u64)st->duty << 16;
+	off = want > st->achieved ? want - st->achieved : st->achieved - want;
+
+	if (st->periods < PWM_DITHER_WINDOW)
+		st->bits = 0;
+	else if (off == 0)
+		st->bits = 32 << 8;
+	else
+		st->bits = (32 << 8) - pwm_dither_log2((u32)min_t(u64, off,
+								  0xFFFFFFFF));
+}
+
+static void pwm_dither_release(struct pwm_dither *d)
+{
+	list_del(&d->list);
+	pwm_mode_detach(d->pwm, &pwm_dither_mode);
+}
+
+static long pwm_dither_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			     unsigned long arg)
+{
+	struct pwm_dither_config cfg;
+	struct pwm_dither_status st;
+	struct pwm_dither *d;
+	long retval = 0;
+
+	mutex_lock(&pwm_dither_lock);
+
+	switch (cmd) {
+	case PWM_DITHER_START:
+		if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+			retval = -EFAULT;
+		else
+			retval = pwm_dither_start(dev, &cfg);
+		break;
+
+	case PWM_DITHER_STOP:
+		d = pwm_dither_find(dev);
+		if (!d)
+			retval = -ENODEV;
+		else
+			pwm_dither_release(d);
+		break;
+
+	case PWM_DITHER_STATUS:
+		d = pwm_dither_find(dev);
+		if (!d) {
+			retval = -ENODEV;
+			break;
+		}
+
+		pwm_dither_status(d, &st);
+		if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+			retval = -EFAULT;
+		break;
+
+	default:
+		retval = -ENOTTY;
+	}
+
+	mutex_unlock(&pwm_dither_lock);
+
+	return retval;
+}
+
+static struct pwm_ioctl_ext pwm_dither_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_DITHER_START),
+	.nr_last = _IOC_NR(PWM_DITHER_STATUS),
+	.ioctl = pwm_dither_ioctl,
+};
+
+static int __init pwm_dither_init(void)
+{
+	return pwm_register_ioctl(&pwm_dither_ext);
+}
+
+static void __exit pwm_dither_exit(void)
+{
+	struct pwm_dither *d, *next;
+
+	pwm_unregister_ioctl(&pwm_dither_ext);
+
+	mutex_lock(&pwm_dither_lock);
+	list_for_each_entry_safe(d, next, &pwm_dither_list, list)
+		pwm_dither_release(d);
+	mutex_unlock(&pwm_dither_lock);
+}
+
+module_init(pwm_dither_init);
+module_exit(pwm_dither_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Duty dithering and spread spectrum on OMAP3 GP timers");
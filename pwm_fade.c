@@ -0,0 +1,487 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Hardware timed LED fades. Once per PWM period the overflow interrupt
+ moves the brightness one step along a ramp and writes the matching
+ duty to TMAR, so a fade costs one ioctl instead of one write per step.
+
+ The brightness to duty mapping is a table with linear interpolation,
+ either a straight line, gamma 2.2 or one supplied by the caller.
+
+ Controlled with the PWM_FADE_* ioctls on /dev/pwmN, see pwm_ioctl.h.
+*/
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/errno.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/uaccess.h>
+
+#include "pwm_core.h"
+
+/* (i / 64)^2.2, i = 0 to 64 */
+static const u16 pwm_fade_gamma[65] = {
+	    0,     7,    32,    78,   147,   240,   359,   504,
+	  676,   875,  1104,  1361,  1648,  1966,  2314,  2693,
+	 3104,  3547,  4022,  4530,  5072,  5646,  6255,  6897,
+	 7574,  8286,  9033,  9815, 10632, 11486, 12375, 13301,
+	14263, 15262, 16298, 17371, 18482, 19630, 20816, 22040,
+	23303, 24604, 25943, 27322, 28739, 30196, 31692, 33227,
+	34802, 36417, 38072, 39768, 41503, 43280, 45097, 46954,
+	48853, 50793, 52774, 54796, 56860, 58966, 61114, 63303,
+	65535,
+};
+
+static const u16 pwm_fade_linear[2] = { 0, PWM_FADE_MAX };
+
+struct pwm_fade {
+	struct list_head list;
+	struct pwm_dev *pwm;
+	u16 table[PWM_FADE_TABLE_MAX];
+	unsigned int table_len;
+
+	/* brightness << 16, moved by delta once per period */
+	s64 level;
+	s64 delta;
+	u32 start;
+	u32 target;
+	u32 steps;
+	u32 remaining;
+	u32 flags;
+	u32 ramps;		/* ramps left when breathing, 0 for no limit */
+
+	u32 off;		/* TMAR - TLDR the timer has now */
+	u32 next_off;
+	int pending;		/* next_off could not be written yet */
+};
+
+static LIST_HEAD(pwm_fade_list);
+static DEFINE_MUTEX(pwm_fade_lock);
+
+static u32 pwm_fade_duty(const struct pwm_fade *f, u32 level)
+{
+	u32 pos = level * (f->table_len - 1);
+	u32 i = pos / PWM_FADE_MAX;
+	u32 frac = pos % PWM_FADE_MAX;
+	u32 a, b;
+
+	if (i >= f->table_len - 1)
+		return f->table[f->table_len - 1];
+
+	a = f->table[i];
+	b = f->table[i + 1];
+
+	if (b >= a)
+		return a + (b - a) * frac / PWM_FADE_MAX;
+
+	return a - (a - b) * frac / PWM_FADE_MAX;
+}
+
+/* inverse of pwm_fade_duty(), for picking up an output that is running */
+static u32 pwm_fade_level(const struct pwm_fade *f, u32 duty)
+{
+	unsigned int i;
+	u32 a, b;
+
+	for (i = 0; i < f->table_len - 1; i++) {
+		a = f->table[i];
+		b = f->table[i + 1];
+
+		if ((duty >= a && duty <= b) || (duty <= a && duty >= b))
+			break;
+	}
+
+	if (i == f->table_len - 1)
+		return duty > f->table[0] ? PWM_FADE_MAX : 0;
+
+	if (a == b)
+		return div_u64((u64)i * PWM_FADE_MAX, f->table_len - 1);
+
+	return div_u64(((u64)i * (a > b ? a - b : b - a)
+			+ (a > b ? a - duty : duty - a)) * PWM_FADE_MAX,
+		       (u64)(f->table_len - 1) * (a > b ? a - b : b - a));
+}
+
+static u32 pwm_fade_ticks(struct pwm_dev *dev, const struct pwm_fade *f,
+			  u32 level)
+{
+	u32 off = ((u64)pwm_fade_duty(f, level) * dev->gpt.num_freqs) >> 16;
+
+	/* a match on the reload tick is not seen, keep at least one */
+	return off ? off : 1;
+}
+
+/*
+ * The output toggles on overflow and on match. If the counter is already
+ * past one of the old and new match values but not the other, writing
+ * TMAR now would lose or double the toggle and invert the output, so the
+ * write waits for the next overflow.
+ */
+static void pwm_fade_write(struct pwm_dev *dev, struct pwm_fade *f)
+{
+	u32 now = pwm_reg_read(dev, GPT_TCRR) - dev->gpt.tldr;
+
+	if ((now < f->off) != (now < f->next_off)) {
+		f->pending = 1;
+		return;
+	}
+
+	f->off = f->next_off;
+	f->pending = 0;
+	dev->gpt.tmar = dev->gpt.tldr + f->off;
+	pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+	pwm_publish(dev);
+}
+
+static void pwm_fade_ramp_end(struct pwm_fade *f)
+{
+	u32 tmp;
+
+	if (!(f->flags & PWM_FADE_BREATHE))
+		return;
+
+	if (f->ramps && --f->ramps == 0)
+		return;
+
+	tmp = f->start;
+	f->start = f->target;
+	f->target = tmp;
+	f->delta = -f->delta;
+	f->remaining = f->steps;
+}
+
+static void pwm_fade_irq(struct pwm_dev *dev, void *data, u32 status)
+{
+	struct pwm_fade *f = data;
+
+	if (!(status & GPT_IRQ_OVF))
+		return;
+
+	if (f->pending) {
+		pwm_fade_write(dev, f);
+	} else if (f->remaining) {
+		f->remaining--;
+
+		if (f->remaining)
+			f->level += f->delta;
+		else
+			f->level = (s64)f->target << 16;
+
+		f->next_off = pwm_fade_ticks(dev, f, f->level >> 16);
+		pwm_fade_write(dev, f);
+
+		if (!f->remaining)
+			pwm_fade_ramp_end(f);
+	}
+
+	if (f->remaining || f->pending)
+		return;
+
+	/* done, no more interrupts until the next PWM_FADE_START */
+	pwm_reg_write(dev, GPT_TIER, 0);
+
+	if (f->level == 0) {
+		dev->gpt.tclr &= ~GPT_TCLR_ST;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+		pwm_publish(dev);
+	}
+}
+
+static void pwm_fade_stop(struct pwm_dev *dev, void *data)
+{
+	kfree(data);
+}
+
+static const struct pwm_mode pwm_fade_mode = {
+	.name = "fade",
+	.irq_events = GPT_IRQ_OVF,
+	.irq = pwm_fade_irq,
+	.stop = pwm_fade_stop,
+};
+
+static struct pwm_fade *pwm_fade_find(struct pwm_dev *dev)
+{
+	struct pwm_fade *f;
+
+	list_for_each_entry(f, &pwm_fade_list, list) {
+		if (f->pwm == dev)
+			return f;
+	}
+
+	return NULL;
+}
+
+/* loads the curve, returns the number of points or a negative error */
+static int pwm_fade_load_curve(u16 *table, const struct pwm_fade_config *cfg)
+{
+	const u16 *src;
+	unsigned int len;
+
+	switch (cfg->curve) {
+	case PWM_FADE_LINEAR:
+		src = pwm_fade_linear;
+		len = ARRAY_SIZE(pwm_fade_linear);
+		break;
+
+	case PWM_FADE_GAMMA:
+		src = pwm_fade_gamma;
+		len = ARRAY_SIZE(pwm_fade_gamma);
+		break;
+
+	case PWM_FADE_TABLE:
+		if (cfg->table_len < 2 || cfg->table_len > PWM_FADE_TABLE_MAX)
+			return -EINVAL;
+		src = cfg->table;
+		len = cfg->table_len;
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	memcpy(table, src, len * sizeof(*table));
+
+	return len;
+}
+
+static int pwm_fade_start(struct pwm_dev *dev, struct pwm_fade_config *cfg)
+{
+	struct pwm_fade *f;
+	unsigned long flags;
+	u16 *table;
+	u32 period = 0;
+	u32 freq, start, duty;
+	u64 steps;
+	int len, error;
+	int fresh = 0;
+
+	if (cfg->target > PWM_FADE_MAX
+	    || (cfg->start > PWM_FADE_MAX && cfg->start != PWM_FADE_CURRENT))
+		return -EINVAL;
+
+	if (cfg->frequency) {
+		period = dev->gpt.input_freq / cfg->frequency;
+		if (period < 2)
+			return -EINVAL;
+	}
+
+	table = kmalloc(PWM_FADE_TABLE_MAX * sizeof(*table), GFP_KERNEL);
+	if (!table)
+		return -ENOMEM;
+
+	len = pwm_fade_load_curve(table, cfg);
+	if (len < 0) {
+		error = len;
+		goto start_done;
+	}
+
+	f = pwm_fade_find(dev);
+	if (!f) {
+		f = kzalloc(sizeof(*f), GFP_KERNEL);
+		if (!f) {
+			error = -ENOMEM;
+			goto start_done;
+		}
+
+		f->pwm = dev;
+
+		error = pwm_mode_attach(dev, &pwm_fade_mode, f);
+		if (error) {
+			kfree(f);
+			goto start_done;
+		}
+
+		list_add(&f->list, &pwm_fade_list);
+		fresh = 1;
+	}
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	if (period && period != 0xFFFFFFFF - dev->gpt.tldr + 1) {
+		/* a new period restarts the timer */
+		dev->gpt.tclr &= ~GPT_TCLR_ST;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+		dev->gpt.tldr = 0xFFFFFFFF - period + 1;
+		dev->gpt.num_freqs = 0xFFFFFFFE - dev->gpt.tldr;
+		dev->frequency = dev->gpt.input_freq / period;
+		pwm_reg_write(dev, GPT_TLDR, dev->gpt.tldr);
+	}
+
+	freq = dev->gpt.input_freq / (0xFFFFFFFF - dev->gpt.tldr + 1);
+	steps = div_u64((u64)cfg->duration_ms * freq, 1000);
+	if (steps < 1)
+		steps = 1;
+	else if (steps > U32_MAX)
+		steps = U32_MAX;
+
+	memcpy(f->table, table, len * sizeof(*table));
+	f->table_len = len;
+
+	if (fresh && (dev->gpt.tclr & GPT_TCLR_ST)) {
+		/* first fade on a running output, pick up its duty */
+		f->off = dev->gpt.tmar - dev->gpt.tldr;
+		duty = div_u64((u64)f->off << 16, dev->gpt.num_freqs);
+		f->level = (s64)pwm_fade_level(f, min_t(u32, duty, PWM_FADE_MAX)) << 16;
+	}
+
+	start = cfg->start == PWM_FADE_CURRENT ? f->level >> 16 : cfg->start;
+	f->start = start;
+	f->target = cfg->target;
+	f->level = (s64)start << 16;
+	f->steps = steps;
+	f->remaining = steps;
+	f->delta = div_s64(((s64)cfg->target - start) << 16, steps);
+	f->flags = cfg->flags;
+	/* two ramps a cycle, clamped so the count cannot wrap to 0 */
+	f->ramps = min_t(u32, cfg->cycles, U32_MAX / 2) * 2;
+
+	if (!(dev->gpt.tclr & GPT_TCLR_ST)) {
+		f->off = pwm_fade_ticks(dev, f, start);
+		f->pending = 0;
+		dev->gpt.tmar = dev->gpt.tldr + f->off;
+		dev->gpt.tclr = DEFAULT_TCLR | (dev->gpt.tclr & GPT_TCLR_SCPWM);
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+		pwm_reg_write(dev, GPT_TLDR, dev->gpt.tldr);
+		pwm_reg_write(dev, GPT_TCRR, dev->gpt.tldr);
+		pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+		dev->gpt.tclr |= GPT_TCLR_ST;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+	}
+
+	pwm_publish(dev);
+	pwm_reg_write(dev, GPT_TIER, GPT_IRQ_OVF);
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	error = 0;
+
+      start_done:
+	kfree(table);
+
+	return error;
+}
+
+static void pwm_fade_status(struct pwm_fade *f, struct pwm_fade_status *st)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&f->pwm->lock, flags);
+	st->level = f->level >> 16;
+	st->remaining = f->remaining;
+	st->cycles = (f->ramps + 1) / 2;
+	spin_unlock_irqrestore(&f->pwm->lock, flags);
+}
+
+static void pwm_fade_release(struct pwm_fade *f)
+{
+	list_del(&f->list);
+	pwm_mode_detach(f->pwm, &pwm_fade_mode);
+}
+
+static long pwm_fade_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct pwm_fade_config *cfg;
+	struct pwm_fade_status st;
+	struct pwm_fade *f;
+	long retval = 0;
+
+	mutex_lock(&pwm_fade_lock);
+
+	switch (cmd) {
+	case PWM_FADE_START:
+		cfg = kmalloc(sizeof(*cfg), GFP_KERNEL);
+		if (!cfg)
+			retval = -ENOMEM;
+		else if (copy_from_user(cfg, (void __user *)arg, sizeof(*cfg)))
+			retval = -EFAULT;
+		else
+			retval = pwm_fade_start(dev, cfg);
+		kfree(cfg);
+		break;
+
+	case PWM_FADE_STOP:
+		f = pwm_fade_find(dev);
+		if (!f)
+			retval = -ENODEV;
+		else
+			pwm_fade_release(f);
+		break;
+
+	case PWM_FADE_STATUS:
+		f = pwm_fade_find(dev);
+		if (!f) {
+			retval = -ENODEV;
+			break;
+		}
+
+		pwm_fade_status(f, &st);
+		if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+			retval = -EFAULT;
+		break;
+
+	default:
+		retval = -ENOTTY;
+	}
+
+	mutex_unlock(&pwm_fade_lock);
+
+	return retval;
+}
+
+static struct pwm_ioctl_ext pwm_fade_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_FADE_START),
+	.nr_last = _IOC_NR(PWM_FADE_STATUS),
+	.ioctl = pwm_fade_ioctl,
+};
+
+static int __init pwm_fade_init(void)
+{
+	return pwm_register_ioctl(&pwm_fade_ext);
+}
+
+static void __exit pwm_fade_exit(void)
+{
+	struct pwm_fade *f, *next;
+
+	pwm_unregister_ioctl(&pwm_fade_ext);
+
+	mutex_lock(&pwm_fade_lock);
+	list_for_each_entry_safe(f, next, &pwm_fade_list, list)
+		pwm_fade_release(f);
+	mutex_unlock(&pwm_fade_lock);
+}
+
+module_init(pwm_fade_init);
+module_exit(pwm_fade_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Hardware timed LED fades on the OMAP3 GP timers");
@@ -0,0 +1,449 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Software model of an OMAP3 GP timer, used by the sim=1 backend of pwm.c
+ so the driver can run, and be timed, on machines without the hardware.
+ Plain C so that host programs can use it as well.
+
+ Modelled: TCRR counting from the functional clock and the prescaler,
+ auto-reload from TLDR, TTGR triggers, compare against TMAR, TISR flags,
+ posted writes with their TWPS pending bits, and the PWM_EVT output in
+ toggle and pulse modes. Time is passed in by the caller in ns.
+*/
+
+#ifndef PWM_GPT_SIM_H
+#define PWM_GPT_SIM_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+#define pwm_sim_div(a, b)	div64_u64(a, b)
+#else
+#include <stdint.h>
+#include <string.h>
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+#define pwm_sim_div(a, b)	((a) / (b))
+#endif
+
+#include "pwm.h"
+
+#define PWM_SIM_NREGS		(GPT_TOWR / 4 + 1)
+
+/* functional clocks a posted write takes to land */
+#define PWM_SIM_POSTED_CLKS	3
+
+/* the five posted registers, in TWPS bit order */
+#define PWM_SIM_NPOSTED		5
+
+#define NSEC_PER_SEC_U64	1000000000ULL
+
+struct pwm_gpt_sim {
+	u32 reg[PWM_SIM_NREGS];
+	u32 clk_hz;
+	u64 now;		/* ns the model has been run up to */
+	u64 clk_rem;		/* ns * clk_hz not yet a whole clock */
+	u32 presc_count;	/* clocks towards the next prescaled tick */
+
+	u32 posted_val[PWM_SIM_NPOSTED];
+	u64 posted_at[PWM_SIM_NPOSTED];
+	u32 posted_overruns;	/* writes to a register still pending */
+
+	int out;		/* PWM_EVT level */
+	u64 edges;
+	u64 last_edge_ns;
+	u64 overflows;
+	u64 matches;
+};
+
+static inline int pwm_gpt_sim_posted_index(u32 reg)
+{
+	switch (reg) {
+	case GPT_TCLR:
+		return 0;
+	case GPT_TCRR:
+		return 1;
+	case GPT_TLDR:
+		return 2;
+	case GPT_TTGR:
+		return 3;
+	case GPT_TMAR:
+		return 4;
+	}
+
+	return -1;
+}
+
+static inline u32 *pwm_gpt_sim_r(struct pwm_gpt_sim *s, u32 reg)
+{
+	return &s->reg[reg / 4];
+}
+
+static inline void pwm_gpt_sim_reset(struct pwm_gpt_sim *s)
+{
+	memset(s->reg, 0, sizeof(s->reg));
+	memset(s->posted_at, 0, sizeof(s->posted_at));
+	*pwm_gpt_sim_r(s, GPT_TISTAT) = 1;	/* reset done */
+	s->presc_count = 0;
+	s->out = 0;
+}
+
+static inline void pwm_gpt_sim_init(struct pwm_gpt_sim *s, u32 clk_hz,
+				    u64 now)
+{
+	memset(s, 0, sizeof(*s));
+	s->clk_hz = clk_hz;
+	s->now = now;
+	pwm_gpt_sim_reset(s);
+}
+
+/* counter increments per functional clock, as a divider */
+static inline u32 pwm_gpt_sim_div(struct pwm_gpt_sim *s)
+{
+	u32 tclr = *pwm_gpt_sim_r(s, GPT_TCLR);
+
+	if (!(tclr & GPT_TCLR_PRE))
+		return 1;
+
+	return 2 << ((tclr & GPT_TCLR_PTV_MASK) >> 2);
+}
+
+static inline u32 pwm_gpt_sim_toggles(u32 tclr, int match)
+{
+	u32 trg = tclr & GPT_TCLR_TRG_MASK;
+
+	if (trg == GPT_TCLR_TRG_OVFL_MATCH)
+		return 1;
+
+	return trg == GPT_TCLR_TRG_OVFL && !match;
+}
+
+static inline void pwm_gpt_sim_output(struct pwm_gpt_sim *s, int match,
+				      u64 ns)
+{
+	u32 tclr = *pwm_gpt_sim_r(s, GPT_TCLR);
+
+	if (!pwm_gpt_sim_toggles(tclr, match))
+		return;
+
+	if (tclr & GPT_TCLR_PT) {
+		s->out ^= 1;
+		s->edges++;
+	} else {
+		/* one clock wide pulse */
+		s->edges += 2;
+	}
+
+	s->last_edge_ns = ns;
+}
+
+/* ns from s->now until 'ticks' more counter increments have happened */
+static inline u64 pwm_gpt_sim_ticks_ns(struct pwm_gpt_sim *s, u64 ticks)
+{
+	u64 clks = ticks * pwm_gpt_sim_div(s) - s->presc_count;
+	u64 scaled = clks * NSEC_PER_SEC_U64 - s->clk_rem;
+
+	return pwm_sim_div(scaled + s->clk_hz - 1, s->clk_hz);
+}
+
+/* apply 'ticks' counter increments, starting at time 'ns' */
+static inline void pwm_gpt_sim_count(struct pwm_gpt_sim *s, u64 ticks, u64 ns)
+{
+	u32 *tcrr = pwm_gpt_sim_r(s, GPT_TCRR);
+	u32 *tclr = pwm_gpt_sim_r(s, GPT_TCLR);
+	u32 tldr = *pwm_gpt_sim_r(s, GPT_TLDR);
+	u32 tmar = *pwm_gpt_sim_r(s, GPT_TMAR);
+	u32 *tisr = pwm_gpt_sim_r(s, GPT_TISR);
+	u64 to_ovf, to_mat, period, n, done = 0;
+	u32 toggles;
+
+	while (ticks && (*tclr & GPT_TCLR_ST)) {
+		to_ovf = 0x100000000ULL - *tcrr;
+		to_mat = (u32) (tmar - *tcrr);
+
+		if ((*tclr & GPT_TCLR_CE) && to_mat && to_mat < to_ovf
+		    && to_mat <= ticks) {
+			*tcrr += to_mat;
+			ticks -= to_mat;
+			done += to_mat;
+			*tisr |= GPT_IRQ_MAT;
+			s->matches++;
+			pwm_gpt_sim_output(s, 1, ns + pwm_gpt_sim_ticks_ns(s, done));
+			continue;
+		}
+
+		if (to_ovf > ticks) {
+			*tcrr += ticks;
+			break;
+		}
+
+		ticks -= to_ovf;
+		done += to_ovf;
+		*tisr |= GPT_IRQ_OVF;
+		s->overflows++;
+		pwm_gpt_sim_output(s, 0, ns + pwm_gpt_sim_ticks_ns(s, done));
+
+		if (!(*tclr & GPT_TCLR_AR)) {
+			*tcrr = 0;
+			*tclr &= ~GPT_TCLR_ST;
+			break;
+		}
+
+		/* a match on the reload tick is not seen */
+		*tcrr = tldr;
+
+		/* skip whole periods, they all look the same */
+		period = 0x100000000ULL - tldr;
+		if (ticks < period)
+			continue;
+
+		n = pwm_sim_div(ticks, period);
+		ticks -= n * period;
+		done += n * period;
+		s->overflows += n;
+		*tisr |= GPT_IRQ_OVF;
+		toggles = pwm_gpt_sim_toggles(*tclr, 0);
+
+		if ((*tclr & GPT_TCLR_CE) && tmar > tldr) {
+			s->matches += n;
+			*tisr |= GPT_IRQ_MAT;
+			toggles += pwm_gpt_sim_toggles(*tclr, 1);
+		}
+
+		if (toggles) {
+			if (*tclr & GPT_TCLR_PT) {
+				s->edges += n * toggles;
+				s->out ^= (n * toggles) & 1;
+			} else {
+				s->edges += 2 * n * toggles;
+			}
+			s->last_edge_ns = ns + pwm_gpt_sim_ticks_ns(s, done);
+		}
+	}
+}
+
+/* run the functional clock from s->now to 'now' */
+static inline void pwm_gpt_sim_run(struct pwm_gpt_sim *s, u64 now)
+{
+	u64 elapsed, clks, ticks, start, step;
+	u32 div;
+
+	while (now > s->now) {
+		/* at most a second at a time so the products fit in 64 bits */
+		step = now - s->now;
+		if (step > NSEC_PER_SEC_U64)
+			step = NSEC_PER_SEC_U64;
+
+		start = s->now;
+		elapsed = step * s->clk_hz + s->clk_rem;
+		clks = pwm_sim_div(elapsed, NSEC_PER_SEC_U64);
+		s->clk_rem = elapsed - clks * NSEC_PER_SEC_U64;
+		s->now += step;
+
+		if (!(*pwm_gpt_sim_r(s, GPT_TCLR) & GPT_TCLR_ST))
+			continue;
+
+		div = pwm_gpt_sim_div(s);
+		clks += s->presc_count;
+		ticks = pwm_sim_div(clks, div);
+		s->presc_count = clks - ticks * div;
+
+		pwm_gpt_sim_count(s, ticks, start);
+	}
+}
+
+static inline void pwm_gpt_sim_apply(struct pwm_gpt_sim *s, u32 reg, u32 val)
+{
+	u32 *r = pwm_gpt_sim_r(s, reg);
+	u32 old;
+
+	switch (reg) {
+	case GPT_TCLR:
+		old = *r;
+		*r = val;
+
+		if ((old & GPT_TCLR_ST) && !(val & GPT_TCLR_ST))
+			s->presc_count = 0;
+
+		/* while the output is not being driven SCPWM sets it */
+		if (!(val & GPT_TCLR_ST) || !(val & GPT_TCLR_TRG_MASK))
+			s->out = !!(val & GPT_TCLR_SCPWM);
+		break;
+
+	case GPT_TTGR:
+		*pwm_gpt_sim_r(s, GPT_TCRR) = *pwm_gpt_sim_r(s, GPT_TLDR);
+		s->presc_count = 0;
+		break;
+
+	case GPT_TISR:
+		*r &= ~val;
+		break;
+
+	case GPT_TIOCP_CFG:
+		if (val & (1 << 1)) {
+			pwm_gpt_sim_reset(s);
+			break;
+		}
+		*r = val;
+		break;
+
+	case GPT_TSICR:
+		if (val & GPT_TSICR_SFT) {
+			pwm_gpt_sim_reset(s);
+			break;
+		}
+		*r = val;
+		break;
+
+	case GPT_TISTAT:
+	case GPT_TWPS:
+	case GPT_TCAR1:
+	case GPT_TCAR2:
+		break;		/* read only */
+
+	default:
+		*r = val;
+	}
+}
+
+/* the earliest posted write still in flight, -1 if none */
+static inline int pwm_gpt_sim_next_posted(struct pwm_gpt_sim *s)
+{
+	int i, next = -1;
+
+	for (i = 0; i < PWM_SIM_NPOSTED; i++) {
+		if (s->posted_at[i]
+		    && (next < 0 || s->posted_at[i] < s->posted_at[next]))
+			next = i;
+	}
+
+	return next;
+}
+
+/* bring the model up to 'now', landing posted writes on the way */
+static inline void pwm_gpt_sim_advance(struct pwm_gpt_sim *s, u64 now)
+{
+	static const u32 posted_regs[PWM_SIM_NPOSTED] = {
+		GPT_TCLR, GPT_TCRR, GPT_TLDR, GPT_TTGR, GPT_TMAR
+	};
+	int i;
+
+	while ((i = pwm_gpt_sim_next_posted(s)) >= 0 && s->posted_at[i] <= now) {
+		pwm_gpt_sim_run(s, s->posted_at[i]);
+		s->posted_at[i] = 0;
+		*pwm_gpt_sim_r(s, GPT_TWPS) &= ~(1 << i);
+		pwm_gpt_sim_apply(s, posted_regs[i], s->posted_val[i]);
+	}
+
+	pwm_gpt_sim_run(s, now);
+}
+
+static inline u32 pwm_gpt_sim_read(struct pwm_gpt_sim *s, u32 reg, u64 now)
+{
+	if (reg / 4 >= PWM_SIM_NREGS)
+		return 0;
+
+	pwm_gpt_sim_advance(s, now);
+
+	return *pwm_gpt_sim_r(s, reg);
+}
+
+static inline void pwm_gpt_sim_write(struct pwm_gpt_sim *s, u32 reg, u32 val,
+				     u64 now)
+{
+	int i = pwm_gpt_sim_posted_index(reg);
+
+	if (reg / 4 >= PWM_SIM_NREGS)
+		return;
+
+	pwm_gpt_sim_advance(s, now);
+
+	if (i < 0 || !(*pwm_gpt_sim_r(s, GPT_TSICR) & GPT_TSICR_POSTED)) {
+		pwm_gpt_sim_apply(s, reg, val);
+		return;
+	}
+
+	if (s->posted_at[i])
+		s->posted_overruns++;
+
+	s->posted_val[i] = val;
+	s->posted_at[i] = now + pwm_sim_div(PWM_SIM_POSTED_CLKS
+					    * NSEC_PER_SEC_U64 + s->clk_hz - 1,
+					    s->clk_hz);
+	*pwm_gpt_sim_r(s, GPT_TWPS) |= 1 << i;
+}
+
+/* interrupts the model is asserting right now */
+static inline u32 pwm_gpt_sim_irq(struct pwm_gpt_sim *s)
+{
+	return *pwm_gpt_sim_r(s, GPT_TISR) & *pwm_gpt_sim_r(s, GPT_TIER);
+}
+
+/*
+ * Time of the next enabled interrupt or posted write landing, so a
+ * caller can sleep until then. 0 if nothing is going to happen.
+ */
+static inline u64 pwm_gpt_sim_next_event(struct pwm_gpt_sim *s)
+{
+	u32 tclr = *pwm_gpt_sim_r(s, GPT_TCLR);
+	u32 tier = *pwm_gpt_sim_r(s, GPT_TIER);
+	u32 tcrr = *pwm_gpt_sim_r(s, GPT_TCRR);
+	u32 tmar = *pwm_gpt_sim_r(s, GPT_TMAR);
+	u64 to_ovf, to_mat, ticks = 0, next = 0;
+	int i;
+
+	if (pwm_gpt_sim_irq(s))
+		return s->now;
+
+	i = pwm_gpt_sim_next_posted(s);
+	if (i >= 0)
+		next = s->posted_at[i];
+
+	if (!(tclr & GPT_TCLR_ST))
+		return next;
+
+	to_ovf = 0x100000000ULL - tcrr;
+	to_mat = (u32) (tmar - tcrr);
+
+	if ((tier & GPT_IRQ_OVF))
+		ticks = to_ovf;
+
+	if ((tier & GPT_IRQ_MAT) && (tclr & GPT_TCLR_CE) && to_mat
+	    && to_mat < to_ovf && (!ticks || to_mat < ticks))
+		ticks = to_mat;
+
+	if (!ticks)
+		return next;
+
+	ticks = s->now + pwm_gpt_sim_ticks_ns(s, ticks);
+
+	return (next && next < ticks) ? next : ticks;
+}
+
+#endif /* ifndef PWM_GPT_SIM_H */
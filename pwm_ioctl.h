@@ -0,0 +1,513 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Userspace interface of the pwm driver: ioctls, their arguments and the
+ timer input clocks. Only needs the kernel's uapi headers, include this
+ one from applications rather than pwm.h.
+*/
+
+#ifndef PWM_IOCTL_H
+#define PWM_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* timer input clocks, PWM_SET_CLK switches GPT10/11 between them */
+#define PWM_INPUT_32K	32768
+#define PWM_INPUT_13K	13312
+
+/*
+ * Ioctl definitions
+ */
+
+#define PWM_IOC_MAGIC  0x00
+
+#define PWM_SET_DUTYCYCLE _IOW(PWM_IOC_MAGIC ,  1, int)
+#define PWM_GET_DUTYCYCLE _IOW(PWM_IOC_MAGIC ,  2, int)
+#define PWM_SET_FREQUENCY _IOW(PWM_IOC_MAGIC ,  3, int)
+#define PWM_GET_FREQUENCY _IOW(PWM_IOC_MAGIC ,  4, int)
+#define PWM_ON _IO(PWM_IOC_MAGIC ,  5)
+#define PWM_OFF _IO(PWM_IOC_MAGIC ,  6)
+#define PWM_SET_POLARITY _IOW(PWM_IOC_MAGIC ,  7, int)
+#define PWM_SET_CLK _IOW(PWM_IOC_MAGIC ,  8, int)
+#define PWM_SET_PRE _IOW(PWM_IOC_MAGIC ,  9, int)
+#define PWM_IOC_MAXNR 9
+
+/*
+ * Software PWM on GPIOs, timed by the GPT of the /dev/pwmN the ioctls
+ * are issued on. The timer itself no longer drives its pin.
+ */
+#define PWM_SOFT_MAX		64
+#define PWM_SOFT_DUTY_MAX	0xFFFF
+
+struct pwm_soft_config {
+	__u32 frequency;	/* Hz of the software PWM */
+	__u32 count;		/* number of gpios used */
+	__u32 gpio[PWM_SOFT_MAX];
+};
+
+struct pwm_soft_duty {
+	__u32 first;		/* first output to update */
+	__u32 count;		/* number of entries in duty[] */
+	__u16 duty[PWM_SOFT_MAX];	/* 0 to PWM_SOFT_DUTY_MAX */
+};
+
+#define PWM_SOFT_START _IOW(PWM_IOC_MAGIC, 10, struct pwm_soft_config)
+#define PWM_SOFT_SET_DUTY _IOW(PWM_IOC_MAGIC, 11, struct pwm_soft_duty)
+#define PWM_SOFT_STOP _IO(PWM_IOC_MAGIC, 12)
+
+/*
+ * Hardware timed fades, TMAR is stepped once per PWM period from the
+ * overflow interrupt. Brightness runs from 0 to PWM_FADE_MAX and is
+ * mapped to a duty cycle through the curve.
+ */
+#define PWM_FADE_MAX		0xFFFF
+#define PWM_FADE_TABLE_MAX	256
+#define PWM_FADE_CURRENT	0xFFFFFFFF	/* start where the output is */
+
+#define PWM_FADE_LINEAR		0
+#define PWM_FADE_GAMMA		1	/* gamma 2.2 */
+#define PWM_FADE_TABLE		2	/* table[] below */
+
+#define PWM_FADE_BREATHE	(1 << 0)	/* ramp back and forth */
+
+struct pwm_fade_config {
+	__u32 frequency;	/* Hz, 0 keeps the current one */
+	__u32 duration_ms;	/* of one ramp */
+	__u32 start;		/* brightness or PWM_FADE_CURRENT */
+	__u32 target;		/* brightness at the end of the ramp */
+	__u32 curve;		/* PWM_FADE_LINEAR, _GAMMA or _TABLE */
+	__u32 flags;		/* PWM_FADE_BREATHE */
+	__u32 cycles;		/* breathing cycles, 0 runs until stopped */
+	__u32 table_len;	/* 2 to PWM_FADE_TABLE_MAX points */
+	__u16 table[PWM_FADE_TABLE_MAX];	/* duty, 0 to PWM_FADE_MAX */
+};
+
+struct pwm_fade_status {
+	__u32 level;		/* current brightness */
+	__u32 remaining;	/* periods left in this ramp, 0 when done */
+	__u32 cycles;		/* breathing cycles left */
+};
+
+#define PWM_FADE_START _IOW(PWM_IOC_MAGIC, 13, struct pwm_fade_config)
+#define PWM_FADE_STOP _IO(PWM_IOC_MAGIC, 14)
+#define PWM_FADE_STATUS _IOR(PWM_IOC_MAGIC, 15, struct pwm_fade_status)
+
+/*
+ * Phase groups. The member timers run at one frequency with their
+ * periods offset by the given phase, in 1/100 degree. Duty changes keep
+ * the counters running, a frequency change on any member retimes the
+ * whole group. count = 0 dissolves the group of the /dev/pwmN used.
+ */
+#define PWM_GROUP_MAX		4
+#define PWM_PHASE_UNITS		36000	/* 360 degrees */
+#define PWM_PHASE_STOPPED	0xFFFFFFFF	/* measured on a stopped member */
+
+struct pwm_phase_group {
+	__u32 count;
+	__u32 timer[PWM_GROUP_MAX];	/* GPT numbers */
+	__u32 phase[PWM_GROUP_MAX];	/* 0 to PWM_PHASE_UNITS - 1 */
+	__u32 measured[PWM_GROUP_MAX];	/* PWM_GET_PHASE_GROUP only */
+};
+
+#define PWM_SET_PHASE_GROUP _IOW(PWM_IOC_MAGIC, 16, struct pwm_phase_group)
+#define PWM_GET_PHASE_GROUP _IOR(PWM_IOC_MAGIC, 17, struct pwm_phase_group)
+
+/*
+ * Complementary pairs for half bridges. The /dev/pwmN used is the high
+ * side, low_timer the low side, which runs inverted with dead_ns between
+ * one side turning off and the other turning on. Duty updates land on
+ * both timers in the same period.
+ */
+#define PWM_PAIR_DUTY_MAX	0xFFFF
+
+struct pwm_pair_config {
+	__u32 low_timer;	/* GPT number of the low side */
+	__u32 frequency;	/* Hz */
+	__u32 dead_ns;		/* dead band on each edge */
+	__u32 duty;		/* high side, 0 to PWM_PAIR_DUTY_MAX */
+};
+
+struct pwm_pair_status {
+	__u32 period;		/* timer ticks */
+	__u32 dead;		/* ticks, requested dead band rounded up */
+	__u32 lead;		/* measured low side lead, ticks */
+	__u32 high;		/* high side on time, ticks */
+	__u32 low;		/* low side off time, ticks */
+};
+
+#define PWM_PAIR_START _IOW(PWM_IOC_MAGIC, 18, struct pwm_pair_config)
+#define PWM_PAIR_SET_DUTY _IOW(PWM_IOC_MAGIC, 19, __u32)
+#define PWM_PAIR_STOP _IO(PWM_IOC_MAGIC, 20)
+#define PWM_PAIR_STATUS _IOR(PWM_IOC_MAGIC, 21, struct pwm_pair_status)
+
+/*
+ * Batched core ioctls, issued on any /dev/pwmN, read only or not. Only
+ * the op targets are checked and touched. Each op names its timer
+ * and one of PWM_SET_DUTYCYCLE, PWM_GET_DUTYCYCLE, PWM_SET_FREQUENCY,
+ * PWM_GET_FREQUENCY, PWM_ON, PWM_OFF or PWM_SET_POLARITY. The ops run
+ * in order, result gets what the single ioctl would have returned. The
+ * calling process needs every timer open, for writing unless the op is
+ * a getter, or result is -EBADF. The ioctl fails with -EINVAL before
+ * applying anything if an op is bad, otherwise it returns the first
+ * error of the ops, or 0.
+ */
+#define PWM_BATCH_MAX		32
+
+struct pwm_batch_op {
+	__u32 timer;		/* GPT number */
+	__u32 cmd;
+	__s32 value;		/* argument of cmd */
+	__s32 result;
+};
+
+struct pwm_batch {
+	__u32 count;
+	struct pwm_batch_op op[PWM_BATCH_MAX];
+};
+
+#define PWM_BATCH _IOWR(PWM_IOC_MAGIC, 22, struct pwm_batch)
+
+/*
+ * Closed loop control. The overflow interrupt of the /dev/pwmN used runs
+ * a PID step every divider periods and writes the result to TMAR. The
+ * measured value comes from the edge rate on the input pin of another
+ * timer, in mHz, or is pushed by a kernel driver with pwm_pid_push().
+ * Gains are Q16.16 per loop iteration, the output is a duty cycle from 0
+ * to PWM_PID_OUT_MAX. PWM_PID_START on a running loop only takes the
+ * new gains, setpoint, limits and timing, the integral carries over.
+ */
+#define PWM_PID_OUT_MAX		0xFFFF
+
+#define PWM_PID_CAPTURE		0	/* edge rate on capture_timer */
+#define PWM_PID_PUSHED		1	/* pwm_pid_push() */
+
+struct pwm_pid_config {
+	__u32 frequency;	/* Hz, 0 keeps the current one */
+	__u32 input;		/* PWM_PID_CAPTURE or PWM_PID_PUSHED */
+	__u32 capture_timer;	/* GPT number, PWM_PID_CAPTURE only */
+	__u32 divider;		/* PWM periods per loop iteration */
+	__u32 timeout;		/* iterations without input, 0 for none */
+	__s32 setpoint;
+	__s32 kp;
+	__s32 ki;
+	__s32 kd;
+	__u32 out_min;		/* output limits, also clamp the integral */
+	__u32 out_max;
+};
+
+struct pwm_pid_status {
+	__s32 setpoint;
+	__s32 measured;		/* 0 after a capture timeout */
+	__s32 error;
+	__s32 integral;		/* output units */
+	__u32 output;
+	__u32 iterations;
+	__u32 timeouts;		/* iterations that ran on stale input */
+};
+
+#define PWM_PID_START _IOW(PWM_IOC_MAGIC, 23, struct pwm_pid_config)
+#define PWM_PID_STOP _IO(PWM_IOC_MAGIC, 24)
+#define PWM_PID_STATUS _IOR(PWM_IOC_MAGIC, 25, struct pwm_pid_status)
+
+/*
+ * Scheduled changes. PWM_SCHED_ADD queues one change for an absolute
+ * CLOCK_MONOTONIC time and returns its id in the entry. An hrtimer
+ * applies it at that time, or right away if the time has passed, and
+ * entries with the same time run in the order they were added. The
+ * registers are written at the deadline, not held back to the next
+ * period boundary: a frequency change, PWM_ON and PWM_OFF start or end
+ * a period right there, so their effective_ns is applied_ns. A duty
+ * change on a running output moves TMAR without stopping the counter.
+ * Written before the counter reached either match it shows in the
+ * period already running, effective_ns is that period's start and
+ * before applied_ns. Otherwise it shows from the next overflow on, a
+ * move that had to wait for the counter from the overflow after it.
+ * PWM_SCHED_DONE hands out what happened to the applied entries,
+ * oldest first.
+ */
+#define PWM_SCHED_MAX		64	/* pending entries per channel */
+#define PWM_SCHED_DONE_MAX	64	/* completions kept per channel */
+
+struct pwm_sched_entry {
+	__u64 at_ns;		/* CLOCK_MONOTONIC */
+	__u32 cmd;		/* PWM_SET_DUTYCYCLE, _SET_FREQUENCY, _ON, _OFF */
+	__s32 value;
+	__u32 id;		/* set by PWM_SCHED_ADD */
+	__u32 reserved;
+};
+
+struct pwm_sched_done {
+	__u32 id;
+	__s32 result;		/* what the ioctl would have returned */
+	__u64 applied_ns;	/* registers written */
+	__u64 effective_ns;	/* start of the first period with the change */
+};
+
+struct pwm_sched_status {
+	__u32 pending;
+	__u32 lost;		/* completions dropped before being collected */
+	__u32 count;		/* entries in done[] */
+	__u32 reserved;
+	struct pwm_sched_done done[PWM_SCHED_DONE_MAX];
+};
+
+#define PWM_SCHED_ADD _IOWR(PWM_IOC_MAGIC, 26, struct pwm_sched_entry)
+#define PWM_SCHED_FLUSH _IO(PWM_IOC_MAGIC, 27)	/* drops pending entries */
+#define PWM_SCHED_DONE _IOR(PWM_IOC_MAGIC, 28, struct pwm_sched_status)
+
+/*
+ * IR transmit. The timer runs the carrier and is gated on for marks and
+ * off for spaces by an hrtimer. buf alternates mark and space durations
+ * in us, starting and ending with a mark. PWM_IR_SEND returns when the
+ * last mark is done.
+ */
+#define PWM_IR_MAX		512
+
+struct pwm_ir_tx {
+	__u32 carrier;		/* Hz */
+	__u32 duty;		/* percent of the carrier period, 1 to 99 */
+	__u32 count;		/* entries in buf */
+	__u32 buf[PWM_IR_MAX];
+};
+
+#define PWM_IR_SEND _IOW(PWM_IOC_MAGIC, 29, struct pwm_ir_tx)
+
+/*
+ * Frequency sweeps. From the overflow interrupt every PWM period gets
+ * the frequency the sweep law gives for its start time, TLDR is written
+ * one period ahead so the counter is never reset, and TMAR keeps the
+ * duty ratio. After the last sweep the end frequency is held.
+ */
+#define PWM_SWEEP_DUTY_MAX	0xFFFF
+
+#define PWM_SWEEP_LOG		(1 << 0)	/* logarithmic, else linear */
+#define PWM_SWEEP_PINGPONG	(1 << 1)	/* every other sweep goes back */
+
+struct pwm_sweep_config {
+	__u32 start;		/* Hz */
+	__u32 end;		/* Hz */
+	__u32 duration_ms;	/* of one sweep */
+	__u32 duty;		/* 0 to PWM_SWEEP_DUTY_MAX */
+	__u32 flags;		/* PWM_SWEEP_LOG, PWM_SWEEP_PINGPONG */
+	__u32 cycles;		/* sweeps to run, 0 runs until stopped */
+};
+
+struct pwm_sweep_status {
+	__u32 frequency;	/* mHz of the running period */
+	__u32 elapsed_ms;	/* into the current sweep */
+	__u32 sweeps;		/* completed */
+	__u32 late;		/* periods whose TMAR update came too late */
+	__u32 running;		/* 0 once the end frequency is held */
+};
+
+#define PWM_SWEEP_START _IOW(PWM_IOC_MAGIC, 30, struct pwm_sweep_config)
+#define PWM_SWEEP_STOP _IO(PWM_IOC_MAGIC, 31)
+#define PWM_SWEEP_STATUS _IOR(PWM_IOC_MAGIC, 32, struct pwm_sweep_status)
+
+/*
+ * Tone generator. A phase accumulator per tone is stepped once per
+ * carrier period from the overflow interrupt, the summed waveforms set
+ * the next TMAR around 50% duty. PWM_DDS_START on a running generator
+ * changes the tones without a phase jump, phase only applies to tones
+ * that were not running.
+ */
+#define PWM_DDS_TONES		4
+#define PWM_DDS_AMPLITUDE_MAX	0xFFFF	/* full scale for one tone */
+
+#define PWM_DDS_SINE		0
+#define PWM_DDS_TRIANGLE	1
+#define PWM_DDS_SQUARE		2
+#define PWM_DDS_SAWTOOTH	3
+
+struct pwm_dds_tone {
+	__u32 frequency;	/* mHz, below half the carrier */
+	__u32 amplitude;	/* 0 to PWM_DDS_AMPLITUDE_MAX */
+	__u32 waveform;		/* PWM_DDS_SINE ... */
+	__u32 phase;		/* start, 1/65536 of a cycle */
+};
+
+struct pwm_dds_config {
+	__u32 carrier;		/* Hz, 0 keeps the current one */
+	__u32 count;		/* tones used */
+	struct pwm_dds_tone tone[PWM_DDS_TONES];
+};
+
+struct pwm_dds_status {
+	__u32 carrier;		/* Hz the timer runs at */
+	__u32 samples;		/* periods stepped */
+	__u32 late;		/* samples skipped, TMAR was already passed */
+};
+
+#define PWM_DDS_START _IOW(PWM_IOC_MAGIC, 33, struct pwm_dds_config)
+#define PWM_DDS_STOP _IO(PWM_IOC_MAGIC, 34)
+#define PWM_DDS_STATUS _IOR(PWM_IOC_MAGIC, 35, struct pwm_dds_status)
+
+/*
+ * Three phase drive. The channel the ioctl is issued on is phase U, the
+ * other two are claimed for V and W and all three run one carrier with
+ * counters started back to back. The U overflow interrupt steps the
+ * electrical angle and writes the three duties, 120 degrees apart.
+ * PWM_3PH_SET changes frequency and modulation together, the angle
+ * carries on. A negative frequency turns the other way.
+ */
+#define PWM_3PH_MOD_ONE		0x10000	/* modulation index 1.0 */
+#define PWM_3PH_MOD_MAX_SINE	PWM_3PH_MOD_ONE
+#define PWM_3PH_MOD_MAX_SVPWM	0x1279A	/* 2 / sqrt(3) */
+
+#define PWM_3PH_SVPWM		0x0001	/* min-max injection, space vector */
+
+struct pwm_3ph_drive {
+	__s32 frequency;	/* electrical, mHz, signed for direction */
+	__u32 modulation;	/* PWM_3PH_MOD_ONE is full sine */
+};
+
+struct pwm_3ph_config {
+	__u32 v_timer;		/* GPT numbers of phase V and W */
+	__u32 w_timer;
+	__u32 carrier;		/* Hz */
+	__u32 flags;		/* PWM_3PH_* */
+	struct pwm_3ph_drive drive;
+};
+
+struct pwm_3ph_status {
+	__u32 carrier;		/* Hz */
+	__u32 angle;		/* electrical, 1/65536 of a turn */
+	__u32 duty[3];		/* U, V, W, 0 to 65535 */
+	__u32 periods;		/* carrier periods stepped */
+	__u32 late;		/* updates skipped, a TMAR was already passed */
+	struct pwm_3ph_drive drive;
+};
+
+#define PWM_3PH_START _IOW(PWM_IOC_MAGIC, 36, struct pwm_3ph_config)
+#define PWM_3PH_SET _IOW(PWM_IOC_MAGIC, 37, struct pwm_3ph_drive)
+#define PWM_3PH_STOP _IO(PWM_IOC_MAGIC, 38)
+#define PWM_3PH_STATUS _IOR(PWM_IOC_MAGIC, 39, struct pwm_3ph_status)
+
+/*
+ * Period start timestamps. While enabled the overflow interrupt notes
+ * when every Nth period of the channel started on CLOCK_MONOTONIC, the
+ * interrupt latency taken out with the counter value. Records go into a
+ * ring that mmap() of /dev/pwmN maps read only, or that PWM_STAMP_READ
+ * copies out in bulk. Not available while a mode owns the channel.
+ *
+ * Record seq lives in stamp[seq & (size - 1)] and is complete once
+ * head has passed it. A reader copies what it wants, then checks head
+ * again, records with head - seq >= size were overwritten meanwhile.
+ */
+#define PWM_STAMP_SIZE_MIN	16
+#define PWM_STAMP_SIZE_MAX	65536
+#define PWM_STAMP_EVERY_MAX	65536
+
+struct pwm_stamp_config {
+	__u32 size;		/* records, a power of two */
+	__u32 every;		/* record every Nth period, 1 for all */
+};
+
+struct pwm_stamp {
+	__u64 time;		/* CLOCK_MONOTONIC ns the period started */
+	__u64 period;		/* index, counted from PWM_STAMP_START */
+};
+
+/* start of the mapping, the records follow */
+struct pwm_stamp_ring {
+	__u32 head;		/* records written, wraps */
+	__u32 size;
+	__u32 every;
+	__u32 missed;		/* periods without an interrupt */
+	__u32 nominal_ns;	/* period from the timer clock */
+	__u32 period_ns;	/* measured, averaged */
+	__s32 drift_ppb;	/* timer clock against CLOCK_MONOTONIC */
+	__u32 jitter_ns;	/* mean deviation of the record spacing */
+	struct pwm_stamp stamp[0];
+};
+
+struct pwm_stamp_read {
+	__u64 buf;		/* struct pwm_stamp array */
+	__u32 seq;		/* in first wanted, out next to ask for */
+	__u32 count;		/* in room in buf, out records copied */
+	__u32 lost;		/* overwritten before they could be read */
+	__u32 reserved;
+};
+
+#define PWM_STAMP_START _IOW(PWM_IOC_MAGIC, 40, struct pwm_stamp_config)
+#define PWM_STAMP_STOP _IO(PWM_IOC_MAGIC, 41)
+#define PWM_STAMP_STATUS _IOR(PWM_IOC_MAGIC, 42, struct pwm_stamp_ring)
+#define PWM_STAMP_READ _IOWR(PWM_IOC_MAGIC, 43, struct pwm_stamp_read)
+
+/*
+ * Exclusive control. Opening /dev/pwmN with O_EXCL, or PWM_CLAIM on an
+ * open file, makes that file the writer of the channel until it calls
+ * PWM_UNCLAIM or is closed. Meanwhile other processes get EBUSY for
+ * anything that changes the channel, directly, in a batch or through a
+ * phase group. Without a claim any file opened for writing can change
+ * it. Files opened read only are monitors: read(), mmap(), the getters
+ * and the ioctls that only return data work, the rest fail with EBADF.
+ * read() and the getters take no lock, any number of monitors can poll
+ * without slowing the writer down.
+ */
+#define PWM_CLAIM _IO(PWM_IOC_MAGIC, 44)
+#define PWM_UNCLAIM _IO(PWM_IOC_MAGIC, 45)
+
+/*
+ * Duty dithering. When a carrier period is only a few ticks long the
+ * overflow interrupt moves TMAR by a tick from period to period, driven
+ * by an error accumulator, so the duty averages out to the requested
+ * fraction of PWM_DITHER_ONE. With spread set every period is also
+ * lengthened or shortened by up to spread ticks, pseudo randomly and
+ * with a mean of zero, to smear the carrier harmonics. The on time is
+ * kept between 2 * spread + 1 ticks and the period less one, a duty
+ * whose mean on time falls outside gets -EINVAL, 0 and PWM_DITHER_ONE
+ * always do. PWM_DITHER_START on a running channel with the same
+ * carrier changes duty and spread without a restart.
+ */
+#define PWM_DITHER_ONE		0x10000	/* 100% */
+#define PWM_DITHER_WINDOW	256	/* periods per status measurement */
+
+struct pwm_dither_config {
+	__u32 carrier;		/* Hz, 0 keeps the current one */
+	__u32 duty;		/* of PWM_DITHER_ONE, see above */
+	__u32 spread;		/* ticks either side, up to period / 8 */
+};
+
+struct pwm_dither_status {
+	__u32 carrier;		/* Hz, nominal */
+	__u32 period;		/* ticks, the undithered duty steps */
+	__u32 duty;		/* requested */
+	__u32 achieved;		/* mean of the last window, 1/2^32 */
+	__u32 bits;		/* resolution of achieved, 1/256 bit */
+	__u32 min_period;	/* ticks, range seen with spread */
+	__u32 max_period;
+	__u32 periods;
+	__u32 late;		/* periods that kept the old TMAR */
+};
+
+#define PWM_DITHER_START _IOW(PWM_IOC_MAGIC, 46, struct pwm_dither_config)
+#define PWM_DITHER_STOP _IO(PWM_IOC_MAGIC, 47)
+#define PWM_DITHER_STATUS _IOR(PWM_IOC_MAGIC, 48, struct pwm_dither_status)
+
+#endif /* ifndef PWM_IOCTL_H */
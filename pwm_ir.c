@@ -0,0 +1,452 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ IR transmitter. The timer runs the carrier as a normal PWM output and an
+ hrtimer gates it, counting on for marks and stopped with the trigger
+ off, so the pin sits low, for spaces. Edge times are kept absolute so
+ the durations do not drift over a long code.
+
+ Sends with PWM_IR_SEND on /dev/pwmN, see pwm_ioctl.h. The timers given
+ with rc= are also registered as rc-core transmitters, so lircd and
+ ir-ctl can use them through /dev/lircN.
+*/
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/errno.h>
+#include <linux/err.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/hrtimer.h>
+#include <linux/wait.h>
+#include <linux/uaccess.h>
+#if IS_ENABLED(CONFIG_RC_CORE)
+#include <media/rc-core.h>
+#endif
+
+#include "pwm_core.h"
+
+static int rc_timers[4];		/* GPT8 to 11 */
+static int rc_timers_count;
+module_param_array_named(rc, rc_timers, int, &rc_timers_count, S_IRUGO);
+MODULE_PARM_DESC(rc, "GP timers to register as rc-core transmitters");
+
+struct pwm_ir {
+	struct list_head list;
+	struct pwm_dev *pwm;
+	struct mutex tx_lock;	/* one transmission at a time */
+	struct hrtimer timer;
+	wait_queue_head_t wait;
+
+	/* the transmission, edge and pos under pwm->lock */
+	const unsigned int *buf;
+	unsigned int count;
+	unsigned int pos;
+	ktime_t edge;
+	int done;
+
+	/* rc-core transmitters keep the channel until unload */
+	struct rc_dev *rc;
+	u32 carrier;
+	u32 duty;
+};
+
+static LIST_HEAD(pwm_ir_list);
+static DEFINE_MUTEX(pwm_ir_lock);
+
+static const struct pwm_mode pwm_ir_mode = {
+	.name = "ir",
+};
+
+/* carrier from the start of its period, dev->lock held */
+static void pwm_ir_mark(struct pwm_dev *dev)
+{
+	pwm_reg_write(dev, GPT_TCRR, dev->gpt.tldr);
+	dev->gpt.tclr = DEFAULT_TCLR | GPT_TCLR_ST;
+	pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+}
+
+/* stopped with TRG cleared, the pin follows SCPWM, low */
+static void pwm_ir_space(struct pwm_dev *dev)
+{
+	dev->gpt.tclr = 0;
+	pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+}
+
+static enum hrtimer_restart pwm_ir_timer_fn(struct hrtimer *timer)
+{
+	struct pwm_ir *ir = container_of(timer, struct pwm_ir, timer);
+	struct pwm_dev *dev = ir->pwm;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	if (++ir->pos >= ir->count) {
+		pwm_ir_space(dev);
+		pwm_publish(dev);
+		ir->done = 1;
+		spin_unlock_irqrestore(&dev->lock, flags);
+		wake_up(&ir->wait);
+		return HRTIMER_NORESTART;
+	}
+
+	if (ir->pos & 1)
+		pwm_ir_space(dev);
+	else
+		pwm_ir_mark(dev);
+
+	ir->edge = ktime_add_ns(ir->edge, (u64)ir->buf[ir->pos] * 1000);
+	hrtimer_set_expires(timer, ir->edge);
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return HRTIMER_RESTART;
+}
+
+/* plays buf and waits for it, ir->tx_lock held */
+static int pwm_ir_play(struct pwm_ir *ir, u32 carrier, u32 duty,
+		       const unsigned int *buf, unsigned int count)
+{
+	struct pwm_dev *dev = ir->pwm;
+	unsigned long flags;
+	u32 period, on;
+
+	if (!carrier || duty < 1 || duty > 99 || !count)
+		return -EINVAL;
+
+	period = dev->gpt.input_freq / carrier;
+	if (period < 2)
+		return -EINVAL;
+
+	on = (period - 1) * duty / 100;
+	if (on < 1)
+		on = 1;
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	pwm_ir_space(dev);
+	dev->gpt.tldr = 0xFFFFFFFF - period + 1;
+	dev->gpt.num_freqs = 0xFFFFFFFE - dev->gpt.tldr;
+	dev->gpt.tmar = dev->gpt.tldr + on;
+	dev->frequency = carrier;
+	pwm_reg_write(dev, GPT_TLDR, dev->gpt.tldr);
+	pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+
+	ir->buf = buf;
+	ir->count = count;
+	ir->pos = 0;
+	ir->done = 0;
+
+	pwm_ir_mark(dev);
+	/* the carrier, the marks and spaces are not republished */
+	pwm_publish(dev);
+	ir->edge = ktime_add_ns(ktime_get(), (u64)buf[0] * 1000);
+	hrtimer_start(&ir->timer, ir->edge, HRTIMER_MODE_ABS);
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	if (wait_event_interruptible(ir->wait, ir->done)) {
+		hrtimer_cancel(&ir->timer);
+
+		spin_lock_irqsave(&dev->lock, flags);
+		pwm_ir_space(dev);
+		pwm_publish(dev);
+		spin_unlock_irqrestore(&dev->lock, flags);
+
+		return -EINTR;
+	}
+
+	return 0;
+}
+
+static struct pwm_ir *pwm_ir_find(struct pwm_dev *dev)
+{
+	struct pwm_ir *ir;
+
+	list_for_each_entry(ir, &pwm_ir_list, list) {
+		if (ir->pwm == dev)
+			return ir;
+	}
+
+	return NULL;
+}
+
+/* takes the channel, pwm_ir_lock held */
+static struct pwm_ir *pwm_ir_create(struct pwm_dev *dev)
+{
+	struct pwm_ir *ir;
+	int error;
+
+	ir = kzalloc(sizeof(*ir), GFP_KERNEL);
+	if (!ir)
+		return ERR_PTR(-ENOMEM);
+
+	ir->pwm = dev;
+	ir->carrier = 38000;
+	ir->duty = 33;
+	mutex_init(&ir->tx_lock);
+	init_waitqueue_head(&ir->wait);
+	hrtimer_init(&ir->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	ir->timer.function = pwm_ir_timer_fn;
+
+	error = pwm_mode_attach(dev, &pwm_ir_mode, ir);
+	if (error) {
+		kfree(ir);
+		return ERR_PTR(error);
+	}
+
+	list_add(&ir->list, &pwm_ir_list);
+
+	return ir;
+}
+
+/* pwm_ir_lock held, nothing is playing */
+static void pwm_ir_release(struct pwm_ir *ir)
+{
+	list_del(&ir->list);
+	hrtimer_cancel(&ir->timer);
+	pwm_mode_detach(ir->pwm, &pwm_ir_mode);
+	kfree(ir);
+}
+
+#if IS_ENABLED(CONFIG_RC_CORE)
+static int pwm_ir_tx(struct rc_dev *rc, unsigned int *txbuf, unsigned int n)
+{
+	struct pwm_ir *ir = rc->priv;
+	int error;
+
+	mutex_lock(&ir->tx_lock);
+	error = pwm_ir_play(ir, ir->carrier, ir->duty, txbuf, n);
+	mutex_unlock(&ir->tx_lock);
+
+	return error ? error : n;
+}
+
+static int pwm_ir_set_carrier(struct rc_dev *rc, u32 carrier)
+{
+	struct pwm_ir *ir = rc->priv;
+
+	if (!carrier || ir->pwm->gpt.input_freq / carrier < 2)
+		return -EINVAL;
+
+	ir->carrier = carrier;
+
+	return 0;
+}
+
+static int pwm_ir_set_duty(struct rc_dev *rc, u32 duty)
+{
+	struct pwm_ir *ir = rc->priv;
+
+	if (duty < 1 || duty > 99)
+		return -EINVAL;
+
+	ir->duty = duty;
+
+	return 0;
+}
+
+static int pwm_ir_rc_add(struct pwm_ir *ir)
+{
+	struct rc_dev *rc;
+	int error;
+
+	rc = rc_allocate_device(RC_DRIVER_IR_RAW_TX);
+	if (!rc)
+		return -ENOMEM;
+
+	rc->priv = ir;
+	rc->driver_name = "pwm_ir";
+	rc->device_name = dev_name(ir->pwm->device);
+	rc->tx_ir = pwm_ir_tx;
+	rc->s_tx_carrier = pwm_ir_set_carrier;
+	rc->s_tx_duty_cycle = pwm_ir_set_duty;
+
+	error = rc_register_device(rc);
+	if (error) {
+		rc_free_device(rc);
+		return error;
+	}
+
+	ir->rc = rc;
+
+	return 0;
+}
+
+static void pwm_ir_rc_remove(struct pwm_ir *ir)
+{
+	rc_unregister_device(ir->rc);
+	ir->rc = NULL;
+}
+#else
+static inline int pwm_ir_rc_add(struct pwm_ir *ir)
+{
+	return -ENODEV;
+}
+
+static inline void pwm_ir_rc_remove(struct pwm_ir *ir)
+{
+}
+#endif
+
+static int pwm_ir_send(struct pwm_dev *dev, struct pwm_ir_tx *tx)
+{
+	struct pwm_ir *ir;
+	int error;
+
+	if (tx->count > PWM_IR_MAX || !(tx->count & 1))
+		return -EINVAL;
+
+	mutex_lock(&pwm_ir_lock);
+
+	ir = pwm_ir_find(dev);
+	if (ir && !ir->rc)
+		ir = ERR_PTR(-EBUSY);	/* another PWM_IR_SEND is playing */
+	else if (!ir)
+		ir = pwm_ir_create(dev);
+
+	mutex_unlock(&pwm_ir_lock);
+
+	if (IS_ERR(ir))
+		return PTR_ERR(ir);
+
+	mutex_lock(&ir->tx_lock);
+	error = pwm_ir_play(ir, tx->carrier, tx->duty, tx->buf, tx->count);
+	mutex_unlock(&ir->tx_lock);
+
+	if (!ir->rc) {
+		mutex_lock(&pwm_ir_lock);
+		pwm_ir_release(ir);
+		mutex_unlock(&pwm_ir_lock);
+	}
+
+	return error;
+}
+
+static long pwm_ir_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			 unsigned long arg)
+{
+	struct pwm_ir_tx *tx;
+	long retval;
+
+	if (cmd != PWM_IR_SEND)
+		return -ENOTTY;
+
+	tx = kmalloc(sizeof(*tx), GFP_KERNEL);
+	if (!tx)
+		return -ENOMEM;
+
+	if (copy_from_user(tx, (void __user *)arg, sizeof(*tx)))
+		retval = -EFAULT;
+	else
+		retval = pwm_ir_send(dev, tx);
+
+	kfree(tx);
+
+	return retval;
+}
+
+static struct pwm_ioctl_ext pwm_ir_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_IR_SEND),
+	.nr_last = _IOC_NR(PWM_IR_SEND),
+	.ioctl = pwm_ir_ioctl,
+};
+
+static void pwm_ir_cleanup(void)
+{
+	struct pwm_ir *ir, *next;
+
+	mutex_lock(&pwm_ir_lock);
+
+	list_for_each_entry_safe(ir, next, &pwm_ir_list, list) {
+		if (ir->rc)
+			pwm_ir_rc_remove(ir);
+		pwm_ir_release(ir);
+	}
+
+	mutex_unlock(&pwm_ir_lock);
+}
+
+static int __init pwm_ir_init(void)
+{
+	struct pwm_dev *dev;
+	struct pwm_ir *ir;
+	int i, error;
+
+	mutex_lock(&pwm_ir_lock);
+
+	for (i = 0; i < rc_timers_count; i++) {
+		dev = pwm_get_dev(rc_timers[i]);
+		if (!dev) {
+			printk(KERN_ALERT "pwm_ir: GPT%d is not enabled\n",
+			       rc_timers[i]);
+			error = -ENODEV;
+			goto init_fail;
+		}
+
+		ir = pwm_ir_create(dev);
+		if (IS_ERR(ir)) {
+			error = PTR_ERR(ir);
+			goto init_fail;
+		}
+
+		error = pwm_ir_rc_add(ir);
+		if (error) {
+			pwm_ir_release(ir);
+			goto init_fail;
+		}
+	}
+
+	mutex_unlock(&pwm_ir_lock);
+
+	error = pwm_register_ioctl(&pwm_ir_ext);
+	if (error)
+		pwm_ir_cleanup();
+
+	return error;
+
+      init_fail:
+	mutex_unlock(&pwm_ir_lock);
+	pwm_ir_cleanup();
+
+	return error;
+}
+
+static void __exit pwm_ir_exit(void)
+{
+	pwm_unregister_ioctl(&pwm_ir_ext);
+	pwm_ir_cleanup();
+}
+
+module_init(pwm_ir_init);
+module_exit(pwm_ir_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("IR transmitter on OMAP3 GP timers");
@@ -0,0 +1,428 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Complementary output pairs with dead time, for half bridges.
+
+ The high side is a normal timer. The low side runs inverted at the
+ same frequency with its counter 'lead' ticks ahead, and its match
+ placed so its low window covers the high pulse plus the dead band on
+ both sides:
+
+   high   ________/~~~~~~~\_________
+   low    ~~~~~\_____________/~~~~~~
+               |<>|       |<>|
+               lead       dead
+
+ Duty changes are staged and written to both timers from the high
+ side's overflow interrupt, so they land in the same period.
+
+ The lead is only known once both counters run. Until the first offsets
+ computed from it are written the low side is held low with its trigger
+ cleared, and it is switched on inside its low window, which puts its
+ toggles opposite to the high side's.
+
+ Controlled with the PWM_PAIR_* ioctls on the high side's /dev/pwmN,
+ see pwm_ioctl.h.
+*/
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/errno.h>
+#include <linux/err.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/uaccess.h>
+
+#include "pwm_core.h"
+
+struct pwm_pair {
+	struct list_head list;
+	struct pwm_dev *hi;
+	struct pwm_dev *lo;	/* claimed with pwm_channel_request() */
+	unsigned long locks;	/* of both, see pwm_lock_channels() */
+
+	u32 period;		/* ticks */
+	u32 dead;
+	u32 lead;		/* how far the low side counter is ahead */
+	u16 duty;
+
+	/* TMAR - TLDR of each side, and the staged values */
+	u32 hi_off;	/* lo_off is the period while the low side is held */
+	u32 lo_off;
+	u32 next_hi;
+	u32 next_lo;
+	int pending;
+};
+
+static LIST_HEAD(pwm_pair_list);
+static DEFINE_MUTEX(pwm_pair_lock);
+
+/* match offsets for duty, clamped so both dead bands always fit */
+static void pwm_pair_offsets(struct pwm_pair *p, u16 duty, u32 *hi, u32 *lo)
+{
+	u32 max = p->period - 1 - p->dead - p->lead;
+	u32 off = ((u64)p->period * duty + PWM_PAIR_DUTY_MAX / 2)
+	    / PWM_PAIR_DUTY_MAX;
+
+	if (off < 1)
+		off = 1;
+	else if (off > max)
+		off = max;
+
+	*hi = off;
+	*lo = off + p->dead + p->lead;
+}
+
+/* true if moving the match from old to new cannot lose or double a toggle */
+static int pwm_pair_safe(struct pwm_dev *dev, u32 old, u32 new)
+{
+	u32 now = pwm_reg_read(dev, GPT_TCRR) - dev->gpt.tldr;
+
+	return (now < old) == (now < new);
+}
+
+static void pwm_pair_irq(struct pwm_dev *dev, void *data, u32 status)
+{
+	struct pwm_pair *p = data;
+	struct pwm_dev *lo = p->lo;
+
+	if (!(status & GPT_IRQ_OVF) || !p->pending)
+		return;
+
+	/* both sides or neither, a half applied update eats the dead band */
+	if (pwm_pair_safe(dev, p->hi_off, p->next_hi)
+	    && pwm_pair_safe(lo, p->lo_off, p->next_lo)) {
+		p->hi_off = p->next_hi;
+		p->lo_off = p->next_lo;
+		dev->gpt.tmar = dev->gpt.tldr + p->hi_off;
+		lo->gpt.tmar = lo->gpt.tldr + p->lo_off;
+		pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+		pwm_reg_write(lo, GPT_TMAR, lo->gpt.tmar);
+
+		/* still held, its counter is before the match, low so far */
+		if (!(lo->gpt.tclr & GPT_TCLR_TRG_MASK)) {
+			lo->gpt.tclr |= GPT_TCLR_TRG_OVFL_MATCH;
+			pwm_reg_write(lo, GPT_TCLR, lo->gpt.tclr);
+		}
+
+		pwm_publish(dev);
+		pwm_publish(lo);
+		p->pending = 0;
+	}
+}
+
+/* both outputs low, TRG cleared makes the pins follow SCPWM */
+static void pwm_pair_stop(struct pwm_dev *dev, void *data)
+{
+	struct pwm_pair *p = data;
+	unsigned long flags;
+
+	pwm_lock_channels(p->locks, &flags);
+
+	pwm_reg_write(dev, GPT_TCLR, 0);
+	pwm_reg_write(p->lo, GPT_TCLR, 0);
+	dev->gpt.tclr = DEFAULT_TCLR;
+	p->lo->gpt.tclr = DEFAULT_TCLR;
+	pwm_publish(dev);
+	pwm_publish(p->lo);
+
+	pwm_unlock_channels(p->locks, flags);
+}
+
+static const struct pwm_mode pwm_pair_mode = {
+	.name = "pair",
+	.irq_events = GPT_IRQ_OVF,
+	.irq = pwm_pair_irq,
+	.stop = pwm_pair_stop,
+};
+
+static struct pwm_pair *pwm_pair_find(struct pwm_dev *dev)
+{
+	struct pwm_pair *p;
+
+	list_for_each_entry(p, &pwm_pair_list, list) {
+		if (p->hi == dev)
+			return p;
+	}
+
+	return NULL;
+}
+
+/* low side lead, counters read in both orders so the read time cancels */
+static u32 pwm_pair_measure(struct pwm_pair *p)
+{
+	u32 h1, l1, l2, h2, d1, d2;
+
+	h1 = pwm_reg_read(p->hi, GPT_TCRR);
+	l1 = pwm_reg_read(p->lo, GPT_TCRR);
+	l2 = pwm_reg_read(p->lo, GPT_TCRR);
+	h2 = pwm_reg_read(p->hi, GPT_TCRR);
+
+	/* same TLDR on both, fold the difference back into one period */
+	d1 = l1 - h1;
+	if (l1 < h1)
+		d1 += p->period;
+	d2 = l2 - h2;
+	if (l2 < h2)
+		d2 += p->period;
+
+	/* round up, a tick too much only widens the dead band */
+	return (d1 + d2 + 1) / 2 + 1;
+}
+
+static void pwm_pair_release(struct pwm_pair *p)
+{
+	list_del(&p->list);
+	pwm_mode_detach(p->hi, &pwm_pair_mode);
+	pwm_channel_free(p->lo);
+	kfree(p);
+}
+
+static int pwm_pair_start(struct pwm_dev *hi, struct pwm_pair_config *cfg)
+{
+	struct pwm_pair *p;
+	struct pwm_dev *lo;
+	unsigned long flags;
+	u32 tldr;
+	int error, fits;
+
+	if (cfg->frequency < 1 || cfg->duty > PWM_PAIR_DUTY_MAX)
+		return -EINVAL;
+
+	if (pwm_pair_find(hi))
+		return -EBUSY;
+
+	p = kzalloc(sizeof(*p), GFP_KERNEL);
+	if (!p)
+		return -ENOMEM;
+
+	lo = pwm_channel_request(cfg->low_timer, "pwm_pair");
+	if (IS_ERR(lo)) {
+		error = PTR_ERR(lo);
+		goto start_fail_1;
+	}
+
+	if (lo == hi || lo->gpt.input_freq != hi->gpt.input_freq) {
+		error = -EINVAL;
+		goto start_fail_2;
+	}
+
+	p->hi = hi;
+	p->lo = lo;
+	p->period = hi->gpt.input_freq / cfg->frequency;
+	p->dead = div_u64((u64)cfg->dead_ns * hi->gpt.input_freq
+			  + NSEC_PER_SEC - 1, NSEC_PER_SEC);
+	p->lead = p->dead;
+	p->duty = cfg->duty;
+
+	/* one tick of high pulse between the two dead bands at least */
+	if (p->period < 2 * p->dead + 4) {
+		error = -EINVAL;
+		goto start_fail_2;
+	}
+
+	p->locks = pwm_channel_bit(hi) | pwm_channel_bit(lo);
+
+	error = pwm_mode_attach_locks(hi, &pwm_pair_mode, p, p->locks);
+	if (error)
+		goto start_fail_2;
+
+	list_add(&p->list, &pwm_pair_list);
+
+	tldr = 0xFFFFFFFF - p->period + 1;
+	pwm_pair_offsets(p, p->duty, &p->hi_off, &p->lo_off);
+
+	/* low side held off, lo_off at the period makes any move safe */
+	p->lo_off = p->period;
+
+	pwm_lock_channels(p->locks, &flags);
+
+	hi->gpt.tclr = DEFAULT_TCLR;
+	lo->gpt.tclr = DEFAULT_TCLR & ~GPT_TCLR_TRG_MASK;
+	pwm_reg_write(hi, GPT_TCLR, hi->gpt.tclr);
+	pwm_reg_write(lo, GPT_TCLR, lo->gpt.tclr);
+
+	hi->gpt.tldr = lo->gpt.tldr = tldr;
+	hi->gpt.num_freqs = lo->gpt.num_freqs = 0xFFFFFFFE - tldr;
+	hi->frequency = lo->frequency = cfg->frequency;
+	hi->gpt.tmar = tldr + p->hi_off;
+	lo->gpt.tmar = tldr + p->period - 1;
+
+	pwm_reg_write(hi, GPT_TLDR, tldr);
+	pwm_reg_write(lo, GPT_TLDR, tldr);
+	pwm_reg_write(hi, GPT_TCRR, tldr);
+	pwm_reg_write(lo, GPT_TCRR, tldr + p->dead);
+	pwm_reg_write(hi, GPT_TMAR, hi->gpt.tmar);
+	pwm_reg_write(lo, GPT_TMAR, lo->gpt.tmar);
+
+	/* low side first, the start skew can only add to its lead */
+	lo->gpt.tclr |= GPT_TCLR_ST;
+	hi->gpt.tclr |= GPT_TCLR_ST;
+	pwm_reg_write(lo, GPT_TCLR, lo->gpt.tclr);
+	pwm_reg_write(hi, GPT_TCLR, hi->gpt.tclr);
+
+	/*
+	 * The low side goes live with the measured lead at the next
+	 * overflow, unless the skew ate the room for the dead bands.
+	 */
+	p->lead = max(pwm_pair_measure(p), p->dead);
+	fits = p->period >= 2 * p->dead + p->lead + 2;
+	if (fits) {
+		pwm_pair_offsets(p, p->duty, &p->next_hi, &p->next_lo);
+		p->pending = 1;
+	}
+
+	pwm_publish(hi);
+	pwm_publish(lo);
+
+	pwm_unlock_channels(p->locks, flags);
+
+	if (!fits) {
+		pwm_pair_release(p);
+		return -EINVAL;
+	}
+
+	return 0;
+
+      start_fail_2:
+	pwm_channel_free(lo);
+      start_fail_1:
+	kfree(p);
+
+	return error;
+}
+
+static void pwm_pair_set_duty(struct pwm_pair *p, u16 duty)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&p->hi->lock, flags);
+	p->duty = duty;
+	pwm_pair_offsets(p, duty, &p->next_hi, &p->next_lo);
+	p->pending = 1;
+	spin_unlock_irqrestore(&p->hi->lock, flags);
+}
+
+static void pwm_pair_status(struct pwm_pair *p, struct pwm_pair_status *st)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&p->hi->lock, flags);
+	st->period = p->period;
+	st->dead = p->dead;
+	st->lead = p->lead;
+	st->high = p->hi_off;
+	st->low = p->lo_off;
+	spin_unlock_irqrestore(&p->hi->lock, flags);
+}
+
+static long pwm_pair_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct pwm_pair_config cfg;
+	struct pwm_pair_status st;
+	struct pwm_pair *p;
+	long retval = 0;
+	__u32 duty;
+
+	mutex_lock(&pwm_pair_lock);
+
+	if (cmd == PWM_PAIR_START) {
+		if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+			retval = -EFAULT;
+		else
+			retval = pwm_pair_start(dev, &cfg);
+		goto ioctl_done;
+	}
+
+	p = pwm_pair_find(dev);
+	if (!p) {
+		retval = -ENODEV;
+		goto ioctl_done;
+	}
+
+	switch (cmd) {
+	case PWM_PAIR_SET_DUTY:
+		if (get_user(duty, (__u32 __user *)arg))
+			retval = -EFAULT;
+		else if (duty > PWM_PAIR_DUTY_MAX)
+			retval = -EINVAL;
+		else
+			pwm_pair_set_duty(p, duty);
+		break;
+
+	case PWM_PAIR_STOP:
+		pwm_pair_release(p);
+		break;
+
+	case PWM_PAIR_STATUS:
+		pwm_pair_status(p, &st);
+		if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+			retval = -EFAULT;
+		break;
+
+	default:
+		retval = -ENOTTY;
+	}
+
+      ioctl_done:
+	mutex_unlock(&pwm_pair_lock);
+
+	return retval;
+}
+
+static struct pwm_ioctl_ext pwm_pair_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_PAIR_START),
+	.nr_last = _IOC_NR(PWM_PAIR_STATUS),
+	.ioctl = pwm_pair_ioctl,
+};
+
+static int __init pwm_pair_init(void)
+{
+	return pwm_register_ioctl(&pwm_pair_ext);
+}
+
+static void __exit pwm_pair_exit(void)
+{
+	struct pwm_pair *p, *next;
+
+	pwm_unregister_ioctl(&pwm_pair_ext);
+
+	mutex_lock(&pwm_pair_lock);
+	list_for_each_entry_safe(p, next, &pwm_pair_list, list)
+		pwm_pair_release(p);
+	mutex_unlock(&pwm_pair_lock);
+}
+
+module_init(pwm_pair_init);
+module_exit(pwm_pair_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Complementary PWM pairs with dead time on OMAP3 GP timers");
@@ -0,0 +1,509 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Closed loop PID control in the overflow interrupt. The measured value
+ is the edge rate on the input pin of a second timer in dual capture
+ mode (TCAR2 - TCAR1 is one period of the input signal), or a value a
+ kernel driver hands in with pwm_pid_push(). Every divider PWM periods
+ a fixed point PID step turns it into a new duty cycle and TMAR is
+ updated without stopping the counter, so a fan or heater loop runs at
+ up to the PWM frequency with no syscalls at all.
+
+ Controlled with the PWM_PID_* ioctls on the output's /dev/pwmN, see
+ pwm_ioctl.h.
+*/
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/errno.h>
+#include <linux/err.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/uaccess.h>
+
+#include "pwm_core.h"
+
+struct pwm_pid {
+	struct list_head list;
+	struct pwm_dev *pwm;
+	struct pwm_dev *cap;	/* PWM_PID_CAPTURE, claimed channel */
+	u32 input;
+
+	u32 divider;
+	u32 tick;
+	u32 timeout;
+	u32 age;		/* iterations since the last fresh input */
+
+	s32 setpoint;
+	s32 kp, ki, kd;
+	u32 out_min, out_max;
+
+	s32 measured;
+	s32 prev;		/* measured of the last step, for D */
+	s32 error;
+	s64 integral;		/* output << 16 */
+	u32 output;
+	int fresh;
+	u32 iterations;
+	u32 timeouts;
+
+	u32 off;		/* TMAR - TLDR the timer has now */
+	u32 next_off;
+	int pending;
+};
+
+static LIST_HEAD(pwm_pid_list);
+static DEFINE_MUTEX(pwm_pid_lock);
+
+static u32 pwm_pid_ticks(struct pwm_dev *dev, u32 output)
+{
+	u32 off = ((u64)output * dev->gpt.num_freqs) >> 16;
+
+	/* a match on the reload tick is not seen, keep at least one */
+	return off ? off : 1;
+}
+
+/* same rule as the fades, never move TMAR across the counter */
+static void pwm_pid_write(struct pwm_dev *dev, struct pwm_pid *p)
+{
+	u32 now = pwm_reg_read(dev, GPT_TCRR) - dev->gpt.tldr;
+
+	if ((now < p->off) != (now < p->next_off)) {
+		p->pending = 1;
+		return;
+	}
+
+	p->off = p->next_off;
+	p->pending = 0;
+	dev->gpt.tmar = dev->gpt.tldr + p->off;
+	pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+	pwm_publish(dev);
+}
+
+/*
+ * Polled once per PWM period. TISR has the capture bit once both edges
+ * are in, the interrupt of the capture timer itself stays off. The irq
+ * holds cap->lock too, the mode is attached with it.
+ */
+static void pwm_pid_capture(struct pwm_pid *p)
+{
+	struct pwm_dev *cap = p->cap;
+	u32 c1, c2;
+
+	if (pwm_reg_read(cap, GPT_TISR) & GPT_IRQ_TCAR) {
+		c1 = pwm_reg_read(cap, GPT_TCAR1);
+		c2 = pwm_reg_read(cap, GPT_TCAR2);
+		pwm_reg_write(cap, GPT_TISR, GPT_IRQ_TCAR);
+
+		if (c2 != c1) {
+			p->measured = min_t(u64, S32_MAX,
+					    div_u64((u64)cap->gpt.input_freq
+						    * 1000, c2 - c1));
+			p->fresh = 1;
+		}
+	}
+}
+
+static void pwm_pid_step(struct pwm_pid *p)
+{
+	s64 lo = (s64)p->out_min << 16;
+	s64 hi = (s64)p->out_max << 16;
+	s64 out, e;
+
+	if (p->fresh) {
+		p->fresh = 0;
+		p->age = 0;
+	} else if (p->timeout && ++p->age > p->timeout) {
+		/* a stalled fan has no edges, read it as 0 */
+		if (p->input == PWM_PID_CAPTURE)
+			p->measured = 0;
+		p->timeouts++;
+	}
+
+	e = (s64)p->setpoint - p->measured;
+	p->error = clamp_t(s64, e, S32_MIN, S32_MAX);
+
+	p->integral += (s64)p->ki * p->error;
+	p->integral = clamp(p->integral, lo, hi);
+
+	/* D on the measurement, a setpoint change does not kick */
+	out = (s64)p->kp * p->error + p->integral
+	    - (s64)p->kd * ((s64)p->measured - p->prev);
+	p->prev = p->measured;
+
+	p->output = clamp(out, lo, hi) >> 16;
+	p->iterations++;
+}
+
+static void pwm_pid_irq(struct pwm_dev *dev, void *data, u32 status)
+{
+	struct pwm_pid *p = data;
+
+	if (!(status & GPT_IRQ_OVF))
+		return;
+
+	if (p->pending)
+		pwm_pid_write(dev, p);
+
+	if (p->cap)
+		pwm_pid_capture(p);
+
+	if (++p->tick < p->divider)
+		return;
+
+	p->tick = 0;
+	pwm_pid_step(p);
+
+	p->next_off = pwm_pid_ticks(dev, p->output);
+	if (p->next_off != p->off)
+		pwm_pid_write(dev, p);
+}
+
+static const struct pwm_mode pwm_pid_mode = {
+	.name = "pid",
+	.irq_events = GPT_IRQ_OVF,
+	.irq = pwm_pid_irq,
+};
+
+int pwm_pid_push(struct pwm_dev *dev, s32 value)
+{
+	struct pwm_pid *p;
+	unsigned long flags;
+	int error = -ENODEV;
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	if (dev->mode == &pwm_pid_mode) {
+		p = dev->mode_data;
+		if (p->input == PWM_PID_PUSHED) {
+			p->measured = value;
+			p->fresh = 1;
+			error = 0;
+		}
+	}
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return error;
+}
+EXPORT_SYMBOL_GPL(pwm_pid_push);
+
+static struct pwm_pid *pwm_pid_find(struct pwm_dev *dev)
+{
+	struct pwm_pid *p;
+
+	list_for_each_entry(p, &pwm_pid_list, list) {
+		if (p->pwm == dev)
+			return p;
+	}
+
+	return NULL;
+}
+
+/* dual capture of rising edges, counting from 0 with the timer's clock */
+static void pwm_pid_capture_start(struct pwm_dev *cap)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&cap->lock, flags);
+
+	cap->ops->pad_write(cap->gpt.mux_offset,
+			    cap->gpt.mux_mode | PWM_MUX_INPUT);
+
+	cap->gpt.tclr = GPT_TCLR_AR | GPT_TCLR_TCM_RISING
+	    | GPT_TCLR_CAPT_MODE | GPT_TCLR_GPO_CFG;
+	pwm_reg_write(cap, GPT_TCLR, cap->gpt.tclr);
+	pwm_reg_write(cap, GPT_TLDR, 0);
+	pwm_reg_write(cap, GPT_TCRR, 0);
+	pwm_reg_write(cap, GPT_TISR, GPT_IRQ_ALL);
+	cap->gpt.tclr |= GPT_TCLR_ST;
+	pwm_reg_write(cap, GPT_TCLR, cap->gpt.tclr);
+	pwm_publish(cap);
+
+	spin_unlock_irqrestore(&cap->lock, flags);
+}
+
+/* back to a stopped PWM output, gpt.tldr was never touched */
+static void pwm_pid_capture_stop(struct pwm_dev *cap)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&cap->lock, flags);
+
+	cap->gpt.tclr = DEFAULT_TCLR;
+	pwm_reg_write(cap, GPT_TCLR, cap->gpt.tclr);
+	pwm_reg_write(cap, GPT_TLDR, cap->gpt.tldr);
+	pwm_reg_write(cap, GPT_TCRR, cap->gpt.tldr);
+	cap->ops->pad_write(cap->gpt.mux_offset, cap->gpt.mux_mode);
+	pwm_publish(cap);
+
+	spin_unlock_irqrestore(&cap->lock, flags);
+}
+
+static int pwm_pid_check(struct pwm_dev *dev, const struct pwm_pid_config *cfg)
+{
+	if (cfg->input != PWM_PID_CAPTURE && cfg->input != PWM_PID_PUSHED)
+		return -EINVAL;
+
+	if (cfg->divider < 1 || cfg->out_min > cfg->out_max
+	    || cfg->out_max > PWM_PID_OUT_MAX)
+		return -EINVAL;
+
+	if (cfg->frequency && dev->gpt.input_freq / cfg->frequency < 2)
+		return -EINVAL;
+
+	return 0;
+}
+
+/* gains and limits, the part that can change on a running loop */
+static void pwm_pid_tune(struct pwm_pid *p, const struct pwm_pid_config *cfg)
+{
+	p->divider = cfg->divider;
+	p->timeout = cfg->timeout;
+	p->setpoint = cfg->setpoint;
+	p->kp = cfg->kp;
+	p->ki = cfg->ki;
+	p->kd = cfg->kd;
+	p->out_min = cfg->out_min;
+	p->out_max = cfg->out_max;
+	p->integral = clamp(p->integral, (s64)cfg->out_min << 16,
+			    (s64)cfg->out_max << 16);
+}
+
+static int pwm_pid_start(struct pwm_dev *dev, struct pwm_pid_config *cfg)
+{
+	struct pwm_pid *p;
+	struct pwm_dev *cap = NULL;
+	unsigned long flags;
+	u32 period = 0;
+	int error;
+
+	error = pwm_pid_check(dev, cfg);
+	if (error)
+		return error;
+
+	if (cfg->frequency)
+		period = dev->gpt.input_freq / cfg->frequency;
+
+	p = pwm_pid_find(dev);
+	if (p) {
+		if (cfg->input != p->input || (p->cap && cfg->capture_timer
+					       != p->cap->gpt.timer_num))
+			return -EBUSY;
+
+		spin_lock_irqsave(&dev->lock, flags);
+		pwm_pid_tune(p, cfg);
+		spin_unlock_irqrestore(&dev->lock, flags);
+
+		return 0;
+	}
+
+	p = kzalloc(sizeof(*p), GFP_KERNEL);
+	if (!p)
+		return -ENOMEM;
+
+	if (cfg->input == PWM_PID_CAPTURE) {
+		cap = pwm_channel_request(cfg->capture_timer, "pwm_pid");
+		if (IS_ERR(cap)) {
+			error = PTR_ERR(cap);
+			goto start_fail_1;
+		}
+
+		if (cap == dev) {
+			error = -EINVAL;
+			goto start_fail_2;
+		}
+	}
+
+	p->pwm = dev;
+	p->cap = cap;
+	p->input = cfg->input;
+
+	error = pwm_mode_attach_locks(dev, &pwm_pid_mode, p,
+				      cap ? pwm_channel_bit(cap) : 0);
+	if (error)
+		goto start_fail_2;
+
+	list_add(&p->list, &pwm_pid_list);
+
+	if (cap)
+		pwm_pid_capture_start(cap);
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	if (period && period != 0xFFFFFFFF - dev->gpt.tldr + 1) {
+		/* a new period restarts the timer */
+		dev->gpt.tclr &= ~GPT_TCLR_ST;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+		dev->gpt.tldr = 0xFFFFFFFF - period + 1;
+		dev->gpt.num_freqs = 0xFFFFFFFE - dev->gpt.tldr;
+		dev->frequency = cfg->frequency;
+		pwm_reg_write(dev, GPT_TLDR, dev->gpt.tldr);
+	}
+
+	if (dev->gpt.tclr & GPT_TCLR_ST) {
+		/* bumpless, the integral starts at the running duty */
+		p->off = dev->gpt.tmar - dev->gpt.tldr;
+		p->output = min_t(u64, PWM_PID_OUT_MAX,
+				  div_u64((u64)p->off << 16,
+					  dev->gpt.num_freqs));
+	} else {
+		p->output = cfg->out_min;
+		p->off = pwm_pid_ticks(dev, p->output);
+		dev->gpt.tmar = dev->gpt.tldr + p->off;
+		dev->gpt.tclr = DEFAULT_TCLR | (dev->gpt.tclr & GPT_TCLR_SCPWM);
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+		pwm_reg_write(dev, GPT_TLDR, dev->gpt.tldr);
+		pwm_reg_write(dev, GPT_TCRR, dev->gpt.tldr);
+		pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+		dev->gpt.tclr |= GPT_TCLR_ST;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+	}
+
+	p->integral = (s64)p->output << 16;
+	pwm_pid_tune(p, cfg);
+	pwm_publish(dev);
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
+
+      start_fail_2:
+	if (cap)
+		pwm_channel_free(cap);
+      start_fail_1:
+	kfree(p);
+
+	return error;
+}
+
+static void pwm_pid_status(struct pwm_pid *p, struct pwm_pid_status *st)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&p->pwm->lock, flags);
+	st->setpoint = p->setpoint;
+	st->measured = p->measured;
+	st->error = p->error;
+	st->integral = p->integral >> 16;
+	st->output = p->output;
+	st->iterations = p->iterations;
+	st->timeouts = p->timeouts;
+	spin_unlock_irqrestore(&p->pwm->lock, flags);
+}
+
+static void pwm_pid_release(struct pwm_pid *p)
+{
+	list_del(&p->list);
+	pwm_mode_detach(p->pwm, &pwm_pid_mode);
+
+	if (p->cap) {
+		pwm_pid_capture_stop(p->cap);
+		pwm_channel_free(p->cap);
+	}
+
+	kfree(p);
+}
+
+static long pwm_pid_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct pwm_pid_config cfg;
+	struct pwm_pid_status st;
+	struct pwm_pid *p;
+	long retval = 0;
+
+	mutex_lock(&pwm_pid_lock);
+
+	switch (cmd) {
+	case PWM_PID_START:
+		if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+			retval = -EFAULT;
+		else
+			retval = pwm_pid_start(dev, &cfg);
+		break;
+
+	case PWM_PID_STOP:
+		p = pwm_pid_find(dev);
+		if (!p)
+			retval = -ENODEV;
+		else
+			pwm_pid_release(p);
+		break;
+
+	case PWM_PID_STATUS:
+		p = pwm_pid_find(dev);
+		if (!p) {
+			retval = -ENODEV;
+			break;
+		}
+
+		pwm_pid_status(p, &st);
+		if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+			retval = -EFAULT;
+		break;
+
+	default:
+		retval = -ENOTTY;
+	}
+
+	mutex_unlock(&pwm_pid_lock);
+
+	return retval;
+}
+
+static struct pwm_ioctl_ext pwm_pid_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_PID_START),
+	.nr_last = _IOC_NR(PWM_PID_STATUS),
+	.ioctl = pwm_pid_ioctl,
+};
+
+static int __init pwm_pid_init(void)
+{
+	return pwm_register_ioctl(&pwm_pid_ext);
+}
+
+static void __exit pwm_pid_exit(void)
+{
+	struct pwm_pid *p, *next;
+
+	pwm_unregister_ioctl(&pwm_pid_ext);
+
+	mutex_lock(&pwm_pid_lock);
+	list_for_each_entry_safe(p, next, &pwm_pid_list, list)
+		pwm_pid_release(p);
+	mutex_unlock(&pwm_pid_lock);
+}
+
+module_init(pwm_pid_init);
+module_exit(pwm_pid_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Closed loop PID control on OMAP3 GP timers");
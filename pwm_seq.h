@@ -0,0 +1,139 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Register sequences of the driver: frequency, start, stop, polarity,
+ duty and moving the match of a running timer. Plain C so that
+ tools/pwm_test.c runs the code pwm.c does on the model in
+ pwm_gpt_sim.h.
+
+ The includer defines PWM_SEQ_DEV, a type with the gpt, frequency and
+ duty_cycle fields of struct pwm_dev, and pwm_seq_read(dev, reg) and
+ pwm_seq_write(dev, reg, val) for its registers. Locking, publishing
+ and tracing are left to it.
+*/
+
+#ifndef PWM_SEQ_H
+#define PWM_SEQ_H
+
+#include "pwm.h"
+#include "pwm_conv.h"
+
+/* loads the period for freq and restarts it, the count starts over */
+static inline void pwm_seq_frequency(PWM_SEQ_DEV *dev, int freq)
+{
+	dev->frequency = pwm_conv_frequency(dev->gpt.input_freq, freq);
+	dev->gpt.tldr = pwm_conv_tldr(dev->gpt.input_freq, dev->frequency);
+
+	/* just for convenience */
+	dev->gpt.num_freqs = 0xFFFFFFFE - dev->gpt.tldr;
+
+	pwm_seq_write(dev, GPT_TLDR, dev->gpt.tldr);
+
+	/* initialize TCRR to TLDR, have to start somewhere */
+	pwm_seq_write(dev, GPT_TCRR, dev->gpt.tldr);
+}
+
+static inline void pwm_seq_off(PWM_SEQ_DEV *dev)
+{
+	dev->gpt.tclr &= ~GPT_TCLR_ST;
+	pwm_seq_write(dev, GPT_TCLR, dev->gpt.tclr);
+}
+
+static inline void pwm_seq_on(PWM_SEQ_DEV *dev)
+{
+	/* set the duty cycle */
+	pwm_seq_write(dev, GPT_TMAR, dev->gpt.tmar);
+
+	/* now turn it on */
+	dev->gpt.tclr = pwm_seq_read(dev, GPT_TCLR);
+	dev->gpt.tclr |= GPT_TCLR_ST;
+	pwm_seq_write(dev, GPT_TCLR, dev->gpt.tclr);
+}
+
+static inline void pwm_seq_polarity(PWM_SEQ_DEV *dev, int sc)
+{
+	if (sc == 1)
+		dev->gpt.tclr |= GPT_TCLR_SCPWM;
+	else
+		dev->gpt.tclr &= ~GPT_TCLR_SCPWM;
+
+	pwm_seq_write(dev, GPT_TCLR, dev->gpt.tclr);
+}
+
+/* computes gpt.tmar for duty_cycle, returns 0 if the output should be off */
+static inline int pwm_seq_duty(PWM_SEQ_DEV *dev, int duty_cycle)
+{
+	u32 tmar;
+
+	dev->duty_cycle = duty_cycle;
+
+	tmar = pwm_conv_tmar(dev->gpt.tldr, duty_cycle);
+	if (!tmar)
+		return 0;
+
+	dev->gpt.tmar = tmar;
+
+	return 1;
+}
+
+/*
+ * Ticks until the counter is out of the span between the match the
+ * timer has and gpt.tmar, 0 if it is out already. The output toggles
+ * on match, a TMAR write while the counter is inside the span gives
+ * that period two toggles or none and leaves the output inverted from
+ * then on.
+ */
+static inline u32 pwm_seq_tmar_ticks(PWM_SEQ_DEV *dev, u32 hw_tmar)
+{
+	u32 lo = (hw_tmar < dev->gpt.tmar ? hw_tmar : dev->gpt.tmar)
+	    - dev->gpt.tldr;
+	u32 hi = (hw_tmar < dev->gpt.tmar ? dev->gpt.tmar : hw_tmar)
+	    - dev->gpt.tldr;
+	u32 now = pwm_seq_read(dev, GPT_TCRR) - dev->gpt.tldr;
+
+	/* the span is the whole period, waiting would not get out of it */
+	if (lo == 0 && hi > dev->gpt.num_freqs)
+		return 0;
+
+	if (now < lo || now > hi)
+		return 0;
+
+	return hi - now + 1;
+}
+
+/* what pwm_publish() copies, into anything with struct pwm_snap's fields */
+#define pwm_seq_snap(dev, snap)						\
+	do {								\
+		(snap)->tclr = (dev)->gpt.tclr;				\
+		(snap)->tldr = (dev)->gpt.tldr;				\
+		(snap)->tmar = (dev)->gpt.tmar;				\
+		(snap)->num_freqs = (dev)->gpt.num_freqs;		\
+		(snap)->input_freq = (dev)->gpt.input_freq;		\
+		(snap)->frequency = (dev)->frequency;			\
+	} while (0)
+
+#endif /* ifndef PWM_SEQ_H */
@@ -0,0 +1,343 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Software PWM on up to PWM_SOFT_MAX GPIOs, timed by one GP timer.
+
+ The timer overflows once per software PWM period, at which point all
+ outputs with a non-zero duty are raised. The match register is then
+ stepped through the sorted edge schedule so that an interrupt only
+ fires when some output is due to drop.
+
+ Controlled with the PWM_SOFT_* ioctls on the /dev/pwmN of the timer
+ to use, see pwm_ioctl.h.
+*/
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/errno.h>
+#include <linux/gpio.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/bitops.h>
+#include <linux/uaccess.h>
+
+#include "pwm_core.h"
+#include "pwm_soft_sched.h"
+
+struct pwm_soft {
+	struct list_head list;
+	struct pwm_dev *pwm;
+	unsigned int count;
+	unsigned int gpio[PWM_SOFT_MAX];
+	u16 duty[PWM_SOFT_MAX];
+
+	/* sched[active] is used by the irq, a new one is swapped in on overflow */
+	struct pwm_soft_sched sched[2];
+	struct pwm_soft_sched staging;
+	int active;
+	int pending;
+	unsigned int cursor;
+};
+
+static LIST_HEAD(pwm_soft_list);
+static DEFINE_MUTEX(pwm_soft_lock);
+
+static void pwm_soft_set(struct pwm_soft *soft, u64 mask, int value)
+{
+	unsigned int bit;
+
+	while (mask) {
+		bit = __ffs64(mask);
+		mask &= mask - 1;
+		gpio_set_value(soft->gpio[bit], value);
+	}
+}
+
+static void pwm_soft_run_edges(struct pwm_dev *dev, struct pwm_soft *soft)
+{
+	const struct pwm_soft_sched *s = &soft->sched[soft->active];
+	u32 now;
+
+	now = pwm_reg_read(dev, GPT_TCRR) - dev->gpt.tldr;
+
+	for (;;) {
+		pwm_soft_set(soft, pwm_soft_sched_due(s, &soft->cursor, now), 0);
+
+		if (soft->cursor >= s->nedges)
+			break;
+
+		pwm_reg_write(dev, GPT_TMAR,
+			      dev->gpt.tldr + s->edge[soft->cursor].tick);
+
+		/* if the counter already went past it, no match will come */
+		now = pwm_reg_read(dev, GPT_TCRR) - dev->gpt.tldr;
+		if (now < s->edge[soft->cursor].tick)
+			break;
+	}
+}
+
+static void pwm_soft_irq(struct pwm_dev *dev, void *data, u32 status)
+{
+	struct pwm_soft *soft = data;
+	const struct pwm_soft_sched *s;
+
+	if (status & GPT_IRQ_MAT)
+		pwm_soft_run_edges(dev, soft);
+
+	if (!(status & GPT_IRQ_OVF))
+		return;
+
+	/* edges of the last period that were not serviced in time */
+	s = &soft->sched[soft->active];
+	pwm_soft_set(soft, pwm_soft_sched_due(s, &soft->cursor, ~0U), 0);
+
+	if (soft->pending) {
+		soft->active ^= 1;
+		soft->pending = 0;
+	}
+
+	s = &soft->sched[soft->active];
+	soft->cursor = 0;
+	pwm_soft_set(soft, s->start_mask, 1);
+	pwm_soft_run_edges(dev, soft);
+}
+
+static void pwm_soft_stop(struct pwm_dev *dev, void *data)
+{
+	struct pwm_soft *soft = data;
+	unsigned int i;
+
+	pwm_reg_write(dev, GPT_TCLR, 0);
+
+	for (i = 0; i < soft->count; i++) {
+		gpio_set_value(soft->gpio[i], 0);
+		gpio_free(soft->gpio[i]);
+	}
+
+	kfree(soft);
+}
+
+static const struct pwm_mode pwm_soft_mode = {
+	.name = "soft",
+	.irq_events = GPT_IRQ_OVF | GPT_IRQ_MAT,
+	.irq = pwm_soft_irq,
+	.stop = pwm_soft_stop,
+};
+
+static struct pwm_soft *pwm_soft_find(struct pwm_dev *dev)
+{
+	struct pwm_soft *soft;
+
+	list_for_each_entry(soft, &pwm_soft_list, list) {
+		if (soft->pwm == dev)
+			return soft;
+	}
+
+	return NULL;
+}
+
+static int pwm_soft_start(struct pwm_dev *dev, struct pwm_soft_config *cfg)
+{
+	struct pwm_soft *soft;
+	unsigned long flags;
+	unsigned int i;
+	u32 period;
+	int error;
+
+	if (cfg->count < 1 || cfg->count > PWM_SOFT_MAX || cfg->frequency < 1)
+		return -EINVAL;
+
+	period = dev->gpt.input_freq / cfg->frequency;
+	if (period < 2)
+		return -EINVAL;
+
+	if (pwm_soft_find(dev))
+		return -EBUSY;
+
+	soft = kzalloc(sizeof(*soft), GFP_KERNEL);
+	if (!soft)
+		return -ENOMEM;
+
+	soft->pwm = dev;
+
+	for (i = 0; i < cfg->count; i++) {
+		error = gpio_request(cfg->gpio[i], "pwm_soft");
+		if (!error) {
+			error = gpio_direction_output(cfg->gpio[i], 0);
+			if (error)
+				gpio_free(cfg->gpio[i]);
+		}
+
+		if (error) {
+			printk(KERN_ALERT "pwm_soft: gpio %u unavailable\n",
+			       cfg->gpio[i]);
+			goto start_fail;
+		}
+
+		soft->gpio[i] = cfg->gpio[i];
+		soft->count++;
+	}
+
+	pwm_soft_sched_build(&soft->sched[0], period, soft->duty, soft->count);
+
+	error = pwm_mode_attach(dev, &pwm_soft_mode, soft);
+	if (error)
+		goto start_fail;
+
+	list_add(&soft->list, &pwm_soft_list);
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->gpt.tldr = 0xFFFFFFFF - period + 1;
+	dev->gpt.num_freqs = period - 1;
+	dev->gpt.tmar = dev->gpt.tldr;
+	dev->frequency = dev->gpt.input_freq / period;
+	/* compare only, the timer's own pin is not driven */
+	dev->gpt.tclr = GPT_TCLR_AR | GPT_TCLR_CE;
+	pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+	pwm_reg_write(dev, GPT_TLDR, dev->gpt.tldr);
+	pwm_reg_write(dev, GPT_TCRR, dev->gpt.tldr);
+	pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+	dev->gpt.tclr |= GPT_TCLR_ST;
+	pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+	pwm_publish(dev);
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
+
+      start_fail:
+	for (i = 0; i < soft->count; i++)
+		gpio_free(soft->gpio[i]);
+
+	kfree(soft);
+
+	return error;
+}
+
+static int pwm_soft_set_duty(struct pwm_soft *soft, struct pwm_soft_duty *req)
+{
+	struct pwm_dev *dev = soft->pwm;
+	unsigned long flags;
+
+	if (req->count > PWM_SOFT_MAX || req->first >= soft->count
+	    || req->count > soft->count - req->first)
+		return -EINVAL;
+
+	memcpy(&soft->duty[req->first], req->duty,
+	       req->count * sizeof(req->duty[0]));
+
+	pwm_soft_sched_build(&soft->staging, soft->sched[0].period,
+			     soft->duty, soft->count);
+
+	spin_lock_irqsave(&dev->lock, flags);
+	soft->sched[soft->active ^ 1] = soft->staging;
+	soft->pending = 1;
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
+}
+
+static void pwm_soft_release(struct pwm_soft *soft)
+{
+	list_del(&soft->list);
+	pwm_mode_detach(soft->pwm, &pwm_soft_mode);
+}
+
+static long pwm_soft_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct pwm_soft_config cfg;
+	struct pwm_soft_duty req;
+	struct pwm_soft *soft;
+	long retval = 0;
+
+	mutex_lock(&pwm_soft_lock);
+
+	switch (cmd) {
+	case PWM_SOFT_START:
+		if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+			retval = -EFAULT;
+		else
+			retval = pwm_soft_start(dev, &cfg);
+		break;
+
+	case PWM_SOFT_SET_DUTY:
+		soft = pwm_soft_find(dev);
+		if (!soft)
+			retval = -ENODEV;
+		else if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			retval = -EFAULT;
+		else
+			retval = pwm_soft_set_duty(soft, &req);
+		break;
+
+	case PWM_SOFT_STOP:
+		soft = pwm_soft_find(dev);
+		if (!soft)
+			retval = -ENODEV;
+		else
+			pwm_soft_release(soft);
+		break;
+
+	default:
+		retval = -ENOTTY;
+	}
+
+	mutex_unlock(&pwm_soft_lock);
+
+	return retval;
+}
+
+static struct pwm_ioctl_ext pwm_soft_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_SOFT_START),
+	.nr_last = _IOC_NR(PWM_SOFT_STOP),
+	.ioctl = pwm_soft_ioctl,
+};
+
+static int __init pwm_soft_init(void)
+{
+	return pwm_register_ioctl(&pwm_soft_ext);
+}
+
+static void __exit pwm_soft_exit(void)
+{
+	struct pwm_soft *soft, *next;
+
+	pwm_unregister_ioctl(&pwm_soft_ext);
+
+	mutex_lock(&pwm_soft_lock);
+	list_for_each_entry_safe(soft, next, &pwm_soft_list, list)
+		pwm_soft_release(soft);
+	mutex_unlock(&pwm_soft_lock);
+}
+
+module_init(pwm_soft_init);
+module_exit(pwm_soft_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Software PWM on GPIOs timed by an OMAP3 GP timer");
@@ -0,0 +1,132 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Edge schedule for the software PWM in pwm_soft.c. Plain C so the same
+ code can be run against a simulated timer by tools/pwm_soft_bench.c.
+
+ A period is 'period' timer ticks long. Every output with a non-zero
+ duty goes high at tick 0 and low again at its edge. Edges are kept
+ sorted and merged by tick, so each match interrupt only touches the
+ outputs that are due.
+*/
+
+#ifndef PWM_SOFT_SCHED_H
+#define PWM_SOFT_SCHED_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+#endif
+
+#include "pwm.h"
+
+struct pwm_soft_edge {
+	u32 tick;
+	u64 mask;		/* outputs that go low at tick */
+};
+
+struct pwm_soft_sched {
+	u32 period;
+	u64 start_mask;		/* outputs that go high at tick 0 */
+	unsigned int nedges;
+	struct pwm_soft_edge edge[PWM_SOFT_MAX];
+};
+
+static inline u32 pwm_soft_duty_ticks(u32 period, u16 duty)
+{
+	return (u32) (((u64) period * duty + PWM_SOFT_DUTY_MAX / 2)
+		      / PWM_SOFT_DUTY_MAX);
+}
+
+/* rebuild the schedule from one duty per output */
+static inline void pwm_soft_sched_build(struct pwm_soft_sched *s, u32 period,
+					const u16 *duty, unsigned int count)
+{
+	struct pwm_soft_edge e;
+	unsigned int i, j;
+	u32 tick;
+
+	s->period = period;
+	s->start_mask = 0;
+	s->nedges = 0;
+
+	for (i = 0; i < count; i++) {
+		tick = pwm_soft_duty_ticks(period, duty[i]);
+
+		if (tick == 0)
+			continue;
+
+		s->start_mask |= (u64) 1 << i;
+
+		/* full on, never goes low */
+		if (tick >= period)
+			continue;
+
+		for (j = 0; j < s->nedges; j++) {
+			if (s->edge[j].tick == tick)
+				break;
+		}
+
+		if (j < s->nedges) {
+			s->edge[j].mask |= (u64) 1 << i;
+			continue;
+		}
+
+		/* insertion sort, count is small */
+		e.tick = tick;
+		e.mask = (u64) 1 << i;
+
+		for (j = s->nedges; j > 0 && s->edge[j - 1].tick > tick; j--)
+			s->edge[j] = s->edge[j - 1];
+
+		s->edge[j] = e;
+		s->nedges++;
+	}
+}
+
+/*
+ * Returns the outputs whose edges are due at 'now' and advances
+ * *cursor past them.
+ */
+static inline u64 pwm_soft_sched_due(const struct pwm_soft_sched *s,
+				     unsigned int *cursor, u32 now)
+{
+	u64 mask = 0;
+
+	while (*cursor < s->nedges && s->edge[*cursor].tick <= now) {
+		mask |= s->edge[*cursor].mask;
+		(*cursor)++;
+	}
+
+	return mask;
+}
+
+#endif /* ifndef PWM_SOFT_SCHED_H */
@@ -0,0 +1,442 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Frequency sweeps and chirps. The overflow interrupt moves the timer to
+ the next frequency every period: the TLDR written now is loaded at the
+ next reload, and TMAR for the period that just started is set from the
+ TLDR it started with, so the duty ratio holds and the counter is never
+ reset. Linear sweeps interpolate the frequency, logarithmic ones use a
+ fixed point 2^x.
+
+ Controlled with the PWM_SWEEP_* ioctls on /dev/pwmN, see pwm_ioctl.h.
+*/
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/errno.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/uaccess.h>
+
+#include "pwm_core.h"
+
+/* frequencies are Hz << 8, sweep progress is Q24 */
+#define SWEEP_FSHIFT	8
+#define SWEEP_PSHIFT	24
+
+/* 2^(i / 64) << 16, i = 0 to 64 */
+static const u32 pwm_sweep_exp2[65] = {
+	 65536,  66250,  66971,  67700,  68438,  69183,  69936,  70698,
+	 71468,  72246,  73032,  73828,  74632,  75444,  76266,  77096,
+	 77936,  78785,  79642,  80510,  81386,  82273,  83169,  84074,
+	 84990,  85915,  86851,  87796,  88752,  89719,  90696,  91684,
+	 92682,  93691,  94711,  95743,  96785,  97839,  98905,  99982,
+	101070, 102171, 103283, 104408, 105545, 106694, 107856, 109031,
+	110218, 111418, 112631, 113858, 115098, 116351, 117618, 118899,
+	120194, 121502, 122825, 124163, 125515, 126882, 128263, 129660,
+	131072,
+};
+
+struct pwm_sweep {
+	struct list_head list;
+	struct pwm_dev *pwm;
+
+	u64 from;		/* Hz << 8, of the current sweep */
+	u64 to;
+	s32 log2_ratio;		/* log2(to / from) << 16, PWM_SWEEP_LOG */
+	u64 total;		/* ticks per sweep */
+	u64 elapsed;		/* ticks into the current sweep */
+	u32 duty;
+	u32 flags;
+	u32 cycles;		/* 0 for no limit */
+	u32 sweeps;
+	u32 late;
+
+	u64 freq;		/* of the TLDR written last */
+	u32 next_period;	/* ticks, loaded at the next overflow */
+	int done;		/* next_period is the last one */
+};
+
+static LIST_HEAD(pwm_sweep_list);
+static DEFINE_MUTEX(pwm_sweep_lock);
+
+/* x << 16 to 2^x << 16, x may be negative */
+static u64 pwm_sweep_pow2(u64 base, s64 x)
+{
+	s64 n = x >> 16;
+	u32 frac = x & 0xFFFF;
+	u32 i = frac >> 10, rem = frac & 1023;
+	u32 a = pwm_sweep_exp2[i], b = pwm_sweep_exp2[i + 1];
+	u64 v = (base * (a + (((b - a) * rem) >> 10))) >> 16;
+
+	return n >= 0 ? v << n : v >> -n;
+}
+
+/* log2(num / den) << 16, process context */
+static s32 pwm_sweep_log2(u64 num, u64 den)
+{
+	u64 x = div64_u64(num << 16, den);
+	s32 n = 0;
+	u32 i;
+
+	while (x >= 2 << 16) {
+		x >>= 1;
+		n++;
+	}
+	while (x < 1 << 16) {
+		x <<= 1;
+		n--;
+	}
+
+	for (i = 0; i < 63 && pwm_sweep_exp2[i + 1] <= x; i++)
+		;
+
+	return n * 65536 + i * 1024
+	    + div_u64((u64)(x - pwm_sweep_exp2[i]) * 1024,
+		      pwm_sweep_exp2[i + 1] - pwm_sweep_exp2[i]);
+}
+
+/* frequency elapsed ticks into the sweep, the end one once past it */
+static u64 pwm_sweep_law(const struct pwm_sweep *s)
+{
+	u64 p = div64_u64(s->elapsed << SWEEP_PSHIFT, s->total);
+	s64 span = (s64)s->to - (s64)s->from;
+
+	if (p > 1 << SWEEP_PSHIFT)
+		p = 1 << SWEEP_PSHIFT;
+
+	if (s->flags & PWM_SWEEP_LOG)
+		return pwm_sweep_pow2(s->from,
+				      ((s64)s->log2_ratio * p) >> SWEEP_PSHIFT);
+
+	return s->from + ((span * (s64)p) >> SWEEP_PSHIFT);
+}
+
+static u32 pwm_sweep_period(struct pwm_dev *dev, u64 freq)
+{
+	u64 period = div64_u64((u64)dev->gpt.input_freq << SWEEP_FSHIFT, freq);
+
+	return clamp_t(u64, period, 2, 0xFFFFFFFF);
+}
+
+static u32 pwm_sweep_on(const struct pwm_sweep *s, u32 period)
+{
+	u32 on = ((u64)period * s->duty) >> 16;
+
+	return clamp_t(u32, on, 1, period - 1);
+}
+
+/*
+ * TMAR for the period that just started. The old match counts as seen
+ * only if this period could reach it, the write has to leave that as it
+ * is or the output inverts.
+ */
+static int pwm_sweep_tmar_ok(struct pwm_dev *dev, u32 tmar)
+{
+	u32 now = pwm_reg_read(dev, GPT_TCRR);
+	int seen = dev->gpt.tmar >= dev->gpt.tldr && now >= dev->gpt.tmar;
+
+	return seen == (now >= tmar);
+}
+
+static void pwm_sweep_end(struct pwm_sweep *s)
+{
+	u64 tmp;
+
+	s->sweeps++;
+
+	if (s->cycles && s->sweeps >= s->cycles) {
+		s->freq = s->to;
+		s->done = 1;
+		return;
+	}
+
+	s->elapsed -= s->total;
+
+	if (s->flags & PWM_SWEEP_PINGPONG) {
+		tmp = s->from;
+		s->from = s->to;
+		s->to = tmp;
+		s->log2_ratio = -s->log2_ratio;
+	}
+}
+
+static void pwm_sweep_irq(struct pwm_dev *dev, void *data, u32 status)
+{
+	struct pwm_sweep *s = data;
+	u32 period, tmar;
+
+	if (!(status & GPT_IRQ_OVF))
+		return;
+
+	/* the counter just reloaded with the TLDR written last time */
+	period = s->next_period;
+	dev->gpt.tldr = 0xFFFFFFFF - period + 1;
+	dev->gpt.num_freqs = 0xFFFFFFFE - dev->gpt.tldr;
+	dev->frequency = s->freq >> SWEEP_FSHIFT;
+
+	tmar = dev->gpt.tldr + pwm_sweep_on(s, period);
+	if (pwm_sweep_tmar_ok(dev, tmar)) {
+		dev->gpt.tmar = tmar;
+		pwm_reg_write(dev, GPT_TMAR, tmar);
+	} else {
+		s->late++;
+	}
+	pwm_publish(dev);
+
+	if (s->done) {
+		/* holding the end frequency, nothing left to do */
+		pwm_reg_write(dev, GPT_TIER, 0);
+		return;
+	}
+
+	s->elapsed += period;
+	if (s->elapsed >= s->total)
+		pwm_sweep_end(s);
+
+	if (!s->done)
+		s->freq = pwm_sweep_law(s);
+
+	s->next_period = pwm_sweep_period(dev, s->freq);
+	pwm_reg_write(dev, GPT_TLDR, 0xFFFFFFFF - s->next_period + 1);
+}
+
+static void pwm_sweep_stop(struct pwm_dev *dev, void *data)
+{
+	kfree(data);
+}
+
+static const struct pwm_mode pwm_sweep_mode = {
+	.name = "sweep",
+	.irq_events = GPT_IRQ_OVF,
+	.irq = pwm_sweep_irq,
+	.stop = pwm_sweep_stop,
+};
+
+static struct pwm_sweep *pwm_sweep_find(struct pwm_dev *dev)
+{
+	struct pwm_sweep *s;
+
+	list_for_each_entry(s, &pwm_sweep_list, list) {
+		if (s->pwm == dev)
+			return s;
+	}
+
+	return NULL;
+}
+
+static int pwm_sweep_start(struct pwm_dev *dev, struct pwm_sweep_config *cfg)
+{
+	struct pwm_sweep *s;
+	unsigned long flags;
+	u64 total;
+	u32 period;
+	int error, fresh = 0;
+
+	if (!cfg->start || !cfg->end || !cfg->duration_ms
+	    || cfg->duty > PWM_SWEEP_DUTY_MAX)
+		return -EINVAL;
+
+	if (dev->gpt.input_freq / cfg->start < 2
+	    || dev->gpt.input_freq / cfg->end < 2)
+		return -EINVAL;
+
+	/*
+	 * A sweep ends at most a period late and the next one starts that
+	 * far in, it has to be longer than the longest period for that.
+	 */
+	total = div_u64((u64)cfg->duration_ms * dev->gpt.input_freq, 1000);
+	if (total < dev->gpt.input_freq / min(cfg->start, cfg->end))
+		return -EINVAL;
+
+	s = pwm_sweep_find(dev);
+	if (!s) {
+		s = kzalloc(sizeof(*s), GFP_KERNEL);
+		if (!s)
+			return -ENOMEM;
+
+		s->pwm = dev;
+
+		error = pwm_mode_attach(dev, &pwm_sweep_mode, s);
+		if (error) {
+			kfree(s);
+			return error;
+		}
+
+		list_add(&s->list, &pwm_sweep_list);
+		fresh = 1;
+	}
+
+	spin_lock_irqsave(&dev->lock, flags);
+
+	s->from = (u64)cfg->start << SWEEP_FSHIFT;
+	s->to = (u64)cfg->end << SWEEP_FSHIFT;
+	s->log2_ratio = pwm_sweep_log2(s->to, s->from);
+	s->total = total;
+	s->elapsed = 0;
+	s->duty = cfg->duty;
+	s->flags = cfg->flags;
+	s->cycles = cfg->cycles;
+	s->sweeps = 0;
+	s->late = 0;
+	s->done = 0;
+
+	if (dev->gpt.tclr & GPT_TCLR_ST) {
+		/*
+		 * Glide in, the first interrupt writes the start period.
+		 * A running sweep has already written the next TLDR.
+		 */
+		if (fresh) {
+			s->next_period = 0xFFFFFFFF - dev->gpt.tldr + 1;
+			s->freq = (u64)dev->frequency << SWEEP_FSHIFT;
+		}
+		s->elapsed = -(u64)s->next_period;
+	} else {
+		s->freq = s->from;
+		period = pwm_sweep_period(dev, s->from);
+		s->next_period = period;
+		dev->gpt.tldr = 0xFFFFFFFF - period + 1;
+		dev->gpt.num_freqs = 0xFFFFFFFE - dev->gpt.tldr;
+		dev->gpt.tmar = dev->gpt.tldr + pwm_sweep_on(s, period);
+		dev->frequency = cfg->start;
+		dev->gpt.tclr = DEFAULT_TCLR | (dev->gpt.tclr & GPT_TCLR_SCPWM);
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+		pwm_reg_write(dev, GPT_TLDR, dev->gpt.tldr);
+		pwm_reg_write(dev, GPT_TCRR, dev->gpt.tldr);
+		pwm_reg_write(dev, GPT_TMAR, dev->gpt.tmar);
+		dev->gpt.tclr |= GPT_TCLR_ST;
+		pwm_reg_write(dev, GPT_TCLR, dev->gpt.tclr);
+	}
+
+	pwm_publish(dev);
+	pwm_reg_write(dev, GPT_TIER, GPT_IRQ_OVF);
+
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return 0;
+}
+
+static void pwm_sweep_status(struct pwm_sweep *s, struct pwm_sweep_status *st)
+{
+	struct pwm_dev *dev = s->pwm;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	st->frequency = div_u64((u64)dev->gpt.input_freq * 1000,
+				0xFFFFFFFF - dev->gpt.tldr + 1);
+	st->elapsed_ms = s->done || (s64)s->elapsed < 0 ? 0
+	    : div_u64(s->elapsed * 1000, dev->gpt.input_freq);
+	st->sweeps = s->sweeps;
+	st->late = s->late;
+	st->running = !s->done;
+	spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+static void pwm_sweep_release(struct pwm_sweep *s)
+{
+	list_del(&s->list);
+	pwm_mode_detach(s->pwm, &pwm_sweep_mode);
+}
+
+static long pwm_sweep_ioctl(struct pwm_dev *dev, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct pwm_sweep_config cfg;
+	struct pwm_sweep_status st;
+	struct pwm_sweep *s;
+	long retval = 0;
+
+	mutex_lock(&pwm_sweep_lock);
+
+	switch (cmd) {
+	case PWM_SWEEP_START:
+		if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+			retval = -EFAULT;
+		else
+			retval = pwm_sweep_start(dev, &cfg);
+		break;
+
+	case PWM_SWEEP_STOP:
+		s = pwm_sweep_find(dev);
+		if (!s)
+			retval = -ENODEV;
+		else
+			pwm_sweep_release(s);
+		break;
+
+	case PWM_SWEEP_STATUS:
+		s = pwm_sweep_find(dev);
+		if (!s) {
+			retval = -ENODEV;
+			break;
+		}
+
+		pwm_sweep_status(s, &st);
+		if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+			retval = -EFAULT;
+		break;
+
+	default:
+		retval = -ENOTTY;
+	}
+
+	mutex_unlock(&pwm_sweep_lock);
+
+	return retval;
+}
+
+static struct pwm_ioctl_ext pwm_sweep_ext = {
+	.owner = THIS_MODULE,
+	.nr_first = _IOC_NR(PWM_SWEEP_START),
+	.nr_last = _IOC_NR(PWM_SWEEP_STATUS),
+	.ioctl = pwm_sweep_ioctl,
+};
+
+static int __init pwm_sweep_init(void)
+{
+	return pwm_register_ioctl(&pwm_sweep_ext);
+}
+
+static void __exit pwm_sweep_exit(void)
+{
+	struct pwm_sweep *s, *next;
+
+	pwm_unregister_ioctl(&pwm_sweep_ext);
+
+	mutex_lock(&pwm_sweep_lock);
+	list_for_each_entry_safe(s, next, &pwm_sweep_list, list)
+		pwm_sweep_release(s);
+	mutex_unlock(&pwm_sweep_lock);
+}
+
+module_init(pwm_sweep_init);
+module_exit(pwm_sweep_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Frequency sweeps on OMAP3 GP timers");
@@ -0,0 +1,141 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Tracepoints for the pwm.c control path. Enable them with
+ echo 1 > /sys/kernel/debug/tracing/events/pwm/enable
+*/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pwm
+
+#if !defined(PWM_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define PWM_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(pwm_ioctl,
+	TP_PROTO(u32 timer, unsigned int cmd, unsigned long arg),
+	TP_ARGS(timer, cmd, arg),
+	TP_STRUCT__entry(
+		__field(u32, timer)
+		__field(unsigned int, cmd)
+		__field(unsigned long, arg)
+	),
+	TP_fast_assign(
+		__entry->timer = timer;
+		__entry->cmd = cmd;
+		__entry->arg = arg;
+	),
+	TP_printk("pwm%u nr=%u arg=%lu", __entry->timer,
+		  _IOC_NR(__entry->cmd), __entry->arg)
+);
+
+TRACE_EVENT(pwm_write,
+	TP_PROTO(u32 timer, int duty_cycle),
+	TP_ARGS(timer, duty_cycle),
+	TP_STRUCT__entry(
+		__field(u32, timer)
+		__field(int, duty_cycle)
+	),
+	TP_fast_assign(
+		__entry->timer = timer;
+		__entry->duty_cycle = duty_cycle;
+	),
+	TP_printk("pwm%u duty=%d", __entry->timer, __entry->duty_cycle)
+);
+
+TRACE_EVENT(pwm_set_duty_cycle,
+	TP_PROTO(u32 timer, int duty_cycle, u32 tldr, u32 tmar),
+	TP_ARGS(timer, duty_cycle, tldr, tmar),
+	TP_STRUCT__entry(
+		__field(u32, timer)
+		__field(int, duty_cycle)
+		__field(u32, tldr)
+		__field(u32, tmar)
+	),
+	TP_fast_assign(
+		__entry->timer = timer;
+		__entry->duty_cycle = duty_cycle;
+		__entry->tldr = tldr;
+		__entry->tmar = tmar;
+	),
+	TP_printk("pwm%u duty=%d tldr=0x%08x tmar=0x%08x", __entry->timer,
+		  __entry->duty_cycle, __entry->tldr, __entry->tmar)
+);
+
+TRACE_EVENT(pwm_set_frequency,
+	TP_PROTO(u32 timer, int frequency, u32 tldr),
+	TP_ARGS(timer, frequency, tldr),
+	TP_STRUCT__entry(
+		__field(u32, timer)
+		__field(int, frequency)
+		__field(u32, tldr)
+	),
+	TP_fast_assign(
+		__entry->timer = timer;
+		__entry->frequency = frequency;
+		__entry->tldr = tldr;
+	),
+	TP_printk("pwm%u freq=%d tldr=0x%08x", __entry->timer,
+		  __entry->frequency, __entry->tldr)
+);
+
+DECLARE_EVENT_CLASS(pwm_tclr,
+	TP_PROTO(u32 timer, u32 tclr, u32 tmar),
+	TP_ARGS(timer, tclr, tmar),
+	TP_STRUCT__entry(
+		__field(u32, timer)
+		__field(u32, tclr)
+		__field(u32, tmar)
+	),
+	TP_fast_assign(
+		__entry->timer = timer;
+		__entry->tclr = tclr;
+		__entry->tmar = tmar;
+	),
+	TP_printk("pwm%u tclr=0x%08x tmar=0x%08x", __entry->timer,
+		  __entry->tclr, __entry->tmar)
+);
+
+DEFINE_EVENT(pwm_tclr, pwm_on,
+	TP_PROTO(u32 timer, u32 tclr, u32 tmar),
+	TP_ARGS(timer, tclr, tmar)
+);
+
+DEFINE_EVENT(pwm_tclr, pwm_off,
+	TP_PROTO(u32 timer, u32 tclr, u32 tmar),
+	TP_ARGS(timer, tclr, tmar)
+);
+
+#endif /* if !defined(PWM_TRACE_H) || defined(TRACE_HEADER_MULTI_READ) */
+
+/* out of tree, so tell define_trace.h where to find us */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE pwm_trace
+#include <trace/define_trace.h>
@@ -12,12 +12,11 @@
 
 MODULE_DESCRIPTION("PWM-Speaker driver");
 MODULE_LICENSE("GPL");
-MODULE_SUPPORTED_DEVICE("{{PWM-Speaker, pwmsp}}");
 MODULE_ALIAS("platform:pwmspkr");
 
 static int index = SNDRV_DEFAULT_IDX1;	/* Index 0-MAX */
 static char *id = SNDRV_DEFAULT_STR1;	/* ID for this card */
-static int enable = SNDRV_DEFAULT_ENABLE1;	/* Enable this card */
+static bool enable = SNDRV_DEFAULT_ENABLE1;	/* Enable this card */
 
 module_param(index, int, 0444);
 MODULE_PARM_DESC(index, "Index value for pwmsp soundcard.");
@@ -28,7 +27,7 @@ MODULE_PARM_DESC(enable, "Enable PWM-Speaker sound.");
 
 struct snd_pwmsp pwmsp_chip;
 
-static int __devinit snd_pwmsp_create(struct snd_card *card)
+static int snd_pwmsp_create(struct snd_card *card)
 {
 	static struct snd_device_ops ops = { };
 //      struct timespec tp;
@@ -46,6 +45,8 @@ static int __devinit snd_pwmsp_create(struct snd_card *card)
 	pwmsp_chip.enable = 1;
 
 	spin_lock_init(&pwmsp_chip.substream_lock);
+	spin_lock_init(&pwmsp_chip.beep_lock);
+	pwmsp_chip.beep_hz = 0;
 
 	pwmsp_chip.card = card;
 	pwmsp_chip.port = 0x61;	//what?
@@ -60,7 +61,7 @@ static int __devinit snd_pwmsp_create(struct snd_card *card)
 	return 0;
 }
 
-static int __devinit snd_card_pwmsp_probe(int devnum, struct device *dev)
+static int snd_card_pwmsp_probe(int devnum, struct device *dev)
 {
 	struct snd_card *card;
 	int err;
@@ -68,9 +69,9 @@ static int __devinit snd_card_pwmsp_probe(int devnum, struct device *dev)
 	if (devnum != 0)
 		return -EINVAL;
 
-	snd_card_create(index, id, THIS_MODULE, 0,&card);
-	if (!card)
-		return -ENOMEM;
+	err = snd_card_new(dev, index, id, THIS_MODULE, 0, &card);
+	if (err < 0)
+		return err;
 
 	err = snd_pwmsp_create(card);
 	if (err < 0) {
@@ -82,7 +83,6 @@ static int __devinit snd_card_pwmsp_probe(int devnum, struct device *dev)
 		snd_card_free(card);
 		return err;
 	}
-	snd_card_set_dev(pwmsp_chip.card, dev);
 
 	strcpy(card->driver, "PWM-Speaker");
 	strcpy(card->shortname, "pwmsp");
@@ -98,7 +98,7 @@ static int __devinit snd_card_pwmsp_probe(int devnum, struct device *dev)
 	return 0;
 }
 
-static int __devinit alsa_card_pwmsp_init(struct device *dev)
+static int alsa_card_pwmsp_init(struct device *dev)
 {
 	int err;
 
@@ -116,34 +116,35 @@ static int __devinit alsa_card_pwmsp_init(struct device *dev)
 	return 0;
 }
 
-static void __devexit alsa_card_pwmsp_exit(struct snd_pwmsp *chip)
+static void alsa_card_pwmsp_exit(struct snd_pwmsp *chip)
 {
 	snd_card_free(chip->card);
 }
 
-static int __devinit pwmsp_probe(struct platform_device *dev)
+static int pwmsp_probe(struct platform_device *dev)
 {
 	int err;
 
-	/*err = pwmspkr_input_init(&pwmsp_chip.input_dev, &dev->dev);
-	   if (err < 0)
-	   return err; */
-
+	/* the card sets up the locks the beeper shares with the pcm */
 	err = alsa_card_pwmsp_init(&dev->dev);
-	/*if (err < 0) {
-	   pwmspkr_input_remove(pwmsp_chip.input_dev);
-	   return err;
-	   } */
+	if (err < 0)
+		return err;
+
+	err = pwmspkr_input_init(&pwmsp_chip, &dev->dev);
+	if (err < 0) {
+		snd_card_free(pwmsp_chip.card);
+		return err;
+	}
 
 	platform_set_drvdata(dev, &pwmsp_chip);
 	return 0;
 }
 
-static int __devexit pwmsp_remove(struct platform_device *dev)
+static int pwmsp_remove(struct platform_device *dev)
 {
 	struct snd_pwmsp *chip = platform_get_drvdata(dev);
+	pwmspkr_input_remove(chip);
 	alsa_card_pwmsp_exit(chip);
-//      pwmspkr_input_remove(chip->input_dev);
 	platform_set_drvdata(dev, NULL);
 	return 0;
 }
@@ -151,7 +152,7 @@ static int __devexit pwmsp_remove(struct platform_device *dev)
 static void pwmsp_stop_beep(struct snd_pwmsp *chip)
 {
 	pwmsp_sync_stop(chip);
-	//pwmspkr_stop_sound();
+	pwmspkr_stop_sound(chip);
 }
 
 #ifdef CONFIG_PM
@@ -178,7 +179,7 @@ static struct platform_driver pwmsp_platform_driver = {
 		   .owner = THIS_MODULE,
 		   },
 	.probe = pwmsp_probe,
-	.remove = __devexit_p(pwmsp_remove),
+	.remove = pwmsp_remove,
 	.suspend = pwmsp_suspend,
 	.shutdown = pwmsp_shutdown,
 };
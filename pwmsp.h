@@ -1,5 +1,6 @@
 #ifndef __PWMSP_H__
 #define __PWMSP_H__
+#include "pwmsp_conv.h"
 #define PWMSP_SOUND_VERSION 0x100	/* read 1.00 */
 #define PWMSP_DEBUG 0
 #define PWMSP_MAX_TREBLE 1
@@ -8,16 +9,22 @@
 #define PWMSP_MAX_PERIOD_SIZE	(64*1024)
 #define PWMSP_MAX_PERIODS	512
 #define PWMSP_BUFFER_SIZE	(128*1024)
-#define DATA_BITS	256
-#define BASE_CLOCK 	(DATA_BITS*8192)	//256*8khz
 #define SLEEP_TIME	(DATA_BITS*1000/BASE_CLOCK)	//milliseconds
+#define PWMSP_TIMER	9	/* GPT driving the speaker */
 /*defines for ioctl()*/
-#include "pwm.h"
+#include <linux/workqueue.h>
+#include "pwm_core.h"
 struct snd_pwmsp {
 	struct snd_card *card;
 	struct snd_pcm *pcm;
 	struct input_dev *input_dev;
 	//int fd;
+	struct pwm_dev *pwm;	/* PWMSP_TIMER, see pwmsp_pwm_get() */
+	spinlock_t beep_lock;	/* pwm, beep_hz and the start of playback */
+	unsigned int beep_hz;	/* tone sounding, 0 for none */
+	unsigned int input_hz;	/* last EV_SND tone, for input_work */
+	struct work_struct input_work;	/* claims and releases for the beeper */
+	int input_claimed;	/* input_work holds PWMSP_TIMER */
 	unsigned short port, irq, dma;
 	spinlock_t substream_lock;
 	struct snd_pcm_substream *playback_substream;
@@ -34,8 +41,10 @@ struct snd_pwmsp {
 extern struct snd_pwmsp pwmsp_chip;
 extern void pwmsp_sync_stop(struct snd_pwmsp *chip);
 extern int snd_pwmsp_new_pcm(struct snd_pwmsp *chip);
-extern struct pwm_dev *pwm_devs;
-extern int set_pwm_frequency(struct pwm_dev *, int);
-extern int set_duty_cycle(struct pwm_dev *, int);
-extern int pwm_off(struct pwm_dev *);
+extern int pwmsp_pwm_get(struct snd_pwmsp *chip);
+extern void pwmsp_pwm_put(struct snd_pwmsp *chip);
+extern int pwmsp_beep(struct snd_pwmsp *chip, unsigned int hz);
+extern int pwmspkr_input_init(struct snd_pwmsp *chip, struct device *dev);
+extern void pwmspkr_input_remove(struct snd_pwmsp *chip);
+extern void pwmspkr_stop_sound(struct snd_pwmsp *chip);
 #endif
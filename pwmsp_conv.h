@@ -0,0 +1,85 @@
+/*
+ Copyright (c) 2010, Scott Ellis
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright
+	  notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+	* Neither the name of the <organization> nor the
+	  names of its contributors may be used to endorse or promote products
+	  derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY Scott Ellis ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL Scott Ellis BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  
+
+ Sample to timer conversion of the pwmsp speaker. Plain C so the same
+ code runs in pwmsp_lib.c and in tools/pwmsp_render.c on the host.
+
+ pwmsp plays every sample as one duty cycle of a carrier at BASE_CLOCK,
+ through pwm_channel_config(). pwmsp_conv_tldr() and pwmsp_conv_tmar()
+ are what that call leaves in the registers, pwm.c computes them with
+ the same pwm_conv.h.
+*/
+
+#ifndef PWMSP_CONV_H
+#define PWMSP_CONV_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint8_t u8;
+#endif
+
+#include "pwm_conv.h"
+
+#define DATA_BITS	256
+#define BASE_CLOCK 	(DATA_BITS*8192)	//256*8khz
+
+/*
+ * Duty in percent for the sample at p. Only the most significant byte
+ * is used, anything below it is finer than the timer can do at
+ * BASE_CLOCK anyway. Little endian, signed formats are offset binary.
+ */
+static inline int pwmsp_conv_duty(const u8 *p, unsigned int fmt_size,
+				  unsigned int is_signed)
+{
+	int val = p[fmt_size - 1];
+
+	if (is_signed)
+		val ^= 0x80;
+
+	return val * 100 / 256;
+}
+
+/* the frequency the timer really runs at for a requested one */
+static inline int pwmsp_conv_frequency(u32 input_freq, int frequency)
+{
+	return pwm_conv_frequency(input_freq, frequency);
+}
+
+static inline u32 pwmsp_conv_tldr(u32 input_freq, int frequency)
+{
+	return pwm_conv_tldr(input_freq, frequency);
+}
+
+/* 0 for a zero duty, the channel is stopped then and TMAR left alone */
+static inline u32 pwmsp_conv_tmar(u32 tldr, int duty_cycle)
+{
+	return pwm_conv_tmar(tldr, duty_cycle);
+}
+
+#endif /* ifndef PWMSP_CONV_H */
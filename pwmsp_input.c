@@ -0,0 +1,141 @@
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/input.h>
+#include "pwmsp.h"
+
+/*
+ * Claims PWMSP_TIMER for the first tone and hands it back once the
+ * tone is off. The VT keyboard handler keeps every EV_SND device open,
+ * claiming at open would take GPT9 from /dev/pwm9 for good.
+ */
+static void pwmspkr_input_work(struct work_struct *work)
+{
+	struct snd_pwmsp *chip = container_of(work, struct snd_pwmsp,
+					      input_work);
+	unsigned int hz = READ_ONCE(chip->input_hz);
+
+	if (hz && !chip->input_claimed) {
+		/* /dev/pwm9 or another user has it, no beep then */
+		if (pwmsp_pwm_get(chip))
+			return;
+		chip->input_claimed = 1;
+	}
+
+	if (!chip->input_claimed)
+		return;
+
+	/* dropped while the pcm is playing */
+	pwmsp_beep(chip, hz);
+
+	if (!hz) {
+		pwmsp_pwm_put(chip);
+		chip->input_claimed = 0;
+	}
+}
+
+static void pwmspkr_input_release(struct snd_pwmsp *chip)
+{
+	WRITE_ONCE(chip->input_hz, 0);
+	cancel_work_sync(&chip->input_work);
+
+	if (chip->input_claimed) {
+		pwmsp_beep(chip, 0);
+		pwmsp_pwm_put(chip);
+		chip->input_claimed = 0;
+	}
+}
+
+/*
+ * Beeps from the console and EV_SND writes, in any context. The tone
+ * goes to pwmspkr_input_work(), which claims the timer if need be and
+ * writes it through pwmsp_beep(), no ALSA and no allocation.
+ */
+static int pwmspkr_input_event(struct input_dev *dev, unsigned int type,
+			       unsigned int code, int value)
+{
+	struct snd_pwmsp *chip = input_get_drvdata(dev);
+
+	if (type != EV_SND)
+		return -1;
+
+	switch (code) {
+	case SND_BELL:
+		if (value)
+			value = 1000;
+	case SND_TONE:
+		break;
+	default:
+		return -1;
+	}
+
+	/* same range as the pc speaker, anything else is silence */
+	if (value < 20 || value > 32767)
+		value = 0;
+
+	WRITE_ONCE(chip->input_hz, value);
+	schedule_work(&chip->input_work);
+
+	return 0;
+}
+
+static void pwmspkr_input_close(struct input_dev *dev)
+{
+	pwmspkr_input_release(input_get_drvdata(dev));
+}
+
+int pwmspkr_input_init(struct snd_pwmsp *chip, struct device *dev)
+{
+	struct input_dev *input_dev;
+	int err;
+
+	input_dev = input_allocate_device();
+	if (!input_dev)
+		return -ENOMEM;
+
+	input_dev->name = "PWM-Speaker";
+	input_dev->phys = "pwmsp/input0";
+	input_dev->id.bustype = BUS_HOST;
+	input_dev->id.version = PWMSP_SOUND_VERSION;
+	input_dev->dev.parent = dev;
+
+	input_dev->evbit[0] = BIT_MASK(EV_SND);
+	input_dev->sndbit[0] = BIT_MASK(SND_BELL) | BIT_MASK(SND_TONE);
+
+	input_dev->event = pwmspkr_input_event;
+	input_dev->close = pwmspkr_input_close;
+	input_set_drvdata(input_dev, chip);
+
+	INIT_WORK(&chip->input_work, pwmspkr_input_work);
+	chip->input_claimed = 0;
+
+	err = input_register_device(input_dev);
+	if (err) {
+		input_free_device(input_dev);
+		return err;
+	}
+
+	chip->input_dev = input_dev;
+	return 0;
+}
+
+void pwmspkr_input_remove(struct snd_pwmsp *chip)
+{
+	/* closes the device if a handler still has it open */
+	input_unregister_device(chip->input_dev);
+	chip->input_dev = NULL;
+	pwmspkr_input_release(chip);
+}
+
+void pwmspkr_stop_sound(struct snd_pwmsp *chip)
+{
+	pwmsp_beep(chip, 0);
+
+	/* and hand the timer back */
+	WRITE_ONCE(chip->input_hz, 0);
+	schedule_work(&chip->input_work);
+}
+
+MODULE_LICENSE("GPL");
+EXPORT_SYMBOL(pwmspkr_input_init);
+EXPORT_SYMBOL(pwmspkr_input_remove);
+EXPORT_SYMBOL(pwmspkr_stop_sound);
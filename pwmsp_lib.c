@@ -5,22 +5,134 @@
 #include <sound/pcm.h>
 #include <asm/io.h>
 #include <linux/delay.h>
+#include <linux/err.h>
+#include <linux/mutex.h>
 #include "pwmsp.h"
 
+static DEFINE_MUTEX(pwmsp_pwm_lock);
+static int pwmsp_pwm_users;
+
+/*
+ * The pcm and the beeper share PWMSP_TIMER. The pcm holds it while it
+ * is open, the beeper while a tone sounds, and the last of them to let
+ * go hands it back to /dev/pwm9.
+ */
+int pwmsp_pwm_get(struct snd_pwmsp *chip)
+{
+	struct pwm_dev *pwm;
+	int err = 0;
+
+	mutex_lock(&pwmsp_pwm_lock);
+
+	if (pwmsp_pwm_users == 0) {
+		pwm = pwm_channel_request(PWMSP_TIMER, "pwmsp");
+		if (IS_ERR(pwm)) {
+			err = PTR_ERR(pwm);
+			goto get_done;
+		}
+
+		spin_lock_irq(&chip->beep_lock);
+		chip->pwm = pwm;
+		spin_unlock_irq(&chip->beep_lock);
+	}
+
+	pwmsp_pwm_users++;
+
+      get_done:
+	mutex_unlock(&pwmsp_pwm_lock);
+
+	return err;
+}
+
+void pwmsp_pwm_put(struct snd_pwmsp *chip)
+{
+	struct pwm_dev *pwm = NULL;
+
+	mutex_lock(&pwmsp_pwm_lock);
+
+	if (--pwmsp_pwm_users == 0) {
+		spin_lock_irq(&chip->beep_lock);
+		pwm = chip->pwm;
+		chip->pwm = NULL;
+		chip->beep_hz = 0;
+		spin_unlock_irq(&chip->beep_lock);
+	}
+
+	mutex_unlock(&pwmsp_pwm_lock);
+
+	if (pwm)
+		pwm_channel_free(pwm);
+}
+
+/*
+ * Stops the counter, then writes TCLR again with the counter stopped,
+ * which puts the pin back to its SCPWM level. Clearing ST alone leaves
+ * the pin wherever the last toggle put it, DC through the speaker.
+ */
+static void pwmsp_quiet(struct pwm_dev *pwm)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pwm->lock, flags);
+	pwm->gpt.tclr &= ~GPT_TCLR_ST;
+	pwm_reg_write(pwm, GPT_TCLR, pwm->gpt.tclr);
+	pwm_reg_write(pwm, GPT_TCLR, pwm->gpt.tclr);
+	spin_unlock_irqrestore(&pwm->lock, flags);
+}
+
+/*
+ * Square wave at hz for the input device, 0 silences it. Runs from the
+ * input event path, often with irqs off, so it only touches registers.
+ * A playing pcm stream owns the speaker and tones are dropped.
+ */
+int pwmsp_beep(struct snd_pwmsp *chip, unsigned int hz)
+{
+	unsigned long flags;
+	int err = 0;
+
+	spin_lock_irqsave(&chip->beep_lock, flags);
+
+	if (!chip->pwm || atomic_read(&chip->active)) {
+		err = -EBUSY;
+	} else if (hz) {
+		err = pwm_channel_config(chip->pwm, hz, 50);
+		if (!err) {
+			pwm_channel_enable(chip->pwm);
+			chip->beep_hz = hz;
+		}
+	} else if (chip->beep_hz) {
+		pwmsp_quiet(chip->pwm);
+		chip->beep_hz = 0;
+	}
+
+	spin_unlock_irqrestore(&chip->beep_lock, flags);
+
+	return err;
+}
+
 static int pwmsp_start_playing(struct snd_pwmsp *chip)
 {
 //      unsigned long ns;
 	struct snd_pcm_substream *substream;
 	struct snd_pcm_runtime *runtime;
-	int duty_cycle, sleep_time, val;
+	struct pwm_dev *pwm = chip->pwm;
+	int duty_cycle, sleep_time;
+	unsigned long flags;
 #if PWMSP_DEBUG
 	printk(KERN_INFO "pwmsp: start_playing called\n");
 #endif
+	if (!pwm)
+		return -ENODEV;
+	spin_lock_irqsave(&chip->beep_lock, flags);
 	if (atomic_read(&chip->active)) {
+		spin_unlock_irqrestore(&chip->beep_lock, flags);
 		printk(KERN_ERR "PWMSP: Timer already active\n");
 		return -EIO;
 	}
+	/* the stream wins, a tone still sounding is cut off by it */
 	atomic_set(&chip->active, 1);
+	chip->beep_hz = 0;
+	spin_unlock_irqrestore(&chip->beep_lock, flags);
 	substream = chip->playback_substream;
 	if (!substream)
 		return 0;
@@ -29,19 +141,18 @@ static int pwmsp_start_playing(struct snd_pwmsp *chip)
 	sleep_time = SLEEP_TIME;
 	/* assume it is mono! */
 	while (chip->playback_ptr != runtime->dma_bytes) {
-		val = runtime->dma_area[chip->playback_ptr];
-		duty_cycle = val * 100 / 256;
-		if (set_pwm_frequency(pwm_devs, BASE_CLOCK) == -1)
+		duty_cycle = pwmsp_conv_duty(runtime->dma_area
+					     + chip->playback_ptr,
+					     chip->fmt_size, chip->is_signed);
+		if (pwm_channel_config(pwm, BASE_CLOCK, duty_cycle))
 			return -EIO;
 
-		if (set_duty_cycle(pwm_devs, duty_cycle) == -1)
-			return -EIO;
+		pwm_channel_enable(pwm);
 		msleep(sleep_time);
-		chip->playback_ptr += sizeof(char);
+		chip->playback_ptr += chip->fmt_size;
 	}
 
-	if (pwm_off(pwm_devs) == -1)
-		return -EIO;
+	pwm_channel_disable(pwm);
 
 	atomic_set(&chip->active, 0);
 	return 0;
@@ -49,12 +160,16 @@ static int pwmsp_start_playing(struct snd_pwmsp *chip)
 
 static int pwmsp_stop_playing(struct snd_pwmsp *chip)
 {
+	struct pwm_dev *pwm = chip->pwm;
 #if PWMSP_DEBUG
 	printk(KERN_INFO "pwmsp: stop_playing called\n");
 #endif
 
-	if (pwm_off(pwm_devs) == -1)
-		return -EIO;
+	if (!pwm)
+		return -ENODEV;
+
+	/* may be called with irqs off, see pwmsp_sync_stop() */
+	pwm_channel_disable(pwm);
 
 	atomic_set(&chip->active, 0);
 	return 0;
@@ -78,6 +193,7 @@ static int snd_pwmsp_playback_close(struct snd_pcm_substream *substream)
 #endif
 	pwmsp_sync_stop(chip);
 	chip->playback_substream = NULL;
+	pwmsp_pwm_put(chip);
 	//close(chip->fd);
 	return 0;
 }
@@ -179,6 +295,7 @@ static int snd_pwmsp_playback_open(struct snd_pcm_substream *substream)
 {
 	struct snd_pwmsp *chip = snd_pcm_substream_chip(substream);
 	struct snd_pcm_runtime *runtime = substream->runtime;
+	int err;
 #if PWMSP_DEBUG
 	printk(KERN_INFO "pwmsp: open called\n");
 #endif
@@ -187,6 +304,9 @@ static int snd_pwmsp_playback_open(struct snd_pcm_substream *substream)
 		printk(KERN_ERR "pwmsp: still active!!\n");
 		return -EBUSY;
 	}
+	err = pwmsp_pwm_get(chip);
+	if (err)
+		return err;
 	runtime->hw = snd_pwmsp_playback;
 	chip->playback_substream = substream;
 	return 0;
@@ -203,7 +323,7 @@ static struct snd_pcm_ops snd_pwmsp_playback_ops = {
 	.pointer = snd_pwmsp_playback_pointer,
 };
 
-int __devinit snd_pwmsp_new_pcm(struct snd_pwmsp *chip)
+int snd_pwmsp_new_pcm(struct snd_pwmsp *chip)
 {
 	int err;
 	printk(KERN_ALERT "210 \n");
@@ -220,8 +340,7 @@ int __devinit snd_pwmsp_new_pcm(struct snd_pwmsp *chip)
 	printk(KERN_ALERT "ping \n");
 	snd_pcm_lib_preallocate_pages_for_all(chip->pcm,
 					      SNDRV_DMA_TYPE_CONTINUOUS,
-					      snd_dma_continuous_data
-					      (GFP_KERNEL), PWMSP_BUFFER_SIZE,
+					      NULL, PWMSP_BUFFER_SIZE,
 					      PWMSP_BUFFER_SIZE);
 	printk(KERN_ALERT "ping2 \n");
 	return 0;
@@ -231,3 +350,6 @@ int __devinit snd_pwmsp_new_pcm(struct snd_pwmsp *chip)
 MODULE_LICENSE("GPL");
 EXPORT_SYMBOL(pwmsp_sync_stop);
 EXPORT_SYMBOL(snd_pwmsp_new_pcm);
+EXPORT_SYMBOL(pwmsp_pwm_get);
+EXPORT_SYMBOL(pwmsp_pwm_put);
+EXPORT_SYMBOL(pwmsp_beep);
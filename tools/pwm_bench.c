@@ -0,0 +1,361 @@
+/*
+ * Throughput and latency of the /dev/pwmN control interfaces.
+ *
+ * Every interface (ASCII write and read, each ioctl) is run in three
+ * scenarios: one worker on one channel, N workers on the same channel
+ * and N workers spread over all given channels. Workers are threads, or
+ * processes with -P, and each opens its own file descriptor.
+ *
+ * One JSON object is printed per interface and scenario.
+ *
+ * On a machine without OMAP3 timers load the driver with
+ *   insmod pwm.ko sim=1 timers=8,9,10,11
+ * and the registers are simulated in RAM.
+ *
+ * usage: pwm_bench [-d /dev/pwm9[,/dev/pwm10...]] [-n iterations]
+ *                  [-t workers] [-i interface] [-P]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../pwm.h"
+
+#define MAX_CHANNELS	16
+#define MAX_WORKERS	64
+
+/* one call of an interface */
+struct bench_call {
+	int fd;
+	int timer;		/* GPT number of the channel, for PWM_BATCH */
+	unsigned int i;		/* iteration */
+};
+
+struct bench_op {
+	const char *name;
+	int (*run)(const struct bench_call *c);
+};
+
+struct worker {
+	const char *path;
+	int timer;
+	const struct bench_op *op;
+	unsigned int iterations;
+	uint32_t *lat;		/* iterations entries, in ns */
+	unsigned long *errors;
+	pthread_t thread;
+};
+
+static const char *channels[MAX_CHANNELS];
+static int nchannels;
+static unsigned int iterations = 10000;
+static int nworkers = 4;
+static int use_processes;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int op_write(const struct bench_call *c)
+{
+	char buf[8];
+	int len = snprintf(buf, sizeof(buf), "%u\n", 1 + c->i % 99);
+
+	return write(c->fd, buf, len) == len ? 0 : -1;
+}
+
+static int op_read(const struct bench_call *c)
+{
+	char buf[128];
+
+	return pread(c->fd, buf, sizeof(buf), 0) > 0 ? 0 : -1;
+}
+
+static int op_set_dutycycle(const struct bench_call *c)
+{
+	return ioctl(c->fd, PWM_SET_DUTYCYCLE, 1 + c->i % 99);
+}
+
+static int op_get_dutycycle(const struct bench_call *c)
+{
+	return ioctl(c->fd, PWM_GET_DUTYCYCLE) < 0 ? -1 : 0;
+}
+
+static int op_set_frequency(const struct bench_call *c)
+{
+	return ioctl(c->fd, PWM_SET_FREQUENCY, (c->i & 1) ? 1024 : 2048);
+}
+
+static int op_get_frequency(const struct bench_call *c)
+{
+	return ioctl(c->fd, PWM_GET_FREQUENCY) < 0 ? -1 : 0;
+}
+
+static int op_on(const struct bench_call *c)
+{
+	return ioctl(c->fd, PWM_ON);
+}
+
+static int op_off(const struct bench_call *c)
+{
+	return ioctl(c->fd, PWM_OFF);
+}
+
+static int op_set_polarity(const struct bench_call *c)
+{
+	return ioctl(c->fd, PWM_SET_POLARITY, 1);
+}
+
+/* stays on the 32 kHz clock, only GPT10 and GPT11 accept it */
+static int op_set_clk(const struct bench_call *c)
+{
+	return ioctl(c->fd, PWM_SET_CLK, 0);
+}
+
+static int op_set_pre(const struct bench_call *c)
+{
+	return ioctl(c->fd, PWM_SET_PRE, 2);
+}
+
+/* a duty change and a read back, in one call */
+static int op_batch(const struct bench_call *c)
+{
+	struct pwm_batch b;
+
+	b.count = 2;
+	b.op[0].timer = c->timer;
+	b.op[0].cmd = PWM_SET_DUTYCYCLE;
+	b.op[0].value = 1 + c->i % 99;
+	b.op[1].timer = c->timer;
+	b.op[1].cmd = PWM_GET_DUTYCYCLE;
+	b.op[1].value = 0;
+
+	return ioctl(c->fd, PWM_BATCH, &b);
+}
+
+/* workers sharing a channel fight over it, the losers count as errors */
+static int op_claim_unclaim(const struct bench_call *c)
+{
+	return ioctl(c->fd, (c->i & 1) ? PWM_UNCLAIM : PWM_CLAIM);
+}
+
+static const struct bench_op ops[] = {
+	{ "write", op_write },
+	{ "read", op_read },
+	{ "ioctl_set_dutycycle", op_set_dutycycle },
+	{ "ioctl_get_dutycycle", op_get_dutycycle },
+	{ "ioctl_set_frequency", op_set_frequency },
+	{ "ioctl_get_frequency", op_get_frequency },
+	{ "ioctl_on", op_on },
+	{ "ioctl_off", op_off },
+	{ "ioctl_set_polarity", op_set_polarity },
+	{ "ioctl_set_clk", op_set_clk },
+	{ "ioctl_batch", op_batch },
+	{ "ioctl_claim_unclaim", op_claim_unclaim },
+	/* last, PWM_SET_PRE leaves TCLR to a reload of the driver */
+	{ "ioctl_set_pre", op_set_pre },
+};
+
+#define NR_OPS (sizeof(ops) / sizeof(ops[0]))
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct bench_call c;
+	uint64_t start;
+	int fd;
+
+	fd = open(w->path, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "open %s: %s\n", w->path, strerror(errno));
+		*w->errors = w->iterations;
+		return NULL;
+	}
+
+	/* leave the channel running so the getters have something to get */
+	ioctl(fd, PWM_SET_DUTYCYCLE, 50);
+
+	c.fd = fd;
+	c.timer = w->timer;
+
+	for (c.i = 0; c.i < w->iterations; c.i++) {
+		start = now_ns();
+		if (w->op->run(&c))
+			(*w->errors)++;
+		w->lat[c.i] = (uint32_t)(now_ns() - start);
+	}
+
+	close(fd);
+
+	return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, double p)
+{
+	size_t i = (size_t)(p * (n - 1));
+
+	return sorted[i];
+}
+
+static int run_scenario(const struct bench_op *op, const char *scenario,
+			int workers, int spread)
+{
+	struct worker w[MAX_WORKERS];
+	size_t total = (size_t)workers * iterations;
+	size_t lat_size = total * sizeof(uint32_t);
+	size_t err_size = workers * sizeof(unsigned long);
+	unsigned long errors = 0;
+	uint32_t *lat;
+	unsigned long *err;
+	uint64_t start, elapsed;
+	pid_t pid[MAX_WORKERS];
+	int i;
+
+	/* shared so that worker processes can report back */
+	lat = mmap(NULL, lat_size + err_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (lat == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+
+	err = (unsigned long *)((char *)lat + lat_size);
+	memset(err, 0, err_size);
+
+	for (i = 0; i < workers; i++) {
+		w[i].path = channels[spread ? i % nchannels : 0];
+		w[i].timer = atoi(w[i].path
+				  + strcspn(w[i].path, "0123456789"));
+		w[i].op = op;
+		w[i].iterations = iterations;
+		w[i].lat = lat + (size_t)i * iterations;
+		w[i].errors = &err[i];
+	}
+
+	start = now_ns();
+
+	for (i = 0; i < workers; i++) {
+		if (use_processes) {
+			pid[i] = fork();
+			if (pid[i] == 0) {
+				worker_run(&w[i]);
+				_exit(0);
+			}
+		} else {
+			pthread_create(&w[i].thread, NULL, worker_run, &w[i]);
+		}
+	}
+
+	for (i = 0; i < workers; i++) {
+		if (use_processes)
+			waitpid(pid[i], NULL, 0);
+		else
+			pthread_join(w[i].thread, NULL);
+	}
+
+	elapsed = now_ns() - start;
+
+	for (i = 0; i < workers; i++)
+		errors += err[i];
+
+	qsort(lat, total, sizeof(uint32_t), cmp_u32);
+
+	printf("{\"interface\":\"%s\",\"scenario\":\"%s\",\"workers\":%d,"
+	       "\"model\":\"%s\",\"channels\":%d,\"ops\":%zu,\"errors\":%lu,"
+	       "\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"p50_ns\":%u,"
+	       "\"p99_ns\":%u,\"p999_ns\":%u,\"max_ns\":%u}\n",
+	       op->name, scenario, workers,
+	       use_processes ? "processes" : "threads",
+	       spread ? nchannels : 1, total, errors, elapsed / 1e9,
+	       total / (elapsed / 1e9), percentile(lat, total, 0.50),
+	       percentile(lat, total, 0.99), percentile(lat, total, 0.999),
+	       lat[total - 1]);
+	fflush(stdout);
+
+	munmap(lat, lat_size + err_size);
+
+	return 0;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-d /dev/pwm9[,/dev/pwm10...]] "
+		"[-n iterations] [-t workers] [-i interface] [-P]\n", argv0);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *only = NULL;
+	char *devs = NULL, *tok;
+	unsigned int k;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:n:t:i:P")) != -1) {
+		switch (opt) {
+		case 'd':
+			devs = optarg;
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nworkers = atoi(optarg);
+			break;
+		case 'i':
+			only = optarg;
+			break;
+		case 'P':
+			use_processes = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (iterations < 1 || nworkers < 1 || nworkers > MAX_WORKERS)
+		usage(argv[0]);
+
+	if (devs) {
+		for (tok = strtok(devs, ","); tok && nchannels < MAX_CHANNELS;
+		     tok = strtok(NULL, ","))
+			channels[nchannels++] = tok;
+	} else {
+		channels[nchannels++] = "/dev/pwm9";
+	}
+
+	for (k = 0; k < NR_OPS; k++) {
+		if (only && strcmp(only, ops[k].name))
+			continue;
+
+		run_scenario(&ops[k], "single", 1, 0);
+		run_scenario(&ops[k], "contended", nworkers, 0);
+
+		if (nchannels > 1)
+			run_scenario(&ops[k], "spread", nworkers, 1);
+	}
+
+	return 0;
+}
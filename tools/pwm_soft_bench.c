@@ -0,0 +1,139 @@
+/*
+ * Measures the interrupt cost of the pwm_soft edge schedule against a
+ * simulated GP timer, for a growing number of outputs.
+ *
+ * The timer is modelled as a counter running from TLDR to overflow with
+ * one match register. Each overflow and each match is one interrupt,
+ * handled the same way pwm_soft_irq() does it. GPIO writes go to an
+ * array instead of hardware.
+ *
+ * Output is CSV, one line per output count:
+ * outputs,period_ticks,irqs_per_period,gpio_writes_per_period,
+ * ns_per_irq,ns_per_tick,ns_per_build
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../pwm_soft_sched.h"
+
+struct sim_timer {
+	u32 period;		/* ticks per overflow */
+	u32 match;		/* match position within the period */
+};
+
+static volatile int gpio_out[PWM_SOFT_MAX];
+static unsigned long gpio_writes;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sim_set(u64 mask, int value)
+{
+	unsigned int bit;
+
+	while (mask) {
+		bit = __builtin_ctzll(mask);
+		mask &= mask - 1;
+		gpio_out[bit] = value;
+		gpio_writes++;
+	}
+}
+
+/* same steps as pwm_soft_run_edges(), 'now' is the tick being serviced */
+static void sim_run_edges(struct sim_timer *t, const struct pwm_soft_sched *s,
+			  unsigned int *cursor, u32 now)
+{
+	for (;;) {
+		sim_set(pwm_soft_sched_due(s, cursor, now), 0);
+
+		if (*cursor >= s->nedges)
+			break;
+
+		t->match = s->edge[*cursor].tick;
+		if (now < t->match)
+			break;
+	}
+}
+
+static void run(unsigned int outputs, u32 period, unsigned int periods)
+{
+	struct pwm_soft_sched s;
+	u16 duty[PWM_SOFT_MAX];
+	struct sim_timer t;
+	unsigned int cursor, i, p;
+	unsigned long irqs = 0;
+	u64 start, irq_ns, build_ns;
+
+	for (i = 0; i < outputs; i++)
+		duty[i] = rand() % (PWM_SOFT_DUTY_MAX + 1);
+
+	start = now_ns();
+	for (i = 0; i < 1000; i++)
+		pwm_soft_sched_build(&s, period, duty, outputs);
+	build_ns = (now_ns() - start) / 1000;
+
+	gpio_writes = 0;
+	t.period = period;
+	t.match = 0;
+
+	/*
+	 * An interrupt is a few ns, less than clock_gettime() itself, so
+	 * the whole run is timed and divided by the interrupt count.
+	 */
+	start = now_ns();
+	for (p = 0; p < periods; p++) {
+		/* overflow */
+		cursor = 0;
+		sim_set(s.start_mask, 1);
+		sim_run_edges(&t, &s, &cursor, 0);
+		irqs++;
+
+		/* matches until the schedule is exhausted */
+		while (cursor < s.nedges) {
+			sim_run_edges(&t, &s, &cursor, t.match);
+			irqs++;
+		}
+	}
+	irq_ns = now_ns() - start;
+
+	printf("%u,%u,%.2f,%.2f,%.1f,%.3f,%llu\n", outputs, period,
+	       (double)irqs / periods, (double)gpio_writes / periods,
+	       (double)irq_ns / irqs, (double)irq_ns / ((double)periods * period),
+	       (unsigned long long)build_ns);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int periods = 10000;
+	u32 period = 32768 / 100;	/* 100 Hz on the 32 kHz clock */
+	unsigned int n;
+
+	if (argc > 1)
+		period = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		periods = strtoul(argv[2], NULL, 0);
+
+	if (period < 2 || periods < 1) {
+		fprintf(stderr, "usage: %s [period_ticks] [periods]\n", argv[0]);
+		return 1;
+	}
+
+	srand(1);
+
+	printf("outputs,period_ticks,irqs_per_period,gpio_writes_per_period,"
+	       "ns_per_irq,ns_per_tick,ns_per_build\n");
+
+	for (n = 1; n <= PWM_SOFT_MAX; n *= 2)
+		run(n, period, periods);
+
+	return 0;
+}
@@ -0,0 +1,604 @@
+/*
+ * Host tests for the driver's timer math, no board or driver needed.
+ *
+ * The conversion checks call pwm_conv.h, the code pwm.c computes TLDR
+ * and TMAR with. The output checks run the register sequences of
+ * pwm_seq.h, the ones set_pwm_frequency(), pwm_on(), pwm_off(), scpwm()
+ * and pwm_channel_config() are made of, on the timer model in
+ * pwm_gpt_sim.h and sample the output once per counter tick. A TMAR
+ * move that has to wait is left to a timer like pwm.c does. The
+ * concurrency check runs setters under a lock against lock free
+ * getters, with the snapshot protocol of pwm_publish() and
+ * pwm_snapshot().
+ *
+ *   make -C tools check
+ *
+ * Prints one line per failed check and exits with 1 if there was one.
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../pwm_conv.h"
+#include "../pwm_gpt_sim.h"
+
+/* DEFAULT_TCLR of pwm_core.h, what the driver loads a channel with */
+#define TEST_TCLR	(GPT_TCLR_PT | GPT_TCLR_TRG_OVFL_MATCH | GPT_TCLR_CE \
+			 | GPT_TCLR_AR)
+
+#define WRITERS		2
+#define READERS		4
+#define WRITES		20000
+
+static int failures;
+static int checks;
+
+static void check(int ok, const char *fmt, ...)
+{
+	va_list ap;
+
+	checks++;
+
+	if (ok)
+		return;
+
+	failures++;
+	printf("FAIL: ");
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+}
+
+/* counter ticks of one period */
+static u32 period_ticks(u32 tldr)
+{
+	return 0xFFFFFFFF - tldr + 1;
+}
+
+static void test_frequency_clamp(void)
+{
+	static const struct {
+		u32 input;
+		int req;
+		int want;
+	} t[] = {
+		{ CLK_32K_FREQ, 0, 1024 },
+		{ CLK_32K_FREQ, 1, 1024 },	/* rounds down to 0 */
+		{ CLK_32K_FREQ, -1, 1024 },
+		{ CLK_32K_FREQ, INT_MIN, 1024 },
+		{ CLK_32K_FREQ, 2, 2 },
+		{ CLK_32K_FREQ, 3, 2 },
+		{ CLK_32K_FREQ, 1025, 1024 },
+		{ CLK_32K_FREQ, 16384, 16384 },
+		{ CLK_32K_FREQ, 16385, 16384 },
+		{ CLK_32K_FREQ, 16386, 16384 },
+		{ CLK_32K_FREQ, INT_MAX, 16384 },
+		{ CLK_13K_FREQ, 6656, 6656 },
+		{ CLK_13K_FREQ, 6657, 6656 },
+		{ CLK_13K_FREQ, 6658, 6656 },
+		{ CLK_13K_FREQ, 0, 1024 },
+	};
+	unsigned int i;
+	int got;
+
+	for (i = 0; i < sizeof(t) / sizeof(t[0]); i++) {
+		got = pwm_conv_frequency(t[i].input, t[i].req);
+		check(got == t[i].want, "frequency %d at %u Hz: got %d, want %d",
+		      t[i].req, t[i].input, got, t[i].want);
+	}
+
+	/* the reset values in pwm.c are the 32 kHz default */
+	check(pwm_conv_tldr(CLK_32K_FREQ, 1024) == 0xFFFFFFE0,
+	      "default TLDR %08x", pwm_conv_tldr(CLK_32K_FREQ, 1024));
+
+	/* an out of range request gets the TLDR of the clamped one */
+	check(pwm_conv_tldr(CLK_32K_FREQ, 0) == pwm_conv_tldr(CLK_32K_FREQ,
+							      1024)
+	      && pwm_conv_tldr(CLK_32K_FREQ, -7) == pwm_conv_tldr(CLK_32K_FREQ,
+								  1024)
+	      && pwm_conv_tldr(CLK_32K_FREQ, 99999) == 0xFFFFFFFE,
+	      "TLDR of clamped frequencies");
+}
+
+/* every frequency the 32 kHz clock can do, every duty */
+static void test_conversion_range(void)
+{
+	u32 tldr, tmar, p, bad = 0;
+	int freq, duty;
+
+	for (freq = 2; freq <= CLK_32K_FREQ / 2; freq += 2) {
+		tldr = pwm_conv_tldr(CLK_32K_FREQ, freq);
+		p = period_ticks(tldr);
+
+		if (p != CLK_32K_FREQ / (u32)freq)
+			bad++;
+
+		for (duty = 1; duty <= 100; duty++) {
+			tmar = pwm_conv_tmar(tldr, duty);
+			/* two tick periods only have room for one match */
+			if (tmar <= tldr
+			    || tmar - tldr > (p > 2 ? p - 2 : 1))
+				bad++;
+		}
+	}
+
+	check(!bad, "%u frequency/duty pairs out of range", bad);
+}
+
+static void test_duty_clamp(void)
+{
+	u32 tldr = pwm_conv_tldr(CLK_32K_FREQ, 1024);	/* 30 ticks */
+
+	check(pwm_conv_tmar(tldr, 0) == 0, "duty 0 keeps the channel off");
+	check(pwm_conv_tmar(tldr, 1) == tldr + 1,
+	      "duty 1 rounds up to one tick: %u", pwm_conv_tmar(tldr, 1) - tldr);
+	check(pwm_conv_tmar(tldr, 50) == tldr + 15, "duty 50: %u ticks",
+	      pwm_conv_tmar(tldr, 50) - tldr);
+	check(pwm_conv_tmar(tldr, 100) == tldr + 30, "duty 100: %u ticks",
+	      pwm_conv_tmar(tldr, 100) - tldr);
+	check(pwm_conv_tmar(tldr, 101) == tldr + 30, "duty 101: %u ticks",
+	      pwm_conv_tmar(tldr, 101) - tldr);
+
+	/* the fastest carrier has one tick left, any duty gets it */
+	tldr = pwm_conv_tldr(CLK_32K_FREQ, CLK_32K_FREQ / 2);
+	check(pwm_conv_tmar(tldr, 1) == tldr + 1
+	      && pwm_conv_tmar(tldr, 100) == tldr + 1,
+	      "duty at the highest frequency");
+}
+
+/* the register state of struct pwm_dev that pwm_seq.h works on */
+struct gpt {
+	u32 input_freq;
+	u32 tldr;
+	u32 tmar;
+	u32 tclr;
+	u32 num_freqs;
+};
+
+/* a channel on the model, driven by the sequences pwm.c runs */
+struct chan {
+	struct pwm_gpt_sim s;
+	u64 tick;		/* functional clocks since the start */
+	struct gpt gpt;
+	int frequency, duty_cycle;
+	/* tmar_timer of pwm.c, due at a tick instead of a time */
+	u32 tmar_hw;
+	int tmar_pending;
+	u64 tmar_due;
+};
+
+/* halfway between two clock edges, so no sample races a tick */
+static u64 chan_now(struct chan *c)
+{
+	return ((2 * c->tick + 1) * NSEC_PER_SEC_U64) / (2 * c->s.clk_hz);
+}
+
+static u32 chan_read(struct chan *c, u32 reg)
+{
+	return pwm_gpt_sim_read(&c->s, reg, chan_now(c));
+}
+
+static void chan_write(struct chan *c, u32 reg, u32 val)
+{
+	pwm_gpt_sim_write(&c->s, reg, val, chan_now(c));
+}
+
+#define PWM_SEQ_DEV	struct chan
+#define pwm_seq_read	chan_read
+#define pwm_seq_write	chan_write
+#include "../pwm_seq.h"
+
+/* pwm_tmar_timer_fn(), without a mode to take over */
+static void chan_tmar_timer(struct chan *c)
+{
+	u32 ticks;
+
+	if (!(c->gpt.tclr & GPT_TCLR_ST)) {
+		c->tmar_pending = 0;
+		return;
+	}
+
+	ticks = pwm_seq_tmar_ticks(c, c->tmar_hw);
+	if (ticks) {
+		c->tmar_due = c->tick + ticks;
+	} else {
+		chan_write(c, GPT_TMAR, c->gpt.tmar);
+		c->tmar_pending = 0;
+	}
+}
+
+/* runs the model 'ticks' on, firing the TMAR timer when it is due */
+static void chan_wait(struct chan *c, u64 ticks)
+{
+	u64 end = c->tick + ticks;
+
+	while (c->tmar_pending && c->tmar_due <= end) {
+		c->tick = c->tmar_due;
+		pwm_gpt_sim_advance(&c->s, chan_now(c));
+		chan_tmar_timer(c);
+	}
+
+	c->tick = end;
+	pwm_gpt_sim_advance(&c->s, chan_now(c));
+}
+
+/* output samples at the next 'ticks' ticks that were high */
+static u64 chan_high(struct chan *c, u64 ticks)
+{
+	u64 high = 0;
+
+	while (ticks--) {
+		chan_wait(c, 1);
+		high += c->s.out;
+	}
+
+	return high;
+}
+
+/* what TMAR has to read, the old match while a move is deferred */
+static u32 chan_hw_tmar(struct chan *c)
+{
+	return c->tmar_pending ? c->tmar_hw : c->gpt.tmar;
+}
+
+/* set_pwm_frequency() */
+static void chan_frequency(struct chan *c, int freq)
+{
+	pwm_seq_frequency(c, freq);
+}
+
+/* pwm_on() */
+static void chan_on(struct chan *c)
+{
+	c->tmar_pending = 0;
+	pwm_seq_on(c);
+}
+
+/* pwm_off() */
+static void chan_off(struct chan *c)
+{
+	pwm_seq_off(c);
+}
+
+/* scpwm() */
+static void chan_polarity(struct chan *c, int sc)
+{
+	pwm_seq_polarity(c, sc);
+}
+
+/* set_duty_cycle() on a channel outside a group */
+static void chan_duty(struct chan *c, int duty)
+{
+	chan_off(c);
+	if (!pwm_seq_duty(c, duty))
+		return;
+	chan_on(c);
+}
+
+/* pwm_update_tmar(), the write left to the TMAR timer if it has to wait */
+static void chan_update_tmar(struct chan *c, u32 old_tmar)
+{
+	u32 ticks;
+
+	if (c->tmar_pending)
+		old_tmar = c->tmar_hw;
+
+	ticks = pwm_seq_tmar_ticks(c, old_tmar);
+	if (ticks) {
+		c->tmar_hw = old_tmar;
+		c->tmar_pending = 1;
+		c->tmar_due = c->tick + ticks;
+	} else {
+		chan_write(c, GPT_TMAR, c->gpt.tmar);
+		c->tmar_pending = 0;
+	}
+}
+
+/* pwm_channel_config(), TMAR moves without a stop when only it changes */
+static void chan_config(struct chan *c, int freq, int duty)
+{
+	u32 old_tmar;
+
+	if (pwm_conv_frequency(c->gpt.input_freq, freq) != c->frequency)
+		chan_frequency(c, freq);
+
+	old_tmar = c->gpt.tmar;
+
+	if (!pwm_seq_duty(c, duty))
+		chan_off(c);
+	else if (c->gpt.tclr & GPT_TCLR_ST)
+		chan_update_tmar(c, old_tmar);
+}
+
+/* the first load, setup_dev() and the first change of pwm_control() */
+static void chan_init(struct chan *c, u32 clk_hz)
+{
+	memset(c, 0, sizeof(*c));
+	pwm_gpt_sim_init(&c->s, clk_hz, 0);
+	c->gpt.input_freq = clk_hz;
+	c->gpt.tclr = TEST_TCLR;
+	chan_write(c, GPT_TCLR, c->gpt.tclr);
+	chan_frequency(c, 1024);
+}
+
+/*
+ * The counter reloads with TLDR and the output toggles at the match and
+ * at the overflow. From the reload to the match it is at the SCPWM
+ * level, after the match at the other one.
+ */
+static u64 want_high(struct chan *c, unsigned int periods)
+{
+	u32 p = period_ticks(c->gpt.tldr), to_match = c->gpt.tmar - c->gpt.tldr;
+
+	if (c->gpt.tclr & GPT_TCLR_SCPWM)
+		return (u64)periods * to_match;
+
+	return (u64)periods * (p - to_match);
+}
+
+/* skips a period to settle, then samples 'periods' whole ones */
+static void check_output(struct chan *c, unsigned int periods,
+			 const char *what)
+{
+	u32 p = period_ticks(c->gpt.tldr);
+	u64 high, want = want_high(c, periods);
+
+	chan_wait(c, p);
+	high = chan_high(c, (u64)p * periods);
+
+	check(high == want, "%s: %llu of %llu ticks high, want %llu", what,
+	      (unsigned long long)high, (unsigned long long)p * periods,
+	      (unsigned long long)want);
+}
+
+static void test_transitions(void)
+{
+	struct chan c;
+	u64 edges, ovf;
+
+	chan_init(&c, CLK_32K_FREQ);
+
+	/* loaded but not started: SCPWM level, nothing moves */
+	edges = c.s.edges;
+	chan_wait(&c, 1000);
+	check(!c.s.out && c.s.edges == edges, "idle channel toggled");
+
+	chan_duty(&c, 50);
+	check_output(&c, 8, "duty 50");
+
+	/* a second of a running 1024 Hz output */
+	edges = c.s.edges;
+	ovf = c.s.overflows;
+	chan_wait(&c, CLK_32K_FREQ);
+	check(c.s.overflows - ovf == 1024 && c.s.edges - edges == 2048,
+	      "1 s at 1024 Hz: %llu overflows, %llu edges",
+	      (unsigned long long)(c.s.overflows - ovf),
+	      (unsigned long long)(c.s.edges - edges));
+
+	chan_off(&c);
+	edges = c.s.edges;
+	chan_wait(&c, 1000);
+	check(!c.s.out && c.s.edges == edges, "stopped channel toggled");
+
+	/* polarity while stopped shows on the pin right away */
+	chan_polarity(&c, 1);
+	check(c.s.out == 1, "SCPWM=1 on a stopped channel: out %d", c.s.out);
+	chan_on(&c);
+	check_output(&c, 8, "duty 50 inverted");
+	chan_off(&c);
+	chan_polarity(&c, 0);
+	check(c.s.out == 0, "SCPWM=0 on a stopped channel: out %d", c.s.out);
+
+	chan_duty(&c, 1);
+	check_output(&c, 4, "duty 1");
+	chan_duty(&c, 100);
+	check_output(&c, 4, "duty 100");
+
+	chan_duty(&c, 0);
+	check(!(c.s.reg[GPT_TCLR / 4] & GPT_TCLR_ST), "duty 0 left it running");
+	edges = c.s.edges;
+	chan_wait(&c, 1000);
+	check(c.s.edges == edges, "duty 0 channel toggled");
+
+	/* a running channel: duty only moves TMAR, frequency restarts */
+	chan_duty(&c, 50);
+	chan_config(&c, 1024, 25);
+	check_output(&c, 4, "config 1024 Hz 25");
+	chan_config(&c, 4096, 75);
+	check_output(&c, 4, "config 4096 Hz 75");
+	chan_config(&c, -1, 75);
+	check(c.frequency == 1024, "config -1 Hz runs at %d Hz", c.frequency);
+	check_output(&c, 4, "config -1 Hz 75");
+	/* a match span over the whole two tick period */
+	chan_config(&c, 8192, 100);
+	chan_config(&c, 16384, 50);
+	check_output(&c, 4, "config 16384 Hz 50");
+
+	/* the counter between the old and the new match, the move waits */
+	chan_config(&c, 1024, 50);
+	chan_wait(&c, period_ticks(c.gpt.tldr) + 18
+		  - (chan_read(&c, GPT_TCRR) - c.gpt.tldr));
+	chan_config(&c, 1024, 75);
+	check(c.tmar_pending && chan_read(&c, GPT_TMAR) == c.gpt.tldr + 15,
+	      "TMAR moved with the counter in the way");
+	chan_wait(&c, 5);
+	check(!c.tmar_pending && chan_read(&c, GPT_TMAR) == c.gpt.tmar,
+	      "deferred TMAR did not land");
+	check_output(&c, 4, "deferred move to 75");
+
+	chan_config(&c, 1024, 0);
+	check(!(c.s.reg[GPT_TCLR / 4] & GPT_TCLR_ST), "config duty 0 running");
+}
+
+/* posted mode, the driver does not use it but the model has it */
+static void test_posted(void)
+{
+	struct chan c;
+
+	chan_init(&c, CLK_32K_FREQ);
+	chan_write(&c, GPT_TSICR, GPT_TSICR_POSTED);
+
+	chan_write(&c, GPT_TLDR, 0xFFFFFF00);
+	check(pwm_gpt_sim_read(&c.s, GPT_TWPS, chan_now(&c)) == 1 << 2
+	      && c.s.reg[GPT_TLDR / 4] == c.gpt.tldr,
+	      "posted TLDR landed early");
+
+	chan_wait(&c, PWM_SIM_POSTED_CLKS);
+	check(pwm_gpt_sim_read(&c.s, GPT_TWPS, chan_now(&c)) == 0
+	      && c.s.reg[GPT_TLDR / 4] == 0xFFFFFF00,
+	      "posted TLDR did not land");
+}
+
+/*
+ * What the getters read, the fields of struct pwm_snap published like
+ * pwm_publish() does: they only change while seq is odd.
+ */
+struct snap {
+	atomic_uint seq;
+	atomic_uint tclr;
+	atomic_uint tldr;
+	atomic_uint tmar;
+	atomic_uint num_freqs;
+	atomic_uint input_freq;
+	atomic_int frequency;
+};
+
+static struct chan shared;
+static struct snap snap;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int writers_left;
+static atomic_ulong torn, reads;
+
+static void publish(struct chan *c)
+{
+	atomic_fetch_add_explicit(&snap.seq, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	pwm_seq_snap(c, &snap);
+	atomic_fetch_add_explicit(&snap.seq, 1, memory_order_release);
+}
+
+static void *writer(void *arg)
+{
+	unsigned int seed = (unsigned int)(uintptr_t)arg;
+	static const int freqs[] = { 2, 1024, 1000, 4096, 16384, 0, -5 };
+	int i;
+
+	for (i = 0; i < WRITES; i++) {
+		pthread_mutex_lock(&lock);
+		chan_config(&shared, freqs[rand_r(&seed) % 7],
+			    1 + rand_r(&seed) % 100);
+		if (!(shared.gpt.tclr & GPT_TCLR_ST))
+			chan_on(&shared);
+		chan_wait(&shared, 1 + rand_r(&seed) % 64);
+		publish(&shared);
+		pthread_mutex_unlock(&lock);
+	}
+
+	atomic_fetch_sub(&writers_left, 1);
+
+	return NULL;
+}
+
+/*
+ * A snapshot is good if its fields belong to one configuration: the
+ * period of the frequency and a match inside that period.
+ */
+static int snap_ok(u32 tldr, u32 tmar, int freq)
+{
+	u32 p = period_ticks(tldr);
+
+	return tldr == pwm_conv_tldr(CLK_32K_FREQ, freq) && tmar > tldr
+	    && tmar - tldr <= (p > 2 ? p - 2 : 1);
+}
+
+static void *reader(void *arg)
+{
+	unsigned int s1, s2;
+	u32 tldr, tmar, reg_tldr, reg_tmar;
+	int freq;
+
+	(void)arg;
+
+	while (atomic_load(&writers_left)) {
+		/* the lock free getters, PWM_GET_* and read() */
+		do {
+			s1 = atomic_load_explicit(&snap.seq,
+						  memory_order_acquire);
+			tldr = atomic_load_explicit(&snap.tldr,
+						    memory_order_relaxed);
+			tmar = atomic_load_explicit(&snap.tmar,
+						    memory_order_relaxed);
+			freq = atomic_load_explicit(&snap.frequency,
+						    memory_order_relaxed);
+			atomic_thread_fence(memory_order_acquire);
+			s2 = atomic_load_explicit(&snap.seq,
+						  memory_order_relaxed);
+		} while ((s1 & 1) || s1 != s2);
+
+		if (s1 && !snap_ok(tldr, tmar, freq))
+			atomic_fetch_add(&torn, 1);
+
+		/* and the locked path, the registers themselves */
+		pthread_mutex_lock(&lock);
+		reg_tldr = pwm_gpt_sim_read(&shared.s, GPT_TLDR,
+					    chan_now(&shared));
+		reg_tmar = pwm_gpt_sim_read(&shared.s, GPT_TMAR,
+					    chan_now(&shared));
+		if (reg_tldr != shared.gpt.tldr
+		    || reg_tmar != chan_hw_tmar(&shared))
+			atomic_fetch_add(&torn, 1);
+		pthread_mutex_unlock(&lock);
+
+		atomic_fetch_add(&reads, 1);
+	}
+
+	return NULL;
+}
+
+static void test_concurrency(void)
+{
+	pthread_t w[WRITERS], r[READERS];
+	int i;
+
+	chan_init(&shared, CLK_32K_FREQ);
+	atomic_store(&writers_left, WRITERS);
+
+	for (i = 0; i < READERS; i++)
+		pthread_create(&r[i], NULL, reader, NULL);
+	for (i = 0; i < WRITERS; i++)
+		pthread_create(&w[i], NULL, writer, (void *)(uintptr_t)(i + 1));
+
+	for (i = 0; i < WRITERS; i++)
+		pthread_join(w[i], NULL);
+	for (i = 0; i < READERS; i++)
+		pthread_join(r[i], NULL);
+
+	check(!atomic_load(&torn), "%lu of %lu concurrent reads torn",
+	      atomic_load(&torn), atomic_load(&reads));
+	check(snap_ok(atomic_load(&snap.tldr), atomic_load(&snap.tmar),
+		      atomic_load(&snap.frequency))
+	      && atomic_load(&snap.tldr) == shared.gpt.tldr
+	      && atomic_load(&snap.tmar) == shared.gpt.tmar,
+	      "last snapshot is not the last configuration");
+}
+
+int main(void)
+{
+	test_frequency_clamp();
+	test_conversion_range();
+	test_duty_clamp();
+	test_transitions();
+	test_posted();
+	test_concurrency();
+
+	printf("%d of %d checks passed\n", checks - failures, checks);
+
+	return failures ? 1 : 0;
+}
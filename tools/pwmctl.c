@@ -0,0 +1,443 @@
+/*
+ * Scripted control of the /dev/pwmN channels from one process.
+ *
+ * Commands come from -e arguments, script files or stdin, one per line,
+ * '#' starts a comment. Channels are opened on first use and stay open.
+ * All changes of one command go to the driver in one PWM_BATCH call
+ * through pwmlib, older drivers get one ioctl per change.
+ *
+ *   set CH key=value...     freq=, duty=, polarity=, on, off
+ *   get CH                  prints the state of each channel
+ *   on CH / off CH
+ *   ramp CH duty|freq FROM TO [steps=N] [ms=N]
+ *   wait MS
+ *   sync CH [phase=P,P...]  starts the channels in phase, 1/100 degree
+ *   state                   prints every open channel
+ *
+ * CH is a GPT number, a comma separated list or "all" for the open
+ * ones. get, state, ramp and sync print one JSON object per line, so
+ * does an error, which stops the script unless -k is given.
+ *
+ * usage: pwmctl [-k] [-e command]... [script|-]...
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+#include "pwmlib.h"
+
+#define MAX_TIMER	16
+#define MAX_ARGS	16
+
+static struct pwmlib_channel chans[MAX_TIMER];
+static int chan_open[MAX_TIMER];
+static int ctl_fd = -1;		/* any open channel, for PWM_BATCH */
+
+static unsigned int lineno;
+static const char *source;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000LL;
+	ts.tv_nsec = t % 1000000000LL;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+	       == EINTR) ;
+}
+
+static int report(const char *cmd, const char *what, int error)
+{
+	printf("{\"source\":\"%s\",\"line\":%u,\"cmd\":\"%s\","
+	       "\"error\":\"%s%s%s\"}\n", source, lineno, cmd,
+	       what ? what : "", what && error ? ": " : "",
+	       error ? strerror(-error) : "");
+
+	return 1;
+}
+
+static int chan_get(int timer)
+{
+	int error;
+
+	if (timer < 0 || timer >= MAX_TIMER)
+		return -ENODEV;
+
+	if (chan_open[timer])
+		return 0;
+
+	error = pwmlib_open(&chans[timer], timer);
+	if (error)
+		return error;
+
+	chan_open[timer] = 1;
+	if (ctl_fd < 0)
+		ctl_fd = chans[timer].fd;
+
+	return 0;
+}
+
+/*
+ * Fills list with the timers named by spec, opening them. The command
+ * helpers below return a negative errno from the driver or 1 once they
+ * have reported a usage error themselves.
+ */
+static int parse_chans(const char *spec, int *list)
+{
+	char buf[64], *tok, *save;
+	int n = 0, i, error;
+
+	if (!strcmp(spec, "all")) {
+		for (i = 0; i < MAX_TIMER; i++)
+			if (chan_open[i])
+				list[n++] = i;
+		return n;
+	}
+
+	snprintf(buf, sizeof(buf), "%s", spec);
+
+	for (tok = strtok_r(buf, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		if (n >= MAX_TIMER)
+			return -E2BIG;
+
+		list[n] = strtol(tok, NULL, 0);
+		error = chan_get(list[n]);
+		if (error)
+			return error;
+		n++;
+	}
+
+	return n ? n : -EINVAL;
+}
+
+static int submit(struct pwmlib_batch *b, int *calls)
+{
+	if (!b->count)
+		return 0;
+
+	return pwmlib_batch_submit(ctl_fd, b, calls);
+}
+
+static void print_state(int timer, int frequency, int duty)
+{
+	printf("{\"timer\":%d,\"frequency\":%d,\"duty\":%d}\n",
+	       timer, frequency, duty);
+}
+
+/* one batch for all getters, the results carry the values */
+static int cmd_get(const int *list, int n)
+{
+	struct pwmlib_batch b;
+	unsigned int i;
+	int error;
+
+	pwmlib_batch_init(&b);
+	for (i = 0; i < (unsigned int)n; i++) {
+		pwmlib_batch_add(&b, list[i], PWM_GET_FREQUENCY, 0);
+		pwmlib_batch_add(&b, list[i], PWM_GET_DUTYCYCLE, 0);
+	}
+
+	error = submit(&b, NULL);
+
+	for (i = 0; i + 1 < b.count; i += 2)
+		if (b.op[i].result >= 0 && b.op[i + 1].result >= 0)
+			print_state(b.op[i].timer, b.op[i].result,
+				    b.op[i + 1].result);
+
+	return error;
+}
+
+static int cmd_set(const int *list, int n, char **argv, int argc)
+{
+	struct pwmlib_batch b;
+	unsigned int cmd;
+	int i, j, value;
+	char *eq;
+
+	pwmlib_batch_init(&b);
+
+	for (j = 0; j < argc; j++) {
+		eq = strchr(argv[j], '=');
+		value = eq ? strtol(eq + 1, NULL, 0) : 0;
+
+		if (!strncmp(argv[j], "freq=", 5))
+			cmd = PWM_SET_FREQUENCY;
+		else if (!strncmp(argv[j], "duty=", 5))
+			cmd = PWM_SET_DUTYCYCLE;
+		else if (!strncmp(argv[j], "polarity=", 9))
+			cmd = PWM_SET_POLARITY;
+		else if (!strcmp(argv[j], "on"))
+			cmd = PWM_ON;
+		else if (!strcmp(argv[j], "off"))
+			cmd = PWM_OFF;
+		else
+			return report("set", argv[j], 0);
+
+		for (i = 0; i < n; i++)
+			if (pwmlib_batch_add(&b, list[i], cmd, value))
+				return report("set", "too many changes",
+					      -ENOSPC);
+	}
+
+	return submit(&b, NULL);
+}
+
+static int cmd_ramp(const int *list, int n, char **argv, int argc)
+{
+	struct pwmlib_batch b;
+	unsigned int cmd;
+	long from, to, steps = 0, ms = 0, s;
+	int64_t start, end;
+	int i, j, error = 0, calls = 0, total = 0;
+
+	if (argc < 3)
+		return report("ramp", "ramp CH duty|freq FROM TO", 0);
+
+	if (!strcmp(argv[0], "duty"))
+		cmd = PWM_SET_DUTYCYCLE;
+	else if (!strcmp(argv[0], "freq"))
+		cmd = PWM_SET_FREQUENCY;
+	else
+		return report("ramp", argv[0], 0);
+
+	from = strtol(argv[1], NULL, 0);
+	to = strtol(argv[2], NULL, 0);
+
+	for (j = 3; j < argc; j++) {
+		if (!strncmp(argv[j], "steps=", 6))
+			steps = strtol(argv[j] + 6, NULL, 0);
+		else if (!strncmp(argv[j], "ms=", 3))
+			ms = strtol(argv[j] + 3, NULL, 0);
+		else
+			return report("ramp", argv[j], 0);
+	}
+
+	/* one step per unit by default */
+	if (steps <= 0)
+		steps = labs(to - from) ? labs(to - from) : 1;
+
+	start = now_ns();
+
+	for (s = 1; s <= steps && !error; s++) {
+		pwmlib_batch_init(&b);
+		for (i = 0; i < n; i++)
+			pwmlib_batch_add(&b, list[i], cmd,
+					 from + (to - from) * s / steps);
+
+		error = submit(&b, &calls);
+		total += calls;
+
+		if (ms)
+			sleep_until(start + (int64_t)ms * 1000000 * s / steps);
+	}
+
+	end = now_ns();
+
+	printf("{\"cmd\":\"ramp\",\"steps\":%ld,\"calls\":%d,"
+	       "\"elapsed_us\":%lld}\n", s - 1, total,
+	       (long long)(end - start) / 1000);
+
+	return error;
+}
+
+/*
+ * Turns the channels on, then makes them a phase group, which restarts
+ * the running members back to back with their counters at the phases.
+ */
+static int cmd_sync(const int *list, int n, char **argv, int argc)
+{
+	struct pwm_phase_group g;
+	struct pwmlib_batch b;
+	char *p;
+	int i, error;
+
+	if (n > PWM_GROUP_MAX)
+		return report("sync", "too many channels", -E2BIG);
+
+	memset(&g, 0, sizeof(g));
+	g.count = n;
+	for (i = 0; i < n; i++)
+		g.timer[i] = list[i];
+
+	if (argc && !strncmp(argv[0], "phase=", 6)) {
+		p = argv[0] + 6;
+		for (i = 0; i < n && *p; i++) {
+			g.phase[i] = strtoul(p, &p, 0);
+			if (*p == ',')
+				p++;
+		}
+	}
+
+	pwmlib_batch_init(&b);
+	for (i = 0; i < n; i++)
+		pwmlib_batch_add(&b, list[i], PWM_ON, 0);
+
+	error = submit(&b, NULL);
+	if (error)
+		return error;
+
+	if (ioctl(chans[list[0]].fd, PWM_SET_PHASE_GROUP, &g) < 0)
+		return -errno;
+
+	printf("{\"cmd\":\"sync\",\"timers\":%d,\"started_ns\":%lld}\n", n,
+	       (long long)now_ns());
+
+	return 0;
+}
+
+static int run_line(char *line)
+{
+	char *argv[MAX_ARGS], *save, *cmd;
+	int list[MAX_TIMER], argc = 0, n, error;
+
+	if ((cmd = strchr(line, '#')))
+		*cmd = '\0';
+
+	for (cmd = strtok_r(line, " \t\r\n", &save); cmd && argc < MAX_ARGS;
+	     cmd = strtok_r(NULL, " \t\r\n", &save))
+		argv[argc++] = cmd;
+
+	if (!argc)
+		return 0;
+
+	cmd = argv[0];
+
+	if (!strcmp(cmd, "wait")) {
+		if (argc < 2)
+			return report(cmd, "wait MS", 0);
+		sleep_until(now_ns() + strtoll(argv[1], NULL, 0) * 1000000);
+		return 0;
+	}
+
+	if (!strcmp(cmd, "state")) {
+		n = parse_chans("all", list);
+		return n ? cmd_get(list, n) : 0;
+	}
+
+	if (strcmp(cmd, "set") && strcmp(cmd, "get") && strcmp(cmd, "on") &&
+	    strcmp(cmd, "off") && strcmp(cmd, "ramp") && strcmp(cmd, "sync"))
+		return report(cmd, "unknown command", 0);
+
+	if (argc < 2)
+		return report(cmd, "no channel", 0);
+
+	n = parse_chans(argv[1], list);
+	if (n < 0)
+		return report(cmd, argv[1], n);
+	if (!n)
+		return report(cmd, "no channel open", 0);
+
+	if (!strcmp(cmd, "set"))
+		error = cmd_set(list, n, argv + 2, argc - 2);
+	else if (!strcmp(cmd, "get"))
+		error = cmd_get(list, n);
+	else if (!strcmp(cmd, "on") || !strcmp(cmd, "off"))
+		error = cmd_set(list, n, argv, 1);
+	else if (!strcmp(cmd, "ramp"))
+		error = cmd_ramp(list, n, argv + 2, argc - 2);
+	else
+		error = cmd_sync(list, n, argv + 2, argc - 2);
+
+	return error < 0 ? report(cmd, NULL, error) : error;
+}
+
+static int run_file(FILE *f, const char *name, int keep_going)
+{
+	char line[512];
+	int error, first = 0;
+
+	source = name;
+	lineno = 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+
+		error = run_line(line);
+		if (error && !first)
+			first = error;
+		if (error && !keep_going)
+			break;
+
+		/* a script fed line by line wants to see the answers now */
+		fflush(stdout);
+	}
+
+	return first;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-k] [-e command]... [script|-]...\n",
+		argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int i, keep_going = 0, error = 0, ran = 0;
+	char line[512];
+	FILE *f;
+
+	for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+		if (!strcmp(argv[i], "-k")) {
+			keep_going = 1;
+		} else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+			snprintf(line, sizeof(line), "%s", argv[++i]);
+			source = "-e";
+			lineno = ++ran;
+			if (run_line(line) && !error) {
+				error = 1;
+				if (!keep_going)
+					return 1;
+			}
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	for (; i < argc; i++, ran++) {
+		if (!strcmp(argv[i], "-")) {
+			f = stdin;
+		} else {
+			f = fopen(argv[i], "r");
+			if (!f) {
+				fprintf(stderr, "%s: %s\n", argv[i],
+					strerror(errno));
+				return 1;
+			}
+		}
+
+		if (run_file(f, argv[i], keep_going)) {
+			error = 1;
+			if (!keep_going)
+				return 1;
+		}
+
+		if (f != stdin)
+			fclose(f);
+	}
+
+	if (!ran && run_file(stdin, "-", keep_going))
+		error = 1;
+
+	for (i = 0; i < MAX_TIMER; i++)
+		if (chan_open[i])
+			pwmlib_close(&chans[i]);
+
+	return error;
+}
@@ -0,0 +1,496 @@
+/*
+ * Offline renderer for the pwmsp speaker path.
+ *
+ * Every sample goes through the same conversion pwmsp_lib.c does
+ * (pwmsp_conv.h), the resulting TLDR/TMAR writes drive a tick by tick
+ * model of the timer output in toggle mode, and the pin is run through
+ * an RC low pass like the one on the board. The reconstructed signal is
+ * compared with the input sent through the same filter.
+ *
+ * Samples are applied at exact instants of the sample rate, the
+ * driver's own pacing is not modelled. The comparison fits gain and
+ * offset first, so an inverted or attenuated output is not counted as
+ * noise, the fitted gain is reported.
+ *
+ * One JSON object is printed: snr_db over the whole input, thd_db and
+ * thd_pct when the fundamental is known (-g or -F), tmar_glitches for
+ * the TMAR writes that inverted the output, and conversions per second
+ * of the sample to register path alone.
+ *
+ * usage: pwmsp_render [-c clock] [-b carrier] [-r rate] [-f cutoff]
+ *                     [-o out.wav] [-t regs.csv] [-F hz]
+ *                     (in.wav | -g hz [-a amplitude] [-d seconds])
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../pwm_ioctl.h"
+#include "../pwmsp_conv.h"
+
+#define MAX_HARMONIC	10
+
+struct input {
+	unsigned int rate;
+	unsigned int fmt_size;	/* bytes per sample */
+	unsigned int is_signed;
+	size_t count;
+	u8 *data;		/* mono, in the format pwmsp would get */
+};
+
+/* the parts of the timer the output depends on */
+struct timer {
+	u32 tldr;
+	u32 tmar;
+	u32 tcrr;
+	int frequency;
+	int running;
+	int pin;
+	unsigned long glitches;	/* periods with two match toggles or none */
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static u32 get_le(const u8 *p, unsigned int n)
+{
+	u32 v = 0;
+
+	while (n--)
+		v = (v << 8) | p[n];
+
+	return v;
+}
+
+static void put_le(u8 *p, u32 v, unsigned int n)
+{
+	while (n--) {
+		*p++ = v & 0xFF;
+		v >>= 8;
+	}
+}
+
+/* PCM 8 bit unsigned or 16 bit signed, the first channel is kept */
+static int read_wav(const char *path, struct input *in)
+{
+	unsigned int channels = 0, bits = 0, frame;
+	u8 hdr[8], fmt[16], *buf = NULL;
+	u32 len, n = 0;
+	size_t i;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (fread(hdr, 1, 8, f) != 8 || memcmp(hdr, "RIFF", 4)
+	    || fread(hdr, 1, 4, f) != 4 || memcmp(hdr, "WAVE", 4))
+		goto bad;
+
+	while (fread(hdr, 1, 8, f) == 8) {
+		len = get_le(hdr + 4, 4);
+
+		if (!memcmp(hdr, "fmt ", 4) && len >= 16) {
+			if (fread(fmt, 1, 16, f) != 16)
+				goto bad;
+			if (get_le(fmt, 2) != 1)
+				goto bad;
+			channels = get_le(fmt + 2, 2);
+			in->rate = get_le(fmt + 4, 4);
+			bits = get_le(fmt + 14, 2);
+			fseek(f, len - 16 + (len & 1), SEEK_CUR);
+		} else if (!memcmp(hdr, "data", 4) && channels) {
+			buf = malloc(len);
+			if (!buf)
+				goto bad;
+			n = fread(buf, 1, len, f);
+			break;
+		} else {
+			fseek(f, len + (len & 1), SEEK_CUR);
+		}
+	}
+
+	if (!buf || (bits != 8 && bits != 16) || !in->rate)
+		goto bad;
+
+	in->fmt_size = bits / 8;
+	in->is_signed = bits == 16;
+	frame = channels * in->fmt_size;
+	in->count = n / frame;
+
+	/* mono in place, frame >= fmt_size so nothing is overwritten early */
+	for (i = 0; i < in->count; i++)
+		memmove(buf + i * in->fmt_size, buf + i * frame, in->fmt_size);
+
+	in->data = buf;
+	fclose(f);
+
+	return 0;
+
+      bad:
+	fprintf(stderr, "%s: not an 8 or 16 bit PCM wav file\n", path);
+	free(buf);
+	fclose(f);
+
+	return -1;
+}
+
+static int write_wav(const char *path, const double *y, size_t count,
+		     unsigned int rate)
+{
+	u8 hdr[44], s[2];
+	size_t i;
+	long v;
+	FILE *f;
+
+	f = fopen(path, "wb");
+	if (!f) {
+		fprintf(stderr, "open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	memcpy(hdr, "RIFF", 4);
+	put_le(hdr + 4, 36 + count * 2, 4);
+	memcpy(hdr + 8, "WAVEfmt ", 8);
+	put_le(hdr + 16, 16, 4);
+	put_le(hdr + 20, 1, 2);
+	put_le(hdr + 22, 1, 2);
+	put_le(hdr + 24, rate, 4);
+	put_le(hdr + 28, rate * 2, 4);
+	put_le(hdr + 32, 2, 2);
+	put_le(hdr + 34, 16, 2);
+	memcpy(hdr + 36, "data", 4);
+	put_le(hdr + 40, count * 2, 4);
+	fwrite(hdr, 1, sizeof(hdr), f);
+
+	/* the pin is 0 to 1, centre it */
+	for (i = 0; i < count; i++) {
+		v = lrint((y[i] - 0.5) * 65534);
+		if (v > 32767)
+			v = 32767;
+		else if (v < -32768)
+			v = -32768;
+		put_le(s, (u32)v, 2);
+		fwrite(s, 1, 2, f);
+	}
+
+	return fclose(f);
+}
+
+static int make_tone(struct input *in, double hz, double amp, double secs)
+{
+	size_t i;
+	long v;
+
+	in->fmt_size = 2;
+	in->is_signed = 1;
+	in->count = secs * in->rate;
+	in->data = malloc(in->count * 2);
+	if (!in->data)
+		return -1;
+
+	for (i = 0; i < in->count; i++) {
+		v = lrint(amp * 32767 * sin(2 * M_PI * hz * i / in->rate));
+		put_le(in->data + i * 2, (u32)v, 2);
+	}
+
+	return 0;
+}
+
+/* what the input asks for, 0 to 1, before any timer rounding */
+static double level(const struct input *in, size_t i)
+{
+	const u8 *p = in->data + i * in->fmt_size;
+	double full = 1 << (8 * in->fmt_size);
+	u32 v = get_le(p, in->fmt_size);
+
+	if (in->is_signed)
+		v ^= 1u << (8 * in->fmt_size - 1);
+
+	return v / full;
+}
+
+/* pwm_channel_config() then pwm_channel_enable(), as pwmsp does it */
+static void apply(struct timer *t, u32 clock, int carrier, int duty)
+{
+	int freq = pwmsp_conv_frequency(clock, carrier);
+	u32 tmar;
+
+	/* pwm_update_frequency() restarts the period on a change only */
+	if (freq != t->frequency) {
+		t->frequency = freq;
+		t->tldr = pwmsp_conv_tldr(clock, carrier);
+		t->tcrr = t->tldr;
+	}
+
+	/* a zero duty stops the counter and the pin holds its level */
+	if (duty) {
+		tmar = pwmsp_conv_tmar(t->tldr, duty);
+
+		/*
+		 * Stopping and restarting keeps TCRR, so a new TMAR the
+		 * counter has already passed, or one behind it when the old
+		 * one was not reached yet, inverts the output from here on.
+		 */
+		if (t->running && (t->tcrr >= t->tmar) == (tmar > t->tcrr))
+			t->glitches++;
+
+		t->tmar = tmar;
+		t->running = 1;
+	} else {
+		t->running = 0;
+	}
+}
+
+/* toggle on overflow and on match, TRG_OVFL_MATCH with PT set */
+static inline void tick(struct timer *t)
+{
+	if (!t->running)
+		return;
+
+	if (t->tcrr == 0xFFFFFFFF) {
+		t->tcrr = t->tldr;
+		t->pin ^= 1;
+	} else {
+		t->tcrr++;
+	}
+
+	if (t->tcrr == t->tmar)
+		t->pin ^= 1;
+}
+
+/* amplitude of hz in x, Goertzel */
+static double tone_amplitude(const double *x, size_t n, double hz,
+			     unsigned int rate)
+{
+	double w = 2 * M_PI * hz / rate, c = 2 * cos(w);
+	double s0, s1 = 0, s2 = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		s0 = x[i] + c * s1 - s2;
+		s2 = s1;
+		s1 = s0;
+	}
+
+	return 2 * sqrt(s1 * s1 + s2 * s2 - c * s1 * s2) / n;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-c clock] [-b carrier] [-r rate] "
+		"[-f cutoff] [-o out.wav] [-t regs.csv] [-F hz]\n"
+		"       (in.wav | -g hz [-a amplitude] [-d seconds])\n",
+		argv0);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct input in = { 0 };
+	struct timer t = { 0 };
+	u32 clock = PWM_INPUT_32K;
+	int carrier = BASE_CLOCK;
+	double cutoff = 0, tone = 0, amp = 0.9, secs = 1, fund = 0;
+	const char *out = NULL, *regs = NULL, *src = "tone";
+	double a, y1 = 0, y2 = 0, r1 = 0, r2 = 0, x;
+	double *y, *ref, sx = 0, sy = 0, sxx = 0, sxy = 0, gain, off;
+	double sig = 0, noise = 0, mean, h1 = 0, hn = 0, h;
+	unsigned int rate = 0, k;
+	uint64_t start, tk, end_tk, conv_ns, render_ns, conv_n = 0;
+	volatile u32 sink = 0;
+	size_t i, skip, n;
+	FILE *rf = NULL;
+	int opt, duty;
+
+	while ((opt = getopt(argc, argv, "c:b:r:f:o:t:F:g:a:d:")) != -1) {
+		switch (opt) {
+		case 'c':
+			clock = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			carrier = strtol(optarg, NULL, 0);
+			break;
+		case 'r':
+			rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			cutoff = atof(optarg);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 't':
+			regs = optarg;
+			break;
+		case 'F':
+			fund = atof(optarg);
+			break;
+		case 'g':
+			tone = atof(optarg);
+			break;
+		case 'a':
+			amp = atof(optarg);
+			break;
+		case 'd':
+			secs = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (tone > 0) {
+		in.rate = rate ? rate : 8000;
+		if (make_tone(&in, tone, amp, secs))
+			return 1;
+		fund = tone;
+	} else if (optind < argc) {
+		src = argv[optind];
+		if (read_wav(src, &in))
+			return 1;
+		if (rate)
+			in.rate = rate;
+	} else {
+		usage(argv[0]);
+	}
+
+	if (!clock || !in.count || clock < in.rate) {
+		fprintf(stderr, "nothing to render\n");
+		return 1;
+	}
+
+	if (cutoff <= 0)
+		cutoff = in.rate * 0.45;
+
+	/* sample to register path alone, repeated for a stable number */
+	start = now_ns();
+	do {
+		for (i = 0; i < in.count; i++) {
+			duty = pwmsp_conv_duty(in.data + i * in.fmt_size,
+					       in.fmt_size, in.is_signed);
+			sink += pwmsp_conv_tmar(pwmsp_conv_tldr(clock, carrier),
+						duty);
+		}
+		conv_n += in.count;
+	} while (now_ns() - start < 200000000ULL);
+	conv_ns = now_ns() - start;
+
+	y = malloc(in.count * sizeof(*y));
+	ref = malloc(in.count * sizeof(*ref));
+	if (!y || !ref)
+		return 1;
+
+	if (regs) {
+		rf = fopen(regs, "w");
+		if (!rf) {
+			fprintf(stderr, "open %s: %s\n", regs, strerror(errno));
+			return 1;
+		}
+		fprintf(rf, "sample,duty,tldr,tmar,running\n");
+	}
+
+	/* two RC sections at the cutoff, stepped once per timer tick */
+	a = 1 - exp(-2 * M_PI * cutoff / clock);
+	tk = 0;
+
+	start = now_ns();
+	for (i = 0; i < in.count; i++) {
+		duty = pwmsp_conv_duty(in.data + i * in.fmt_size,
+				       in.fmt_size, in.is_signed);
+		apply(&t, clock, carrier, duty);
+
+		if (rf)
+			fprintf(rf, "%zu,%d,0x%08x,0x%08x,%d\n", i, duty,
+				t.tldr, t.tmar, t.running);
+
+		x = level(&in, i);
+		end_tk = (uint64_t)(i + 1) * clock / in.rate;
+
+		for (; tk < end_tk; tk++) {
+			tick(&t);
+			y1 += a * (t.pin - y1);
+			y2 += a * (y1 - y2);
+			r1 += a * (x - r1);
+			r2 += a * (r1 - r2);
+		}
+
+		y[i] = y2;
+		ref[i] = r2;
+	}
+	render_ns = now_ns() - start;
+
+	if (rf)
+		fclose(rf);
+
+	if (out && write_wav(out, y, in.count, in.rate))
+		return 1;
+
+	/* leave out the filter settling, 10 time constants */
+	skip = 10 * in.rate / (2 * M_PI * cutoff) + 1;
+	if (skip >= in.count)
+		skip = 0;
+	n = in.count - skip;
+
+	/* least squares y = gain * ref + off, the rest is noise */
+	for (i = skip; i < in.count; i++) {
+		sx += ref[i];
+		sy += y[i];
+		sxx += ref[i] * ref[i];
+		sxy += ref[i] * y[i];
+	}
+	mean = sx / n;
+	gain = sxx - sx * mean > 0 ? (sxy - mean * sy) / (sxx - sx * mean) : 0;
+	off = (sy - gain * sx) / n;
+
+	for (i = skip; i < in.count; i++) {
+		x = gain * ref[i] + off;
+		sig += (x - gain * mean - off) * (x - gain * mean - off);
+		noise += (y[i] - x) * (y[i] - x);
+	}
+
+	printf("{\"input\":\"%s\",\"samples\":%zu,\"rate\":%u,"
+	       "\"clock\":%u,\"carrier\":%d,\"period_ticks\":%u,"
+	       "\"cutoff\":%.1f,\"gain\":%.4f,\"snr_db\":%.2f",
+	       src, in.count, in.rate, clock, t.frequency,
+	       0xFFFFFFFF - t.tldr + 1, cutoff, gain,
+	       noise > 0 && sig > 0 ? 10 * log10(sig / noise) : 0.0);
+
+	if (fund > 0 && fund < in.rate / 2.0) {
+		h1 = tone_amplitude(y + skip, n, fund, in.rate);
+		for (k = 2; k <= MAX_HARMONIC && k * fund < in.rate / 2.0;
+		     k++) {
+			h = tone_amplitude(y + skip, n, k * fund, in.rate);
+			hn += h * h;
+		}
+
+		if (h1 > 0 && hn > 0)
+			printf(",\"thd_db\":%.2f,\"thd_pct\":%.4f",
+			       20 * log10(sqrt(hn) / h1),
+			       100 * sqrt(hn) / h1);
+	}
+
+	printf(",\"tmar_glitches\":%lu", t.glitches);
+	printf(",\"conversions_per_s\":%.0f,\"render_ticks_per_s\":%.0f}\n",
+	       conv_n * 1e9 / conv_ns, tk * 1e9 / (render_ns ? render_ns : 1));
+
+	free(y);
+	free(ref);
+	free(in.data);
+
+	return sink == 0xDEADBEEF;
+}